@@ -0,0 +1,331 @@
+#include "platform.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+
+#include "logging.h"
+#include "array.h"
+#include "atlas.h"
+
+bool nqiv_atlas_manager_init(nqiv_atlas_manager* manager,
+                             nqiv_log_ctx*       logger,
+                             SDL_Renderer*       renderer,
+                             const int           size)
+{
+	assert(manager != NULL);
+	assert(logger != NULL);
+	assert(renderer != NULL);
+	assert(size >= 0);
+	memset(manager, 0, sizeof(nqiv_atlas_manager));
+	manager->atlases = nqiv_array_create(sizeof(nqiv_atlas*), 1);
+	if(manager->atlases == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR, "Failed to allocate atlas list.\n");
+		return false;
+	}
+	nqiv_array_unlimit_data(manager->atlases);
+	manager->logger = logger;
+	manager->renderer = renderer;
+	manager->size = size > NQIV_ATLAS_MAX_SIZE ? NQIV_ATLAS_MAX_SIZE : size;
+	return true;
+}
+
+void nqiv_atlas_destroy(nqiv_atlas* atlas)
+{
+	if(atlas->texture != NULL) {
+		SDL_DestroyTexture(atlas->texture);
+	}
+	if(atlas->taken != NULL) {
+		free(atlas->taken);
+	}
+	if(atlas->clear_pixels != NULL) {
+		free(atlas->clear_pixels);
+	}
+	if(atlas->vertices != NULL) {
+		nqiv_array_destroy(atlas->vertices);
+	}
+	if(atlas->indices != NULL) {
+		nqiv_array_destroy(atlas->indices);
+	}
+	free(atlas);
+}
+
+void nqiv_atlas_manager_destroy(nqiv_atlas_manager* manager)
+{
+	if(manager->atlases == NULL) {
+		return;
+	}
+	nqiv_atlas** atlases = manager->atlases->data;
+	const int    count = nqiv_array_get_units_count(manager->atlases);
+	int          idx;
+	for(idx = 0; idx < count; ++idx) {
+		nqiv_atlas_destroy(atlases[idx]);
+	}
+	nqiv_array_destroy(manager->atlases);
+	memset(manager, 0, sizeof(nqiv_atlas_manager));
+}
+
+/* Slots of slot_size fitting across the largest atlas. The last slot of a shelf needs no gutter
+ * after it. */
+int nqiv_atlas_manager_get_columns(const nqiv_atlas_manager* manager, const int slot_size)
+{
+	return (manager->size + NQIV_ATLAS_GUTTER) / (slot_size + NQIV_ATLAS_GUTTER);
+}
+
+nqiv_atlas* nqiv_atlas_create(nqiv_atlas_manager* manager, const Uint32 format, const int slot_size)
+{
+	const int   stride = slot_size + NQIV_ATLAS_GUTTER;
+	nqiv_atlas* atlas = calloc(1, sizeof(nqiv_atlas));
+	if(atlas == NULL) {
+		return NULL;
+	}
+	atlas->parent = manager;
+	atlas->format = format;
+	atlas->slot_size = slot_size;
+	atlas->columns = nqiv_atlas_manager_get_columns(manager, slot_size);
+	atlas->rows = atlas->columns;
+	atlas->size = atlas->columns * stride - NQIV_ATLAS_GUTTER;
+	atlas->taken = calloc(atlas->columns * atlas->rows, sizeof(bool));
+	atlas->clear_pixels = calloc(slot_size + 2 * NQIV_ATLAS_GUTTER, SDL_BYTESPERPIXEL(format));
+	atlas->vertices = nqiv_array_create(sizeof(SDL_Vertex), NQIV_ATLAS_BATCH_LENGTH * 4);
+	atlas->indices = nqiv_array_create(sizeof(int), NQIV_ATLAS_BATCH_LENGTH * 6);
+	atlas->texture = SDL_CreateTexture(manager->renderer, format, SDL_TEXTUREACCESS_STATIC,
+	                                   atlas->size, atlas->size);
+	if(atlas->taken == NULL || atlas->clear_pixels == NULL || atlas->vertices == NULL
+	   || atlas->indices == NULL || atlas->texture == NULL
+	   || SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND) != 0) {
+		nqiv_log_write(manager->logger, NQIV_LOG_WARNING,
+		               "Failed to create %dx%d atlas for thumbnails of size %d (%s).\n",
+		               atlas->size, atlas->size, slot_size, SDL_GetError());
+		nqiv_atlas_destroy(atlas);
+		return NULL;
+	}
+	nqiv_array_unlimit_data(atlas->vertices);
+	nqiv_array_unlimit_data(atlas->indices);
+	if(!nqiv_array_push(manager->atlases, &atlas)) {
+		nqiv_log_write(manager->logger, NQIV_LOG_ERROR, "Failed to add atlas to list.\n");
+		nqiv_atlas_destroy(atlas);
+		return NULL;
+	}
+	nqiv_log_write(manager->logger, NQIV_LOG_DEBUG,
+	               "Created %dx%d atlas with %d slots for thumbnails of size %d.\n", atlas->size,
+	               atlas->size, atlas->columns * atlas->rows, slot_size);
+	return atlas;
+}
+
+/* Destroy every atlas with no slots taken and no geometry waiting, but one for the current slot
+ * size. */
+void nqiv_atlas_manager_drop_empty(nqiv_atlas_manager* manager)
+{
+	nqiv_atlas** atlases = manager->atlases->data;
+	bool         spare = false;
+	int          idx;
+	for(idx = nqiv_array_get_units_count(manager->atlases) - 1; idx >= 0; --idx) {
+		nqiv_atlas* atlas = atlases[idx];
+		if(atlas->taken_count > 0 || nqiv_array_get_units_count(atlas->vertices) > 0) {
+			continue;
+		}
+		if(!spare && atlas->slot_size == manager->slot_size) {
+			spare = true;
+			continue;
+		}
+		nqiv_array_remove(manager->atlases, idx);
+		nqiv_atlas_destroy(atlas);
+	}
+}
+
+/* Clear a line of pixels next to a thumbnail, if it's inside the atlas. */
+bool nqiv_atlas_clear_line(nqiv_atlas* atlas, const SDL_Rect* line)
+{
+	if(line->x < 0 || line->y < 0 || line->x + line->w > atlas->size
+	   || line->y + line->h > atlas->size) {
+		return true;
+	}
+	return SDL_UpdateTexture(atlas->texture, line, atlas->clear_pixels,
+	                         line->w * SDL_BYTESPERPIXEL(atlas->format))
+	       == 0;
+}
+
+bool nqiv_atlas_upload(nqiv_atlas* atlas, SDL_Surface* surface, const SDL_Rect* rect)
+{
+	if(SDL_UpdateTexture(atlas->texture, rect, surface->pixels, surface->pitch) != 0) {
+		return false;
+	}
+	/* Whatever was in the slot before is cleared off on each side. */
+	const int      gutter = NQIV_ATLAS_GUTTER;
+	const SDL_Rect lines[] = {
+		{rect->x - gutter, rect->y - gutter, rect->w + 2 * gutter, gutter},
+		{rect->x - gutter, rect->y + rect->h, rect->w + 2 * gutter, gutter},
+		{rect->x - gutter, rect->y, gutter, rect->h},
+		{rect->x + rect->w, rect->y, gutter, rect->h},
+	};
+	int idx;
+	for(idx = 0; idx < (int)(sizeof(lines) / sizeof(SDL_Rect)); ++idx) {
+		if(!nqiv_atlas_clear_line(atlas, &lines[idx])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool nqiv_atlas_manager_add(nqiv_atlas_manager* manager,
+                            SDL_Surface*        surface,
+                            const int           slot_size,
+                            nqiv_atlas_slot*    slot)
+{
+	assert(manager != NULL);
+	assert(surface != NULL);
+	assert(slot != NULL);
+	assert(slot->atlas == NULL);
+	if(slot_size <= 0 || surface->w > slot_size || surface->h > slot_size) {
+		return false;
+	}
+	const int columns = nqiv_atlas_manager_get_columns(manager, slot_size);
+	if(columns * columns < NQIV_ATLAS_MIN_SLOTS) {
+		return false;
+	}
+	if(slot_size != manager->slot_size) {
+		manager->slot_size = slot_size;
+		nqiv_atlas_manager_drop_empty(manager);
+	}
+	nqiv_atlas** atlases = manager->atlases->data;
+	const int    count = nqiv_array_get_units_count(manager->atlases);
+	nqiv_atlas*  atlas = NULL;
+	int          idx;
+	for(idx = 0; idx < count; ++idx) {
+		if(atlases[idx]->slot_size == slot_size && atlases[idx]->format == surface->format->format
+		   && atlases[idx]->taken_count < atlases[idx]->columns * atlases[idx]->rows) {
+			atlas = atlases[idx];
+			break;
+		}
+	}
+	if(atlas == NULL) {
+		atlas = nqiv_atlas_create(manager, surface->format->format, slot_size);
+		if(atlas == NULL) {
+			return false;
+		}
+	}
+	/* There must be a free slot, by the count. */
+	idx = 0;
+	while(atlas->taken[idx]) {
+		++idx;
+	}
+	const int stride = slot_size + NQIV_ATLAS_GUTTER;
+	slot->atlas = atlas;
+	slot->index = idx;
+	slot->rect.x = (idx % atlas->columns) * stride;
+	slot->rect.y = (idx / atlas->columns) * stride;
+	slot->rect.w = surface->w;
+	slot->rect.h = surface->h;
+	slot->id = ++manager->last_id;
+	atlas->taken[idx] = true;
+	++atlas->taken_count;
+	if(!nqiv_atlas_upload(atlas, surface, &slot->rect)) {
+		nqiv_log_write(manager->logger, NQIV_LOG_WARNING,
+		               "Failed to copy thumbnail into atlas (%s).\n", SDL_GetError());
+		nqiv_atlas_slot_release(slot);
+		return false;
+	}
+	return true;
+}
+
+nqiv_atlas* nqiv_atlas_manager_find(nqiv_atlas_manager* manager, const SDL_Texture* texture)
+{
+	if(manager->atlases == NULL || texture == NULL) {
+		return NULL;
+	}
+	nqiv_atlas** atlases = manager->atlases->data;
+	const int    count = nqiv_array_get_units_count(manager->atlases);
+	int          idx;
+	for(idx = 0; idx < count; ++idx) {
+		if(atlases[idx]->texture == texture) {
+			return atlases[idx];
+		}
+	}
+	return NULL;
+}
+
+bool nqiv_atlas_queue(nqiv_atlas* atlas, const SDL_Rect* srcrect, const SDL_Rect* dstrect)
+{
+	assert(atlas != NULL);
+	assert(srcrect != NULL);
+	assert(dstrect != NULL);
+	const float size = (float)atlas->size;
+	const float left = (float)srcrect->x / size;
+	const float top = (float)srcrect->y / size;
+	const float right = (float)(srcrect->x + srcrect->w) / size;
+	const float bottom = (float)(srcrect->y + srcrect->h) / size;
+	const SDL_Color white = {255, 255, 255, 255};
+	const SDL_Vertex vertices[4] = {
+		{{(float)dstrect->x, (float)dstrect->y}, white, {left, top}},
+		{{(float)(dstrect->x + dstrect->w), (float)dstrect->y}, white, {right, top}},
+		{{(float)(dstrect->x + dstrect->w), (float)(dstrect->y + dstrect->h)},
+		 white,
+		 {right, bottom}},
+		{{(float)dstrect->x, (float)(dstrect->y + dstrect->h)}, white, {left, bottom}},
+	};
+	const int first = nqiv_array_get_units_count(atlas->vertices);
+	const int indices[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+	if(!nqiv_array_push_count(atlas->vertices, vertices, 4)) {
+		nqiv_log_write(atlas->parent->logger, NQIV_LOG_ERROR,
+		               "Failed to grow atlas geometry.\n");
+		return false;
+	}
+	if(!nqiv_array_push_count(atlas->indices, indices, 6)) {
+		nqiv_array_pop_count(atlas->vertices, NULL, 4);
+		nqiv_log_write(atlas->parent->logger, NQIV_LOG_ERROR,
+		               "Failed to grow atlas geometry.\n");
+		return false;
+	}
+	return true;
+}
+
+bool nqiv_atlas_manager_flush(nqiv_atlas_manager* manager, const SDL_ScaleMode scale_mode)
+{
+	assert(manager != NULL);
+	nqiv_atlas** atlases = manager->atlases->data;
+	bool         result = true;
+	int          idx;
+	for(idx = nqiv_array_get_units_count(manager->atlases) - 1; idx >= 0; --idx) {
+		nqiv_atlas* atlas = atlases[idx];
+		const int   vertex_count = nqiv_array_get_units_count(atlas->vertices);
+		if(vertex_count == 0) {
+			continue;
+		}
+		if(result
+		   && (SDL_SetTextureScaleMode(atlas->texture, scale_mode) != 0
+		       || SDL_RenderGeometry(manager->renderer, atlas->texture, atlas->vertices->data,
+		                             vertex_count, atlas->indices->data,
+		                             nqiv_array_get_units_count(atlas->indices))
+		              != 0)) {
+			nqiv_log_write(manager->logger, NQIV_LOG_ERROR,
+			               "Failed to draw thumbnails from atlas (%s).\n", SDL_GetError());
+			result = false;
+		}
+		/* Leave nothing behind for the next batch, even on failure. */
+		nqiv_array_clear(atlas->vertices);
+		nqiv_array_clear(atlas->indices);
+	}
+	/* Some may have been emptied while their geometry was waiting. See nqiv_atlas_slot_release. */
+	nqiv_atlas_manager_drop_empty(manager);
+	return result;
+}
+
+void nqiv_atlas_slot_release(nqiv_atlas_slot* slot)
+{
+	assert(slot != NULL);
+	nqiv_atlas* atlas = slot->atlas;
+	if(atlas == NULL) {
+		return;
+	}
+	assert(atlas->taken[slot->index]);
+	atlas->taken[slot->index] = false;
+	--atlas->taken_count;
+	memset(slot, 0, sizeof(nqiv_atlas_slot));
+	/* If geometry is waiting on it, nqiv_atlas_manager_flush destroys it instead. */
+	if(atlas->taken_count == 0) {
+		nqiv_atlas_manager_drop_empty(atlas->parent);
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef NQIV_ATLAS_H
+#define NQIV_ATLAS_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "typedefs.h"
+#include "logging.h"
+#include "array.h"
+
+/*
+ * Rather than a texture each, thumbnails are packed into a few large atlas textures. That way, the
+ * montage is drawn with a batch of geometry per atlas, instead of a copy per thumbnail.
+ *
+ * Each atlas is cut into shelves as tall as the thumbnail size, and each shelf into slots as wide
+ * as it, so any thumbnail fits in any free slot. An atlas is made just large enough for as many
+ * slots as fit across the largest one allowed. If fewer than NQIV_ATLAS_MIN_SLOTS fit, thumbnails
+ * are given textures of their own instead, since an atlas would save little drawing.
+ *
+ * A slot is taken when a thumbnail is loaded into a texture, and given back when it's unloaded,
+ * whether by the pruner or otherwise. Once an atlas has no slots taken, it's destroyed, except for
+ * one kept for the current thumbnail size, so scrolling doesn't keep making and destroying
+ * textures. Once the thumbnail size changes, new atlases are made for the new size, and each old
+ * one is destroyed as soon as its last slot is given back.
+ *
+ * While batching is set, copies from an atlas are collected as geometry instead of drawn.
+ * nqiv_atlas_manager_flush then draws each atlas' geometry at once. Like any texture, atlases are
+ * only to be touched by the master thread.
+ */
+
+/* Largest width and height of an atlas texture, if the renderer allows. */
+#define NQIV_ATLAS_MAX_SIZE 2048
+/* Pixels kept between slots and cleared around each thumbnail, so filtering doesn't blend
+ * neighbours together. */
+#define NQIV_ATLAS_GUTTER 1
+/* Fewest slots an atlas may have. */
+#define NQIV_ATLAS_MIN_SLOTS 4
+/* Starting length of geometry batches, in quads. */
+#define NQIV_ATLAS_BATCH_LENGTH 64
+
+typedef struct nqiv_atlas
+{
+	nqiv_atlas_manager* parent;
+	SDL_Texture*        texture;
+	Uint32              format;
+	/* Width and height of the texture. */
+	int                 size;
+	/* Width and height of each slot. */
+	int                 slot_size;
+	int                 columns;
+	int                 rows;
+	/* Which slots are taken, by index. */
+	bool*               taken;
+	int                 taken_count;
+	/* Transparent pixels to clear the gutter around a thumbnail with. */
+	void*               clear_pixels;
+	/* Geometry collected while batching. */
+	nqiv_array*         vertices;
+	nqiv_array*         indices;
+} nqiv_atlas;
+
+/* Where a thumbnail is kept. Belongs to an image form, and is only touched by the master. */
+typedef struct nqiv_atlas_slot
+{
+	/* NULL if the form has no slot. */
+	nqiv_atlas* atlas;
+	int         index;
+	/* Area of the atlas texture holding the thumbnail. */
+	SDL_Rect    rect;
+	/* Unique to each slot taken, so the same texture in a different slot can be told apart. 0 if
+	 * none. */
+	Uint64      id;
+} nqiv_atlas_slot;
+
+struct nqiv_atlas_manager
+{
+	nqiv_log_ctx* logger;
+	SDL_Renderer* renderer;
+	/* Largest width and height of atlas textures. 0 if atlases aren't used at all. */
+	int           size;
+	/* Slot size of the last thumbnail added, for which an empty atlas is kept. */
+	int           slot_size;
+	/* Of nqiv_atlas* */
+	nqiv_array*   atlases;
+	Uint64        last_id;
+	bool          batching;
+};
+
+/* Size is limited to NQIV_ATLAS_MAX_SIZE. */
+bool nqiv_atlas_manager_init(nqiv_atlas_manager* manager,
+                             nqiv_log_ctx*       logger,
+                             SDL_Renderer*       renderer,
+                             const int           size);
+void nqiv_atlas_manager_destroy(nqiv_atlas_manager* manager);
+/* Copy the surface into a free slot of an atlas with slots of slot_size, making a new atlas if
+ * none has room. Returns false if it can't be kept in an atlas, in which case it should be given
+ * a texture of its own. Atlases for other slot sizes with nothing in them are destroyed. */
+bool nqiv_atlas_manager_add(nqiv_atlas_manager* manager,
+                            SDL_Surface*        surface,
+                            const int           slot_size,
+                            nqiv_atlas_slot*    slot);
+/* The atlas which texture belongs to, or NULL. */
+nqiv_atlas* nqiv_atlas_manager_find(nqiv_atlas_manager* manager, const SDL_Texture* texture);
+/* Draw the geometry collected for every atlas, one call each. */
+bool        nqiv_atlas_manager_flush(nqiv_atlas_manager* manager, const SDL_ScaleMode scale_mode);
+/* Collect a copy from srcrect of the atlas to dstrect, like SDL_RenderCopy. */
+bool        nqiv_atlas_queue(nqiv_atlas* atlas, const SDL_Rect* srcrect, const SDL_Rect* dstrect);
+/* Give back the slot, destroying its atlas if it's the last one taken, unless it's kept spare. */
+void        nqiv_atlas_slot_release(nqiv_atlas_slot* slot);
+
+#endif /* NQIV_ATLAS_H */
@@ -63,6 +63,32 @@ bool nqiv_cmd_parser_set_thread_count(nqiv_cmd_manager* manager, nqiv_cmd_arg_to
 	return true;
 }
 
+bool nqiv_cmd_parser_set_thread_min_count(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_min_count = tokens[0]->value.as_int;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_background_count(nqiv_cmd_manager*    manager,
+                                                  nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_background_count = tokens[0]->value.as_int;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_governor_interval(nqiv_cmd_manager*    manager,
+                                                  nqiv_cmd_arg_token** tokens)
+{
+	manager->state->governor_interval = tokens[0]->value.as_int;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_io_count(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->io_thread_count = tokens[0]->value.as_int;
+	return true;
+}
+
 bool nqiv_cmd_parser_set_thread_event_interval(nqiv_cmd_manager*    manager,
                                                nqiv_cmd_arg_token** tokens)
 {
@@ -70,6 +96,31 @@ bool nqiv_cmd_parser_set_thread_event_interval(nqiv_cmd_manager*    manager,
 	return true;
 }
 
+bool nqiv_cmd_parser_set_thread_aging_interval(nqiv_cmd_manager*    manager,
+                                               nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_aging_interval = tokens[0]->value.as_int;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_niceness(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_niceness = tokens[0]->value.as_int;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_idle(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_idle = tokens[0]->value.as_bool;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_thread_master_cpu(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->thread_master_cpu = tokens[0]->value.as_int;
+	return true;
+}
+
 bool nqiv_cmd_parser_set_vips_threads(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
 {
 	manager->state->vips_threads = tokens[0]->value.as_int;
@@ -210,6 +261,12 @@ bool nqiv_cmd_parser_set_zoom_scale_mode(nqiv_cmd_manager* manager, nqiv_cmd_arg
 	return true;
 }
 
+bool nqiv_cmd_parser_set_zoom_refine_delay(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->refine_delay = tokens[0]->value.as_int;
+	return true;
+}
+
 bool nqiv_cmd_parser_set_thumbnail_load(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
 {
 	manager->state->images.thumbnail.load = tokens[0]->value.as_bool;
@@ -229,6 +286,18 @@ bool nqiv_cmd_parser_set_thumbnail_size(nqiv_cmd_manager* manager, nqiv_cmd_arg_
 	return nqiv_image_manager_reattempt_thumbnails(&manager->state->images, old_size);
 }
 
+bool nqiv_cmd_parser_set_max_pixels(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->images.max_pixels = tokens[0]->value.as_Uint64;
+	return true;
+}
+
+bool nqiv_cmd_parser_set_max_decode_time(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
+{
+	manager->state->images.max_decode_time = tokens[0]->value.as_Uint64;
+	return true;
+}
+
 bool nqiv_cmd_parser_set_default_frame_time(nqiv_cmd_manager* manager, nqiv_cmd_arg_token** tokens)
 {
 	manager->state->images.default_frame_time = tokens[0]->value.as_int;
@@ -506,11 +575,51 @@ void nqiv_cmd_parser_print_thread_count(nqiv_cmd_manager* manager)
 	fprintf(stdout, "%d", manager->state->thread_count);
 }
 
+void nqiv_cmd_parser_print_thread_min_count(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->thread_min_count);
+}
+
+void nqiv_cmd_parser_print_thread_background_count(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->thread_background_count);
+}
+
+void nqiv_cmd_parser_print_thread_governor_interval(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->governor_interval);
+}
+
+void nqiv_cmd_parser_print_thread_io_count(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->io_thread_count);
+}
+
 void nqiv_cmd_parser_print_thread_event_interval(nqiv_cmd_manager* manager)
 {
 	fprintf(stdout, "%d", manager->state->thread_event_interval);
 }
 
+void nqiv_cmd_parser_print_thread_aging_interval(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->thread_aging_interval);
+}
+
+void nqiv_cmd_parser_print_thread_niceness(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->thread_niceness);
+}
+
+void nqiv_cmd_parser_print_thread_idle(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%s", manager->state->thread_idle ? "true" : "false");
+}
+
+void nqiv_cmd_parser_print_thread_master_cpu(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->thread_master_cpu);
+}
+
 void nqiv_cmd_parser_print_vips_threads(nqiv_cmd_manager* manager)
 {
 	fprintf(stdout, "%d", manager->state->vips_threads);
@@ -611,6 +720,11 @@ void nqiv_cmd_parser_print_zoom_scale_mode(nqiv_cmd_manager* manager)
 	fprintf(stdout, "%s", nqiv_scale_mode_to_text(manager->state->texture_scale_mode));
 }
 
+void nqiv_cmd_parser_print_zoom_refine_delay(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%d", manager->state->refine_delay);
+}
+
 void nqiv_cmd_parser_print_thumbnail_load(nqiv_cmd_manager* manager)
 {
 	fprintf(stdout, "%s", manager->state->images.thumbnail.load ? "true" : "false");
@@ -626,6 +740,16 @@ void nqiv_cmd_parser_print_thumbnail_size(nqiv_cmd_manager* manager)
 	fprintf(stdout, "%d", manager->state->images.thumbnail.size);
 }
 
+void nqiv_cmd_parser_print_max_pixels(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%" PRIu64, manager->state->images.max_pixels);
+}
+
+void nqiv_cmd_parser_print_max_decode_time(nqiv_cmd_manager* manager)
+{
+	fprintf(stdout, "%" PRIu64, manager->state->images.max_decode_time);
+}
+
 void nqiv_cmd_parser_print_default_frame_time(nqiv_cmd_manager* manager)
 {
 	fprintf(stdout, "%d", manager->state->images.default_frame_time);
@@ -934,6 +1058,16 @@ const nqiv_cmd_arg_desc nqiv_parser_arg_type_int_positive = {
 	.setting = {.of_int = {.min = 1, .max = INT_MAX}},
 };
 
+const nqiv_cmd_arg_desc nqiv_parser_arg_type_int_niceness = {
+	.type = NQIV_CMD_ARG_INT,
+	.setting = {.of_int = {.min = 0, .max = 19}},
+};
+
+const nqiv_cmd_arg_desc nqiv_parser_arg_type_int_cpu = {
+	.type = NQIV_CMD_ARG_INT,
+	.setting = {.of_int = {.min = -1, .max = INT_MAX}},
+};
+
 const nqiv_cmd_arg_desc nqiv_parser_arg_type_Uint64 = {
 	.type = NQIV_CMD_ARG_UINT64,
 	.setting = {.of_Uint64 = {.min = (Uint64)0, .max = (Uint64)INT_MAX}},
@@ -2066,6 +2200,8 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 	                                           &nqiv_parser_arg_type_string_full, NULL};
 	const nqiv_cmd_arg_desc* natural_args[] = {&nqiv_parser_arg_type_int_natural, NULL};
 	const nqiv_cmd_arg_desc* positive_args[] = {&nqiv_parser_arg_type_int_positive, NULL};
+	const nqiv_cmd_arg_desc* niceness_args[] = {&nqiv_parser_arg_type_int_niceness, NULL};
+	const nqiv_cmd_arg_desc* cpu_args[] = {&nqiv_parser_arg_type_int_cpu, NULL};
 	const nqiv_cmd_arg_desc* uint64_args[] = {&nqiv_parser_arg_type_Uint64, NULL};
 	const nqiv_cmd_arg_desc* keyactionbrief_uint64_args[] = {&nqiv_parser_arg_type_key_action_brief,
 	                                                         &nqiv_parser_arg_type_Uint64, NULL};
@@ -2157,10 +2293,37 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 		B("thread", "Settings related to thread behavior.");
 		{
 			L("count",
-			  "Set the number of worker threads used by the software. Starts as the number of "
-			  "threads on the machine divided by three (or one). This does not count toward VIPs "
-			  "threads. See 'set vips threads' for that.",
+			  "Set the number of worker threads used by the software. Starts as a third of the "
+			  "threads available to nqiv (or one), respecting CPU affinity and cgroup quotas. "
+			  "Unless 'set thread governor_interval' is 0, only some of them are active at a time. "
+			  "This does not count toward VIPs threads. See 'set vips threads' for that.",
 			  nqiv_cmd_parser_set_thread_count, nqiv_cmd_parser_print_thread_count, positive_args);
+			L("min_count",
+			  "The governor will keep at least this many worker threads active. Starts as 1.",
+			  nqiv_cmd_parser_set_thread_min_count, nqiv_cmd_parser_print_thread_min_count,
+			  positive_args);
+			L("background_count",
+			  "While the window is hidden, minimized or without focus, at most this many worker "
+			  "threads, and as many I/O worker threads, are active, so loading carries on slowly "
+			  "in the background. Nothing new is drawn or loaded while it's hidden or minimized. "
+			  "Starts as 1. 0 means no limit.",
+			  nqiv_cmd_parser_set_thread_background_count,
+			  nqiv_cmd_parser_print_thread_background_count, natural_args);
+			L("governor_interval",
+			  "Every this many milliseconds, the governor measures how many events are queued, "
+			  "how many were processed, and how busy the processors are. It then activates or "
+			  "parks a worker thread, starting from a third of the available threads, and divides "
+			  "the available threads between the VIPs threads of each active worker. 0 keeps all "
+			  "worker threads active and leaves VIPs threads as set.",
+			  nqiv_cmd_parser_set_thread_governor_interval,
+			  nqiv_cmd_parser_print_thread_governor_interval, natural_args);
+			L("io_count",
+			  "Set the number of worker threads which read the files of images ahead of the "
+			  "others, so those are not left waiting on the disk. Starts as the number of threads "
+			  "on the machine divided by six (or one). These are in addition to 'set thread "
+			  "count'. 0 means the other worker threads read files themselves.",
+			  nqiv_cmd_parser_set_thread_io_count, nqiv_cmd_parser_print_thread_io_count,
+			  natural_args);
 			L("event_interval",
 			  "After waking, worker threads will check for events and process at most this many "
 			  "before waking the master and going back to sleep. Longer times might produce longer "
@@ -2168,15 +2331,37 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 			  "help UI responsiveness. 0 means they will process all available events.",
 			  nqiv_cmd_parser_set_thread_event_interval,
 			  nqiv_cmd_parser_print_thread_event_interval, natural_args);
+			L("aging_interval",
+			  "Worker threads take the highest priority events first, such as thumbnails closest to "
+			  "the selection. So lower priority events, like saving thumbnails, still get done, "
+			  "every this many milliseconds they wait raises their priority. 0 means they may wait "
+			  "indefinitely. Starts as 250.",
+			  nqiv_cmd_parser_set_thread_aging_interval,
+			  nqiv_cmd_parser_print_thread_aging_interval, natural_args);
+			L("niceness",
+			  "Worker threads run at this niceness, from 0 to 19, so they yield the processors to "
+			  "the rest of nqiv (and other programs) while busy loading and saving thumbnails. "
+			  "Only supported on Linux. 0 runs them at normal priority.",
+			  nqiv_cmd_parser_set_thread_niceness, nqiv_cmd_parser_print_thread_niceness,
+			  niceness_args);
+			L("idle",
+			  "Whether worker threads use the idle scheduling class, running only when the "
+			  "processors have nothing else to do. Only supported on Linux.",
+			  nqiv_cmd_parser_set_thread_idle, nqiv_cmd_parser_print_thread_idle, bool_args);
+			L("master_cpu",
+			  "Pin the thread handling input and rendering to this processor, and keep worker "
+			  "threads and VIPs threads off it. Only supported on Linux. -1 does not pin anything.",
+			  nqiv_cmd_parser_set_thread_master_cpu, nqiv_cmd_parser_print_thread_master_cpu,
+			  cpu_args);
 			L("prune_delay",
 			  "During updates to nqiv's state, a pruning cycle will be allowed to run if this many "
 			  "milliseconds has passed since the last "
 			  "one. 0 always allow prune cycles.",
 			  nqiv_cmd_parser_set_prune_delay, nqiv_cmd_parser_print_prune_delay, uint64_args);
 			L("extra_wakeup_delay",
-			  "In addition to an internal algorithm, wait this long before a worker thread awakens "
-			  "to check for events. Longer times might produce longer loading delays, but help "
-			  "improve UI responsiveness.",
+			  "Worker threads sleep until new events are sent to them. This caps how long (plus a "
+			  "small per-thread stagger) they sleep before checking for events anyway. 0 means "
+			  "they only wake when events are sent.",
 			  nqiv_cmd_parser_set_extra_wakeup_delay, nqiv_cmd_parser_print_extra_wakeup_delay,
 			  natural_args);
 			L("event_timeout",
@@ -2189,9 +2374,10 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 		{
 			L("threads",
 			  "Set the number of threads used by the VIPs library. The default is the number of "
-			  "available threads divided by two (or one). If set to 0, it is determined by the "
-			  "environment variable VIPS_CONCURRENCY, or if unset, the number of threads available "
-			  "on the machine.",
+			  "available threads divided by two (or one). The governor may lower it while more "
+			  "worker threads are active. If set to 0, it is determined by the environment "
+			  "variable VIPS_CONCURRENCY, or if unset, the number of threads available on the "
+			  "machine.",
 			  nqiv_cmd_parser_set_vips_threads, nqiv_cmd_parser_print_vips_threads, natural_args);
 		}
 		POP;
@@ -2252,6 +2438,13 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 			  "or 'anisotropic'.",
 			  nqiv_cmd_parser_set_zoom_scale_mode, nqiv_cmd_parser_print_zoom_scale_mode,
 			  string_args);
+			L("refine_delay",
+			  "While zooming or panning, images are scaled by SDL with the scale mode. Once the "
+			  "view stays the same for this many milliseconds, what's in view of a shrunken image "
+			  "is resampled by a worker thread to the exact size it's drawn at, with the Lanczos "
+			  "kernel, and shown instead. Animated images are not. 0 never resamples.",
+			  nqiv_cmd_parser_set_zoom_refine_delay, nqiv_cmd_parser_print_zoom_refine_delay,
+			  natural_args);
 		}
 		POP;
 		B("thumbnail", "Set operations related to thumbnails.");
@@ -2282,6 +2475,15 @@ bool nqiv_cmd_manager_build_cmdtree(nqiv_cmd_manager* manager)
 		L("default_frame_time", "If an animated image does not provide a frame time, use this.",
 		  nqiv_cmd_parser_set_default_frame_time, nqiv_cmd_parser_print_default_frame_time,
 		  intpositive_args);
+		L("max_pixels",
+		  "Images (or thumbnails) with more pixels than this, counting every frame, are shown as "
+		  "errors instead of being loaded. 0 means no limit.",
+		  nqiv_cmd_parser_set_max_pixels, nqiv_cmd_parser_print_max_pixels, uint64_args);
+		L("max_decode_time",
+		  "If decoding an image (or thumbnail) takes longer than this many milliseconds, it is "
+		  "stopped and shown as an error. Decoding is also stopped if the image is no longer "
+		  "going to be shown. 0 means no limit.",
+		  nqiv_cmd_parser_set_max_decode_time, nqiv_cmd_parser_print_max_decode_time, uint64_args);
 		B("keypress", "Settings for delaying and registering keypresses.");
 		{
 			DEPRECATE B(
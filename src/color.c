@@ -0,0 +1,216 @@
+#include "platform.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+#include <vips/vips.h>
+#include <glib/gstdio.h>
+
+#include "logging.h"
+#include "color.h"
+
+void nqiv_color_lut_log_vips_exception(nqiv_log_ctx* logger)
+{
+	char* error = vips_error_buffer_copy();
+	nqiv_log_write(logger, NQIV_LOG_WARNING, "Vips exception making color table (%s)\n", error);
+	g_free(error);
+}
+
+/* VIPS only reads output profiles from files. */
+bool nqiv_color_lut_write_profile(nqiv_log_ctx* logger,
+                                  const void*   profile,
+                                  const size_t  profile_size,
+                                  char**        path)
+{
+	GError*   error = NULL;
+	const int fd = g_file_open_tmp("nqiv-XXXXXX.icc", path, &error);
+	if(fd == -1) {
+		nqiv_log_write(logger, NQIV_LOG_WARNING, "Failed to make file for display profile (%s)\n",
+		               error->message);
+		g_error_free(error);
+		return false;
+	}
+	g_close(fd, NULL);
+	if(!g_file_set_contents(*path, profile, (gssize)profile_size, &error)) {
+		nqiv_log_write(logger, NQIV_LOG_WARNING, "Failed to write display profile to %s (%s)\n",
+		               *path, error->message);
+		g_error_free(error);
+		g_remove(*path);
+		g_free(*path);
+		*path = NULL;
+		return false;
+	}
+	return true;
+}
+
+bool nqiv_color_lut_create(nqiv_log_ctx*    logger,
+                           const void*      profile,
+                           const size_t     profile_size,
+                           nqiv_color_lut** lut)
+{
+	assert(profile != NULL);
+	assert(profile_size > 0);
+	assert(lut != NULL);
+	const int    size = NQIV_COLOR_LUT_SIZE;
+	const size_t table_size = (size_t)size * (size_t)size * (size_t)size * 3;
+	Uint8*       grid = malloc(table_size);
+	if(grid == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_WARNING, "Failed to allocate color table grid.\n");
+		return false;
+	}
+	Uint8* point = grid;
+	int    r;
+	int    g;
+	int    b;
+	for(b = 0; b < size; ++b) {
+		for(g = 0; g < size; ++g) {
+			for(r = 0; r < size; ++r) {
+				point[0] = (Uint8)((r * 255 + (size - 1) / 2) / (size - 1));
+				point[1] = (Uint8)((g * 255 + (size - 1) / 2) / (size - 1));
+				point[2] = (Uint8)((b * 255 + (size - 1) / 2) / (size - 1));
+				point += 3;
+			}
+		}
+	}
+
+	char* path = NULL;
+	if(!nqiv_color_lut_write_profile(logger, profile, profile_size, &path)) {
+		free(grid);
+		return false;
+	}
+	/* The grid is laid out as an image, a row for each green and blue. */
+	VipsImage*  in =
+		vips_image_new_from_memory(grid, table_size, size, size * size, 3, VIPS_FORMAT_UCHAR);
+	VipsImage*  out = NULL;
+	const void* converted = NULL;
+	if(in == NULL
+	   || vips_icc_transform(in, &out, path, "input_profile", "srgb", "embedded", FALSE, "depth",
+	                         8, NULL)
+	          == -1) {
+		nqiv_color_lut_log_vips_exception(logger);
+	} else if(vips_image_get_bands(out) != 3 || vips_image_get_format(out) != VIPS_FORMAT_UCHAR) {
+		nqiv_log_write(logger, NQIV_LOG_WARNING, "Display profile isn't for 8 bit RGB.\n");
+	} else {
+		converted = vips_image_get_data(out);
+		if(converted == NULL) {
+			nqiv_color_lut_log_vips_exception(logger);
+		}
+	}
+	g_remove(path);
+	g_free(path);
+
+	nqiv_color_lut* new_lut = NULL;
+	if(converted != NULL) {
+		new_lut = calloc(1, sizeof(nqiv_color_lut));
+		if(new_lut == NULL) {
+			nqiv_log_write(logger, NQIV_LOG_WARNING, "Failed to allocate color table.\n");
+		} else {
+			/* The grid is done with, so the table is made in it. */
+			memcpy(grid, converted, table_size);
+			new_lut->table = grid;
+			grid = NULL;
+			SDL_AtomicSet(&new_lut->refs, 1);
+		}
+	}
+	if(out != NULL) {
+		g_object_unref(out);
+	}
+	if(in != NULL) {
+		g_object_unref(in);
+	}
+	if(grid != NULL) {
+		free(grid);
+	}
+	if(new_lut == NULL) {
+		return false;
+	}
+	*lut = new_lut;
+	nqiv_log_write(logger, NQIV_LOG_INFO, "Made color table for display profile of %zu bytes.\n",
+	               profile_size);
+	return true;
+}
+
+void nqiv_color_lut_ref(nqiv_color_lut* lut)
+{
+	SDL_AtomicIncRef(&lut->refs);
+}
+
+void nqiv_color_lut_unref(nqiv_color_lut* lut)
+{
+	if(!SDL_AtomicDecRef(&lut->refs)) {
+		return;
+	}
+	free(lut->table);
+	memset(lut, 0, sizeof(nqiv_color_lut));
+	free(lut);
+}
+
+void nqiv_color_lut_apply(const nqiv_color_lut* lut, Uint8* pixels, const size_t count)
+{
+	const int step = NQIV_COLOR_LUT_SIZE - 1;
+	/* Distances in the table to the next point along each axis. */
+	const int r_stride = 3;
+	const int g_stride = NQIV_COLOR_LUT_SIZE * 3;
+	const int b_stride = NQIV_COLOR_LUT_SIZE * NQIV_COLOR_LUT_SIZE * 3;
+	/* For each channel value, the point of the grid below it on an axis, and how far past it the
+	 * value is, out of 255. At the top of an axis, that's all the way past the point before it.
+	 * Worked out once here, rather than dividing for every pixel. */
+	int points[256];
+	int fractions[256];
+	int value;
+	for(value = 0; value < 256; ++value) {
+		const int point = value * step / 255;
+		points[value] = point < step ? point : step - 1;
+		fractions[value] = value * step - points[value] * 255;
+	}
+	size_t idx;
+	for(idx = 0; idx < count; ++idx) {
+		Uint8*    pixel = pixels + idx * 4;
+		const int r_fraction = fractions[pixel[0]];
+		const int g_fraction = fractions[pixel[1]];
+		const int b_fraction = fractions[pixel[2]];
+		/* The cube of the grid around the pixel is cut into six tetrahedra, each running from its
+		 * lowest corner to its highest along the axes in order of how far the pixel is along them.
+		 * Only the four corners of the one holding the pixel are mixed, with a single division,
+		 * instead of all eight. */
+		int first = r_stride;
+		int second = g_stride;
+		int third = b_stride;
+		int high = r_fraction;
+		int middle = g_fraction;
+		int low = b_fraction;
+		if(middle > high) {
+			first = g_stride;
+			second = r_stride;
+			high = g_fraction;
+			middle = r_fraction;
+		}
+		if(low > middle) {
+			third = second;
+			second = b_stride;
+			low = middle;
+			middle = b_fraction;
+			if(middle > high) {
+				second = first;
+				first = b_stride;
+				middle = high;
+				high = b_fraction;
+			}
+		}
+		const Uint8* corner = lut->table + points[pixel[0]] * r_stride
+		                      + points[pixel[1]] * g_stride + points[pixel[2]] * b_stride;
+		const Uint8* next = corner + first;
+		const Uint8* next_next = next + second;
+		const Uint8* last = next_next + third;
+		int          channel;
+		for(channel = 0; channel < 3; ++channel) {
+			pixel[channel] =
+				(Uint8)((corner[channel] * (255 - high) + next[channel] * (high - middle)
+			             + next_next[channel] * (middle - low) + last[channel] * low + 127)
+			            / 255);
+		}
+	}
+}
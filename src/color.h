@@ -0,0 +1,44 @@
+#ifndef NQIV_COLOR_H
+#define NQIV_COLOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+#include "logging.h"
+
+/*
+ * Images are decoded to sRGB, converting from any ICC profile embedded in them. RGB images without
+ * one are taken to be sRGB already. To show them as they're meant to look on a display with a
+ * different ICC profile, they must be converted to it. Converting every pixel of every image
+ * through the profile with VIPS would be slow, so it's done once, for a grid of colors covering all
+ * of sRGB, and kept as a lookup table. Pixels are then converted by interpolating between four of
+ * the eight points of the grid around them, which takes one division per channel rather than
+ * seven.
+ *
+ * The table is made by the master whenever the display profile changes, and used by the workers as
+ * they load images. It's never changed once made, and is freed once its last reference is dropped.
+ */
+
+/* Points along each side of the grid. */
+#define NQIV_COLOR_LUT_SIZE 33
+
+typedef struct nqiv_color_lut
+{
+	SDL_atomic_t refs;
+	/* RGB for each point of the grid, with red changing fastest, then green, then blue. */
+	Uint8*       table;
+} nqiv_color_lut;
+
+/* Make a table converting sRGB to the ICC profile in memory, with one reference. */
+bool nqiv_color_lut_create(nqiv_log_ctx*    logger,
+                           const void*      profile,
+                           const size_t     profile_size,
+                           nqiv_color_lut** lut);
+void nqiv_color_lut_ref(nqiv_color_lut* lut);
+void nqiv_color_lut_unref(nqiv_color_lut* lut);
+/* Convert count RGBA pixels in place. Alpha is left as it is. */
+void nqiv_color_lut_apply(const nqiv_color_lut* lut, Uint8* pixels, const size_t count);
+
+#endif /* NQIV_COLOR_H */
@@ -4,14 +4,52 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#include "image.h"
+#include <SDL2/SDL.h>
+
+#include "typedefs.h"
+
+/*
+ * Events are jobs for the workers. Loading an image happens in stages, each a
+ * job of its own:
+ * - NQIV_EVENT_IMAGE_LOAD calculates thumbnail paths, reads headers, creates
+ *   thumbnails and picks frames, all under the image lock. Then it sends a
+ *   decode job for each form that needs pixels, at the same priority.
+ * - NQIV_EVENT_FORM_DECODE decodes a form into a surface without the lock, and
+ *   publishes it. (See nqiv_image_form_decode)
+ *
+ * A decode job may be taken by any worker, so the image and thumbnail of one
+ * image, or the decodes of a large image and the loads of many small ones, go
+ * on side by side. Higher priority loads are taken ahead of queued decodes. A
+ * decode which is out of date by the time it's taken is dropped, but what the
+ * load before it did is kept, so the next load only has to decode.
+ *
+ * NQIV_EVENT_IMAGE_REFINE is sent once the view of an image has settled, to resample what's in view
+ * to the size it's drawn at. (See nqiv_image_refinement)
+ */
 
 typedef enum nqiv_event_type
 {
 	NQIV_EVENT_WORKER_STOP,
 	NQIV_EVENT_IMAGE_LOAD,
+	NQIV_EVENT_FORM_DECODE,
+	NQIV_EVENT_IMAGE_REFINE,
 } nqiv_event_type;
 
+/* When an event reaches a worker, it may no longer be worth doing. See nqiv_image_event_is_current.
+ */
+typedef enum nqiv_event_lifetime
+{
+	/* Never out of date. */
+	NQIV_EVENT_LIFETIME_FOREVER,
+	/* Out of date if the image manager's interest generation has changed since it was sent. */
+	NQIV_EVENT_LIFETIME_GENERATION,
+	/* Out of date if its image is no longer of interest to the montage. */
+	NQIV_EVENT_LIFETIME_INTEREST,
+	/* Out of date if its image is no longer of interest, or the montage selection has moved since it
+	 * was sent. Its priority depends on where the selection is, so it must be sent again. */
+	NQIV_EVENT_LIFETIME_SELECTION,
+} nqiv_event_lifetime;
+
 typedef struct nqiv_event_image_load_form_options
 {
 	bool clear_error;
@@ -36,24 +74,54 @@ typedef struct nqiv_event_image_load_options
 	 * are other operations that benefit from knowing this, such as showing the dimensions of the
 	 * actual image, when only a thumbnail is loaded. */
 	bool                               borrow_thumbnail_dimension_metadata;
+	/* The options are held by the image, and merged with any other load sent for it before a
+	 * worker takes them. See nqiv_image_add_pending_load. */
+	bool                               pending;
+	/* Set by nqiv_image_add_pending_load. Level the image's load was pending at before this event
+	 * raised it, or -1 if this event created it. */
+	int                                pending_previous_level;
+	/* Which of the image's pending loads this event was queued for. */
+	int                                pending_generation;
 	nqiv_event_image_load_form_options image_options;
 	nqiv_event_image_load_form_options thumbnail_options;
 } nqiv_event_image_load_options;
 
+typedef struct nqiv_event_form_decode_options
+{
+	nqiv_image*             image;
+	/* Started by the load which sent the job, and owned by the job. */
+	nqiv_image_form_decode* decode;
+} nqiv_event_form_decode_options;
+
+typedef struct nqiv_event_image_refine_options
+{
+	nqiv_image* image;
+	/* The refinement asked for. It's only done if the image still wants the same one. */
+	SDL_Rect    srcrect;
+	int         width;
+	int         height;
+} nqiv_event_image_refine_options;
+
 typedef union nqiv_event_options
 {
-	nqiv_event_image_load_options image_load;
+	nqiv_event_image_load_options   image_load;
+	nqiv_event_form_decode_options  form_decode;
+	nqiv_event_image_refine_options image_refine;
 } nqiv_event_options;
 
 typedef struct nqiv_event
 {
-	nqiv_event_type    type;
-	/* The transaction group is compared against a current number tracked by the threads. If the
-	 * event is less than the current number, it is considered out of date and discarded. An event
-	 * with a transaction group of -1 is never out of date. This feature primarily exists to solve
-	 * the problem of events still being queued for images that are no longer visible. */
-	int64_t            transaction_group;
-	nqiv_event_options options;
+	nqiv_event_type     type;
+	/* Out of date events are discarded by workers, or purged from the queue in bulk. This primarily
+	 * exists to solve the problem of events still being queued for images that are no longer
+	 * visible. Only events for an image may be anything but NQIV_EVENT_LIFETIME_FOREVER. */
+	nqiv_event_lifetime lifetime;
+	/* Interest generation at the time of sending, for NQIV_EVENT_LIFETIME_GENERATION, or selection
+	 * generation, for NQIV_EVENT_LIFETIME_SELECTION. */
+	int                 generation;
+	/* Priority level it was sent at, so it can be passed on from one worker pool to another. */
+	int                 level;
+	nqiv_event_options  options;
 } nqiv_event;
 
 #endif /* NQIV_EVENT_H */
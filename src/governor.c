@@ -0,0 +1,130 @@
+#include "platform.h"
+
+#include <stdbool.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+#include <vips/vips.h>
+
+#include "logging.h"
+#include "worker.h"
+#include "governor.h"
+
+void nqiv_governor_init(nqiv_governor*    governor,
+                        nqiv_log_ctx*     logger,
+                        nqiv_worker_pool* pool,
+                        const Uint64      interval,
+                        const int         min_workers,
+                        const int         initial_workers,
+                        const int         max_vips_threads)
+{
+	assert(governor != NULL);
+	assert(logger != NULL);
+	assert(pool != NULL);
+	assert(pool->count > 0);
+	assert(max_vips_threads >= 0);
+	memset(governor, 0, sizeof(nqiv_governor));
+	governor->logger = logger;
+	governor->pool = pool;
+	governor->interval = interval;
+	governor->min_workers = min_workers < 1 ? 1 : min_workers;
+	governor->min_workers =
+		governor->min_workers > pool->count ? pool->count : governor->min_workers;
+	governor->max_workers = pool->count;
+	governor->max_vips_threads = max_vips_threads;
+	governor->vips_threads = max_vips_threads;
+	governor->available_cpus = nqiv_get_available_cpus();
+	governor->last_time = SDL_GetTicks64();
+	governor->last_processed = SDL_AtomicGet(&pool->processed);
+	governor->has_cpu_time = nqiv_get_process_cpu_time(&governor->last_cpu_time);
+	if(interval > 0) {
+		int active = initial_workers < governor->min_workers ? governor->min_workers
+		                                                     : initial_workers;
+		active = active > pool->count ? pool->count : active;
+		nqiv_worker_pool_set_active(pool, active);
+	}
+	nqiv_log_write(logger, NQIV_LOG_DEBUG,
+	               "Governing %d to %d workers every %" PRIu64 " ms with %d available CPUs.\n",
+	               governor->min_workers, pool->count, interval, governor->available_cpus);
+}
+
+void nqiv_governor_update(nqiv_governor* governor)
+{
+	if(governor->interval == 0) {
+		return;
+	}
+	const Uint64 now = SDL_GetTicks64();
+	const Uint64 elapsed = now - governor->last_time;
+	if(elapsed < governor->interval) {
+		return;
+	}
+	nqiv_worker_pool* pool = governor->pool;
+	const double      seconds = (double)elapsed / 1000.0;
+	const int         processed = SDL_AtomicGet(&pool->processed);
+	const int         handled = (int)((unsigned int)processed - (unsigned int)governor->last_processed);
+	const double      throughput = (double)handled / seconds;
+	double            cpu_time = 0.0;
+	const bool        has_cpu_time = nqiv_get_process_cpu_time(&cpu_time);
+	/* Without a measurement, assume there's time to spare, like a static pool would. */
+	double            utilization = 0.0;
+	if(has_cpu_time && governor->has_cpu_time) {
+		utilization = (cpu_time - governor->last_cpu_time)
+		              / (seconds * (double)governor->available_cpus);
+	}
+	const bool saturated = utilization >= NQIV_GOVERNOR_SATURATED;
+	const int  backlog = nqiv_worker_pool_get_backlog(pool);
+	const int  active = nqiv_worker_pool_get_active(pool);
+	int        new_active = active;
+	if(active > governor->max_workers) {
+		new_active = governor->max_workers;
+	} else if(saturated && governor->last_activated && throughput <= governor->last_throughput
+	          && active > governor->min_workers) {
+		new_active = active - 1;
+	} else if(!saturated && backlog > active && active < governor->max_workers) {
+		new_active = active + 1;
+	}
+	if(new_active != active) {
+		nqiv_worker_pool_set_active(pool, new_active);
+		nqiv_log_write(governor->logger, NQIV_LOG_DEBUG,
+		               "Governor changed active workers from %d to %d with a backlog of %d, %f "
+		               "events per second, and %f CPU utilization.\n",
+		               active, new_active, backlog, throughput, utilization);
+	}
+	if(governor->max_vips_threads > 0) {
+		int vips_threads = governor->available_cpus / new_active;
+		vips_threads = vips_threads < 1 ? 1 : vips_threads;
+		vips_threads =
+			vips_threads > governor->max_vips_threads ? governor->max_vips_threads : vips_threads;
+		if(vips_threads != governor->vips_threads) {
+			vips_concurrency_set(vips_threads);
+			nqiv_log_write(governor->logger, NQIV_LOG_DEBUG,
+			               "Governor changed VIPS threads from %d to %d.\n",
+			               governor->vips_threads, vips_threads);
+			governor->vips_threads = vips_threads;
+		}
+	}
+	governor->last_time = now;
+	governor->last_processed = processed;
+	governor->last_cpu_time = cpu_time;
+	governor->has_cpu_time = has_cpu_time;
+	governor->last_throughput = throughput;
+	governor->last_activated = new_active > active;
+}
+
+void nqiv_governor_set_max_workers(nqiv_governor* governor, const int max_workers)
+{
+	int capped = max_workers < 1 ? 1 : max_workers;
+	capped = capped > governor->pool->count ? governor->pool->count : capped;
+	if(capped == governor->max_workers) {
+		return;
+	}
+	nqiv_log_write(governor->logger, NQIV_LOG_DEBUG, "Governor capped active workers at %d.\n",
+	               capped);
+	governor->max_workers = capped;
+	const int active = nqiv_worker_pool_get_active(governor->pool);
+	/* Without an interval, nothing else changes the active workers, so lifting the cap activates
+	 * all of them again. */
+	if(governor->interval == 0 || active > capped) {
+		nqiv_worker_pool_set_active(governor->pool, capped);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef NQIV_GOVERNOR_H
+#define NQIV_GOVERNOR_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "logging.h"
+#include "worker.h"
+
+/*
+ * The governor adjusts how many workers of a pool are active, and how many
+ * threads libvips uses, while nqiv runs. The master updates it periodically.
+ * Each update measures the backlog of queued events, how many were handled
+ * since the last update, and how much of the available processor time the
+ * process used.
+ *
+ * If events are backing up and there's processor time to spare, another worker
+ * is activated. If the processors are saturated and activating the last worker
+ * didn't raise throughput, it is parked again. Idle workers are left active,
+ * since they only sleep. The active count stays within min_workers and the size
+ * of the pool. libvips gets the available processors divided between the
+ * active workers, within 1 and max_vips_threads.
+ *
+ * Without an interval, every worker is active and nothing is adjusted.
+ *
+ * While nqiv is in the background, the master caps the active workers with
+ * max_workers, so what's queued is finished slowly. The cap applies with or
+ * without an interval, and even below min_workers.
+ */
+
+/* Fraction of available processor time above which the processors are considered saturated. */
+#define NQIV_GOVERNOR_SATURATED 0.9
+
+typedef struct nqiv_governor
+{
+	nqiv_log_ctx*     logger;
+	nqiv_worker_pool* pool;
+	/* Milliseconds between updates. 0 to leave everything as configured. */
+	Uint64            interval;
+	int               min_workers;
+	int               max_workers;
+	/* 0 to leave the number of libvips threads alone. */
+	int               max_vips_threads;
+	int               vips_threads;
+	int               available_cpus;
+	/* Measurements at the last update. */
+	Uint64            last_time;
+	int               last_processed;
+	double            last_cpu_time;
+	bool              has_cpu_time;
+	/* Events handled per second in the last interval. */
+	double            last_throughput;
+	/* Was a worker activated at the last update? */
+	bool              last_activated;
+} nqiv_governor;
+
+void nqiv_governor_init(nqiv_governor*    governor,
+                        nqiv_log_ctx*     logger,
+                        nqiv_worker_pool* pool,
+                        const Uint64      interval,
+                        const int         min_workers,
+                        const int         initial_workers,
+                        const int         max_vips_threads);
+/* Adjust the pool and libvips if the interval has passed since the last update. */
+void nqiv_governor_update(nqiv_governor* governor);
+/* Cap the active workers, parking any past it right away. Capping at the size of the pool lifts
+ * it. */
+void nqiv_governor_set_max_workers(nqiv_governor* governor, const int max_workers);
+
+#endif /* NQIV_GOVERNOR_H */
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -13,6 +14,8 @@
 #include "event.h"
 #include "array.h"
 #include "queue.h"
+#include "atlas.h"
+#include "color.h"
 #include "image.h"
 #include "thumbnail.h"
 #include "state.h"
@@ -41,11 +44,23 @@ void nqiv_unload_texture_ptr(SDL_Texture** texture, const bool destroy)
 void nqiv_unload_image_form_texture(nqiv_image_form* form)
 {
 	nqiv_unload_texture_ptr(&form->texture, form->fallback_texture != form->texture);
+	/* The refinement is drawn in place of the texture, so it goes too, to be asked for again. */
+	if(form->refinement.texture != NULL) {
+		nqiv_unload_texture_ptr(&form->refinement.texture, true);
+		SDL_AtomicSet(&form->refinement.sent, 0);
+	}
+	nqiv_unload_texture_ptr(&form->refinement.previous_texture, true);
 }
 
 void nqiv_unload_image_form_fallback_texture(nqiv_image_form* form)
 {
 	assert(form->texture == NULL || form->texture != form->fallback_texture);
+	/* An atlas is shared, so only its slot is given back. */
+	if(form->atlas_slot.atlas != NULL
+	   && form->fallback_texture == form->atlas_slot.atlas->texture) {
+		nqiv_atlas_slot_release(&form->atlas_slot);
+		form->fallback_texture = NULL;
+	}
 	nqiv_unload_texture_ptr(&form->fallback_texture, true);
 }
 
@@ -63,6 +78,18 @@ void nqiv_unload_image_form_all_textures(nqiv_image_form* form)
 	assert(form->fallback_texture == NULL);
 }
 
+void nqiv_unload_image_form_refinement_surface(nqiv_image_form* form)
+{
+	assert(form != NULL);
+	if(form->refinement.surface != NULL) {
+		SDL_FreeSurface(form->refinement.surface);
+		form->refinement.surface = NULL;
+		assert(form->refinement.data != NULL);
+		free(form->refinement.data);
+		form->refinement.data = NULL;
+	}
+}
+
 void nqiv_unload_image_form_surface(nqiv_image_form* form)
 {
 	assert(form != NULL);
@@ -73,6 +100,17 @@ void nqiv_unload_image_form_surface(nqiv_image_form* form)
 		free(form->data);
 		form->data = NULL;
 	}
+	/* A refinement not yet made into a texture is kept. It's only of the area in view, and asking
+	 * for it again would mean resampling it again. */
+}
+
+void nqiv_unload_image_form_refinement(nqiv_image_form* form)
+{
+	assert(form != NULL);
+	nqiv_unload_texture_ptr(&form->refinement.texture, true);
+	nqiv_unload_texture_ptr(&form->refinement.previous_texture, true);
+	nqiv_unload_image_form_refinement_surface(form);
+	memset(&form->refinement, 0, sizeof(nqiv_image_refinement));
 }
 
 void nqiv_unload_image_form(nqiv_image_form* form)
@@ -81,6 +119,7 @@ void nqiv_unload_image_form(nqiv_image_form* form)
 	nqiv_unload_image_form_vips(form);
 	nqiv_unload_image_form_all_textures(form);
 	nqiv_unload_image_form_surface(form);
+	nqiv_unload_image_form_refinement(form);
 }
 
 void nqiv_image_destroy(nqiv_image* image)
@@ -90,6 +129,7 @@ void nqiv_image_destroy(nqiv_image* image)
 	nqiv_log_write(image->parent->logger, NQIV_LOG_INFO, "Destroying image %s\n",
 	               image->image.path);
 	omp_destroy_lock(&image->lock);
+	omp_destroy_lock(&image->pending_load.lock);
 	nqiv_unload_image_form(&image->image);
 	nqiv_unload_image_form(&image->thumbnail);
 	if(image->image.path != NULL) {
@@ -131,19 +171,26 @@ nqiv_image* nqiv_image_create(nqiv_log_ctx* logger, const char* raw_path)
 		return NULL;
 	}
 	omp_init_lock(&image->lock);
+	omp_init_lock(&image->pending_load.lock);
 	memcpy(image->image.path, path, path_len);
 	assert(strcmp(image->image.path, path) == 0);
 	nqiv_log_write(logger, NQIV_LOG_DEBUG, "Created image %s\n", image->image.path);
 	return image;
 }
 
+const char* nqiv_image_form_name(const nqiv_image* image, const nqiv_image_form* form)
+{
+	/* Private copies of the image form share its path. */
+	return form == &image->image || form->path == image->image.path ? "image" : "thumbnail";
+}
+
 void nqiv_log_vips_exception(nqiv_log_ctx*          logger,
                              const nqiv_image*      image,
                              const nqiv_image_form* form)
 {
 	char* error = vips_error_buffer_copy();
 	nqiv_log_write(logger, NQIV_LOG_WARNING, "Vips exception for form %s of path %s (%s)\n",
-	               form == &image->image ? "image" : "thumbnail", image->image.path, error);
+	               nqiv_image_form_name(image, form), image->image.path, error);
 	g_free(error);
 }
 
@@ -168,6 +215,97 @@ bool nqiv_image_test_lock(nqiv_image* image)
 	return true;
 }
 
+void nqiv_image_merge_load_form_options(nqiv_event_image_load_form_options*       into,
+                                        const nqiv_event_image_load_form_options* from)
+{
+	into->clear_error = into->clear_error || from->clear_error;
+	into->vips = into->vips || from->vips;
+	into->vips_soft = into->vips_soft || from->vips_soft;
+	into->surface = into->surface || from->surface;
+	into->surface_soft = into->surface_soft || from->surface_soft;
+	into->first_frame = into->first_frame || from->first_frame;
+	/* Going back to the first frame supersedes advancing. */
+	into->next_frame = (into->next_frame || from->next_frame) && !into->first_frame;
+}
+
+bool nqiv_image_add_pending_load(nqiv_image* image, nqiv_event* event, const int level)
+{
+	assert(event->type == NQIV_EVENT_IMAGE_LOAD);
+	assert(event->options.image_load.image == image);
+	assert(!event->options.image_load.image_options.unload);
+	assert(!event->options.image_load.thumbnail_options.unload);
+	nqiv_image_pending_load* pending = &image->pending_load;
+	bool                     send = true;
+	omp_set_lock(&pending->lock);
+	if(!pending->exists) {
+		memcpy(&pending->options, &event->options.image_load,
+		       sizeof(nqiv_event_image_load_options));
+		pending->level = level;
+		pending->queued = 1;
+		pending->generation += 1;
+		pending->exists = true;
+		event->options.image_load.pending_previous_level = -1;
+	} else {
+		const nqiv_event_image_load_options* from = &event->options.image_load;
+		pending->options.set_thumbnail_path =
+			pending->options.set_thumbnail_path || from->set_thumbnail_path;
+		pending->options.create_thumbnail =
+			pending->options.create_thumbnail || from->create_thumbnail;
+		pending->options.borrow_thumbnail_dimension_metadata =
+			pending->options.borrow_thumbnail_dimension_metadata
+			|| from->borrow_thumbnail_dimension_metadata;
+		nqiv_image_merge_load_form_options(&pending->options.image_options,
+		                                   &from->image_options);
+		nqiv_image_merge_load_form_options(&pending->options.thumbnail_options,
+		                                   &from->thumbnail_options);
+		send = level < pending->level;
+		if(send) {
+			event->options.image_load.pending_previous_level = pending->level;
+			pending->level = level;
+			pending->queued += 1;
+		}
+	}
+	event->options.image_load.pending_generation = pending->generation;
+	omp_unset_lock(&pending->lock);
+	return send;
+}
+
+void nqiv_image_unsend_pending_load(nqiv_image* image, const nqiv_event* event)
+{
+	const nqiv_event_image_load_options* options = &event->options.image_load;
+	nqiv_image_pending_load*             pending = &image->pending_load;
+	assert(event->type == NQIV_EVENT_IMAGE_LOAD);
+	assert(options->image == image);
+	omp_set_lock(&pending->lock);
+	/* A worker may already have taken it through another event, and another been created. */
+	if(pending->exists && pending->generation == options->pending_generation) {
+		assert(pending->queued > 0);
+		pending->queued -= 1;
+		if(pending->queued == 0) {
+			pending->exists = false;
+		} else if(options->pending_previous_level != -1 && pending->level == event->level) {
+			pending->level = options->pending_previous_level;
+		}
+	}
+	omp_unset_lock(&pending->lock);
+}
+
+bool nqiv_image_take_pending_load(nqiv_image* image, nqiv_event* event)
+{
+	nqiv_image_pending_load* pending = &image->pending_load;
+	bool                     taken = false;
+	omp_set_lock(&pending->lock);
+	if(pending->exists) {
+		memcpy(&event->options.image_load, &pending->options,
+		       sizeof(nqiv_event_image_load_options));
+		pending->exists = false;
+		pending->queued = 0;
+		taken = true;
+	}
+	omp_unset_lock(&pending->lock);
+	return taken;
+}
+
 /* TODO step frame */
 /* TODO input cleanup */
 /* TODO Add twice */
@@ -246,6 +384,54 @@ bool nqiv_image_form_set_frame_delay(nqiv_image* image, nqiv_image_form* form)
 	return true;
 }
 
+void nqiv_image_vips_watch_eval(VipsImage* vips, VipsProgress* progress, void* data)
+{
+	(void)progress;
+	nqiv_image_vips_watch* watch = data;
+	if(watch->timed_out || watch->cancelled) {
+		return;
+	}
+	const Uint64 max_decode_time = watch->image->parent->max_decode_time;
+	if(max_decode_time > 0 && SDL_GetTicks64() - watch->start > max_decode_time) {
+		watch->timed_out = true;
+	} else if(!nqiv_image_is_of_interest(watch->image)) {
+		watch->cancelled = true;
+	} else {
+		return;
+	}
+	vips_image_set_kill(vips, TRUE);
+}
+
+void nqiv_image_vips_watch_start(nqiv_image_vips_watch* watch, nqiv_image* image, VipsImage* vips)
+{
+	memset(watch, 0, sizeof(nqiv_image_vips_watch));
+	watch->image = image;
+	watch->vips = vips;
+	watch->start = SDL_GetTicks64();
+	g_object_ref(vips);
+	vips_image_set_progress(vips, TRUE);
+	watch->handler = g_signal_connect(vips, "eval", G_CALLBACK(nqiv_image_vips_watch_eval), watch);
+}
+
+bool nqiv_image_vips_watch_finish(nqiv_image_vips_watch* watch, nqiv_image_form* form)
+{
+	g_signal_handler_disconnect(watch->vips, watch->handler);
+	g_object_unref(watch->vips);
+	watch->vips = NULL;
+	if(watch->timed_out) {
+		nqiv_log_write(watch->image->parent->logger, NQIV_LOG_WARNING,
+		               "Stopped decoding form %s of %s after %" PRIu64 " milliseconds.\n",
+		               nqiv_image_form_name(watch->image, form), watch->image->image.path,
+		               watch->image->parent->max_decode_time);
+		form->error = true;
+	} else if(watch->cancelled) {
+		nqiv_log_write(watch->image->parent->logger, NQIV_LOG_DEBUG,
+		               "Stopped decoding form %s of %s, which is no longer of interest.\n",
+		               nqiv_image_form_name(watch->image, form), watch->image->image.path);
+	}
+	return watch->timed_out || watch->cancelled;
+}
+
 bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form)
 {
 	assert(image != NULL);
@@ -253,7 +439,7 @@ bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form)
 	assert(form->vips == NULL);
 	if(form->path == NULL) {
 		nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING, "No path for %s form in image %s\n",
-		               form == &image->image ? "image" : "thumbnail", image->image.path);
+		               nqiv_image_form_name(image, form), image->image.path);
 		form->error = true;
 		return false;
 	}
@@ -266,6 +452,13 @@ bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form)
 
 	form->width = vips_image_get_width(form->vips);
 	form->height = vips_image_get_height(form->vips);
+	/* Thumbnails are made upright already. */
+	int exif_orientation = 1;
+	if(form == &image->image && vips_image_get_typeof(form->vips, VIPS_META_ORIENTATION) != 0
+	   && vips_image_get_int(form->vips, VIPS_META_ORIENTATION, &exif_orientation) != 0) {
+		exif_orientation = 1;
+	}
+	form->orientation = nqiv_image_orientation_from_exif(exif_orientation);
 	form->srcrect.x = 0;
 	form->srcrect.y = 0;
 	form->srcrect.w = form->width;
@@ -274,6 +467,20 @@ bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form)
 	form->animation.frame = 0;
 	form->animation.exists = false;
 
+	/* Only the header has been read so far, so this is cheap to check before decoding anything. */
+	const Uint64 pixels = (Uint64)form->width * (Uint64)form->height
+	                      * (Uint64)(form->animation.frame_count > 0 ? form->animation.frame_count : 1);
+	if(image->parent->max_pixels > 0 && pixels > image->parent->max_pixels) {
+		nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
+		               "Not loading form %s of %s with %" PRIu64 " pixels, over the limit of %" PRIu64
+		               ".\n",
+		               nqiv_image_form_name(image, form), image->image.path, pixels,
+		               image->parent->max_pixels);
+		nqiv_unload_image_form_vips(form);
+		form->error = true;
+		return false;
+	}
+
 	if(form->animation.frame_count > 1) {
 		form->animation.exists = true;
 		if(!nqiv_image_form_set_frame_delay(image, form)) {
@@ -291,7 +498,7 @@ bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form)
 	}
 
 	nqiv_log_write(image->parent->logger, NQIV_LOG_DEBUG, "Form %s vips for loaded for image %s\n",
-	               form == &image->image ? "image" : "thumbnail", image->image.path);
+	               nqiv_image_form_name(image, form), image->image.path);
 	return true;
 }
 
@@ -314,7 +521,7 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		   == -1) {
 			nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
 			               "Failed to crop out oversized vips region to resize of form %s of %s\n",
-			               form == &image->image ? "image" : "thumbnail", image->image.path);
+			               nqiv_image_form_name(image, form), image->image.path);
 			form->error = true;
 			return false;
 		}
@@ -323,7 +530,7 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		               "Cropped selection from %dx%d+%dx%d to %dx%d for form %s of %s\n",
 		               form->srcrect.w, form->srcrect.h, form->srcrect.x, form->srcrect.y,
 		               vips_image_get_width(used_vips), vips_image_get_height(used_vips),
-		               form == &image->image ? "image" : "thumbnail", image->image.path);
+		               nqiv_image_form_name(image, form), image->image.path);
 	}
 
 	if(form->srcrect.w > image->parent->max_texture_width
@@ -341,7 +548,7 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 			}
 			nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
 			               "Failed to resize oversized vips region for form %s of %s",
-			               form == &image->image ? "image" : "thumbnail", image->image.path);
+			               nqiv_image_form_name(image, form), image->image.path);
 			form->error = true;
 			return false;
 		}
@@ -353,7 +560,7 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		               "Resized oversized selection %dx%d+%dx%d to %dx%d for form %s of %s\n",
 		               form->srcrect.w, form->srcrect.h, form->srcrect.x, form->srcrect.y,
 		               vips_image_get_width(used_vips), vips_image_get_height(used_vips),
-		               form == &image->image ? "image" : "thumbnail", image->image.path);
+		               nqiv_image_form_name(image, form), image->image.path);
 	}
 
 	const VipsBandFormat band_format = vips_image_get_format(used_vips);
@@ -380,6 +587,21 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		used_vips = new_vips;
 	}
 
+	/* Pixels are taken to be sRGB from here on, including by the color table, so they're converted
+	 * from any profile embedded in the image. If that fails, they're shown as they are. */
+	if(vips_image_get_typeof(used_vips, VIPS_META_ICC_NAME) != 0) {
+		if(vips_icc_transform(used_vips, &new_vips, "srgb", "embedded", TRUE, "depth", 8, NULL)
+		   == -1) {
+			nqiv_log_vips_exception(image->parent->logger, image, form);
+			vips_error_clear();
+		} else {
+			if(used_vips != form->vips) {
+				g_object_unref(used_vips);
+			}
+			used_vips = new_vips;
+		}
+	}
+
 	const VipsInterpretation interpretation = vips_image_get_interpretation(used_vips);
 	if(interpretation == VIPS_INTERPRETATION_ERROR) {
 		if(used_vips != form->vips) {
@@ -419,14 +641,31 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		used_vips = new_vips;
 	}
 
+	/* This is where vips actually computes the pixels. Make sure it's working on a private image, so
+	 * it can be killed without affecting the form. */
+	if(used_vips == form->vips) {
+		if(vips_copy(used_vips, &new_vips, NULL) == -1) {
+			nqiv_log_vips_exception(image->parent->logger, image, form);
+			form->error = true;
+			return false;
+		}
+		used_vips = new_vips;
+	}
+	nqiv_image_vips_watch watch;
+	nqiv_image_vips_watch_start(&watch, image, used_vips);
 	const void* extracted = vips_image_get_data(used_vips);
+	if(nqiv_image_vips_watch_finish(&watch, form)) {
+		g_object_unref(used_vips);
+		vips_error_clear();
+		return false;
+	}
 	if(extracted == NULL) {
 		if(used_vips != form->vips) {
 			g_object_unref(used_vips);
 		}
 		nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
 		               "Failed to extract raw image data for form %s of %s\n",
-		               form == &image->image ? "image" : "thumbnail", image->image.path);
+		               nqiv_image_form_name(image, form), image->image.path);
 		form->error = true;
 		return false;
 	}
@@ -440,7 +679,7 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 		}
 		nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
 		               "Failed to allocate memory for raw image data for form %s of %s\n",
-		               form == &image->image ? "image" : "thumbnail", image->image.path);
+		               nqiv_image_form_name(image, form), image->image.path);
 		form->error = true;
 		return false;
 	}
@@ -448,15 +687,21 @@ bool nqiv_image_load_raw(nqiv_image* image, nqiv_image_form* form)
 	memcpy(form->data, extracted, data_size);
 	form->effective_width = vips_image_get_width(used_vips);
 	form->effective_height = vips_image_get_height(used_vips);
+	nqiv_color_lut* lut = nqiv_image_manager_get_color_lut(image->parent);
+	if(lut != NULL) {
+		assert(VIPS_IMAGE_SIZEOF_PEL(used_vips) == 4);
+		nqiv_color_lut_apply(lut, form->data, VIPS_IMAGE_N_PELS(used_vips));
+		nqiv_color_lut_unref(lut);
+	}
 	if(used_vips != form->vips) {
 		g_object_unref(used_vips);
 	}
 	nqiv_log_write(image->parent->logger, NQIV_LOG_DEBUG,
 	               "Loaded raw of size %zu for image form %s frame %d with pixel offset %d at "
 	               "delay of %d at path %s\n",
-	               data_size, form == &image->image ? "image" : "thumbnail", form->animation.frame,
+	               data_size, nqiv_image_form_name(image, form), form->animation.frame,
 	               frame_offset, form->animation.delay,
-	               form == &image->image ? "image" : "thumbnail", image->image.path);
+	               nqiv_image_form_name(image, form), image->image.path);
 	return true;
 }
 
@@ -478,16 +723,174 @@ bool nqiv_image_load_surface(nqiv_image* image, nqiv_image_form* form)
 	if(form->surface == NULL) {
 		nqiv_log_write(image->parent->logger, NQIV_LOG_WARNING,
 		               "Failed to create SDL surface for form %s of %s (%s).",
-		               form == &image->image ? "image" : "thumbnail", image->image.path,
+		               nqiv_image_form_name(image, form), image->image.path,
 		               SDL_GetError());
 		form->error = true;
 		return false;
 	}
 	nqiv_log_write(image->parent->logger, NQIV_LOG_DEBUG, "Loaded surface of form %s of image %s\n",
-	               form == &image->image ? "image" : "thumbnail", image->image.path);
+	               nqiv_image_form_name(image, form), image->image.path);
 	return true;
 }
 
+void nqiv_image_form_decode_start(nqiv_image_form_decode* decode, nqiv_image_form* form)
+{
+	assert(decode != NULL);
+	assert(form != NULL);
+	assert(form->vips != NULL);
+	assert(!form->decoding);
+	decode->target = form;
+	memcpy(&decode->staging, form, sizeof(nqiv_image_form));
+	/* The copy owns nothing but its own reference to the vips image. */
+	g_object_ref(decode->staging.vips);
+	decode->staging.data = NULL;
+	decode->staging.surface = NULL;
+	decode->staging.texture = NULL;
+	decode->staging.fallback_texture = NULL;
+	memset(&decode->staging.atlas_slot, 0, sizeof(nqiv_atlas_slot));
+	memset(&decode->staging.refinement, 0, sizeof(nqiv_image_refinement));
+	form->decoding = true;
+}
+
+bool nqiv_image_form_decode_run(nqiv_image* image, nqiv_image_form_decode* decode)
+{
+	return nqiv_image_load_surface(image, &decode->staging);
+}
+
+bool nqiv_image_form_decode_finish(nqiv_image* image, nqiv_image_form_decode* decode)
+{
+	nqiv_image_form* form = decode->target;
+	nqiv_image_form* staging = &decode->staging;
+	assert(form->decoding);
+	form->decoding = false;
+	/* The form may have been unloaded, moved to another frame, or resampled in the meantime. Then,
+	 * the result is out of date. */
+	const bool current = form->vips == staging->vips
+	                     && form->animation.frame == staging->animation.frame
+	                     && form->srcrect.x == staging->srcrect.x
+	                     && form->srcrect.y == staging->srcrect.y
+	                     && form->srcrect.w == staging->srcrect.w
+	                     && form->srcrect.h == staging->srcrect.h;
+	const bool published = current && form->surface == NULL && staging->surface != NULL;
+	if(published) {
+		form->data = staging->data;
+		form->surface = staging->surface;
+		form->effective_width = staging->effective_width;
+		form->effective_height = staging->effective_height;
+		staging->data = NULL;
+		staging->surface = NULL;
+	} else if(current && staging->error) {
+		form->error = true;
+	}
+	nqiv_unload_image_form_surface(staging);
+	/* Raw data may have been extracted without making a surface of it. */
+	if(staging->data != NULL) {
+		free(staging->data);
+		staging->data = NULL;
+	}
+	nqiv_unload_image_form_vips(staging);
+	nqiv_log_write(image->parent->logger, NQIV_LOG_DEBUG, "%s decoded form %s of image %s\n",
+	               published ? "Published" : "Discarded", nqiv_image_form_name(image, form),
+	               image->image.path);
+	return published;
+}
+
+/* Is this the refinement the form wants, and not yet made? */
+bool nqiv_image_form_wants_refinement(const nqiv_image_form*                 form,
+                                      const nqiv_event_image_refine_options* options)
+{
+	const nqiv_image_refinement* refinement = &form->refinement;
+	return !form->animation.exists && refinement->surface == NULL
+	       && refinement->texture == NULL && refinement->width == options->width
+	       && refinement->height == options->height
+	       && refinement->srcrect.x == options->srcrect.x
+	       && refinement->srcrect.y == options->srcrect.y
+	       && refinement->srcrect.w == options->srcrect.w
+	       && refinement->srcrect.h == options->srcrect.h;
+}
+
+bool nqiv_image_form_refine(nqiv_image* image, const nqiv_event_image_refine_options* options)
+{
+	assert(image != NULL);
+	assert(options != NULL);
+	assert(options->width > 0);
+	assert(options->height > 0);
+	nqiv_image_form* form = &image->image;
+	nqiv_image_lock(image);
+	if(!nqiv_image_form_wants_refinement(form, options)) {
+		nqiv_image_unlock(image);
+		return false;
+	}
+	/* Resample from a private copy of the form, like a decode, without the lock. */
+	nqiv_image_form staging = {0};
+	VipsImage*      vips = form->vips;
+	if(vips != NULL) {
+		g_object_ref(vips);
+	}
+	staging.path = form->path;
+	nqiv_image_unlock(image);
+	/* The vips image is pruned once the texture is made, so it's opened again just for this. Only
+	 * the area in view is decoded. */
+	if(vips == NULL) {
+		vips = vips_image_new_from_file(staging.path, NULL);
+		if(vips == NULL) {
+			nqiv_log_vips_exception(image->parent->logger, image, form);
+			return false;
+		}
+	}
+
+	VipsImage* area;
+	if(vips_extract_area(vips, &area, options->srcrect.x, options->srcrect.y, options->srcrect.w,
+	                     options->srcrect.h, NULL)
+	   == -1) {
+		g_object_unref(vips);
+		nqiv_log_vips_exception(image->parent->logger, image, form);
+		return false;
+	}
+	g_object_unref(vips);
+	const double hscale = (double)options->width / (double)options->srcrect.w;
+	const double vscale = (double)options->height / (double)options->srcrect.h;
+	/* Enlarging is only asked for in place of SDL's linear scaling, so it's matched. */
+	const VipsKernel kernel =
+		hscale > 1.0 || vscale > 1.0 ? VIPS_KERNEL_LINEAR : VIPS_KERNEL_LANCZOS3;
+	if(vips_resize(area, &staging.vips, hscale, "vscale", vscale, "kernel", kernel, NULL)
+	   == -1) {
+		g_object_unref(area);
+		nqiv_log_vips_exception(image->parent->logger, image, form);
+		return false;
+	}
+	g_object_unref(area);
+	staging.width = vips_image_get_width(staging.vips);
+	staging.height = vips_image_get_height(staging.vips);
+	staging.srcrect.w = staging.width;
+	staging.srcrect.h = staging.height;
+	nqiv_image_load_surface(image, &staging);
+	nqiv_unload_image_form_vips(&staging);
+
+	nqiv_image_lock(image);
+	const bool published =
+		staging.surface != NULL && nqiv_image_form_wants_refinement(form, options);
+	if(published) {
+		form->refinement.data = staging.data;
+		form->refinement.surface = staging.surface;
+		staging.data = NULL;
+		staging.surface = NULL;
+	}
+	nqiv_image_unlock(image);
+	nqiv_unload_image_form_surface(&staging);
+	/* Raw data may have been extracted without making a surface of it. */
+	if(staging.data != NULL) {
+		free(staging.data);
+		staging.data = NULL;
+	}
+	nqiv_log_write(image->parent->logger, NQIV_LOG_DEBUG,
+	               "%s refinement %dx%d of %dx%d+%dx%d for image %s\n",
+	               published ? "Published" : "Discarded", options->width, options->height,
+	               options->srcrect.w, options->srcrect.h, options->srcrect.x, options->srcrect.y,
+	               image->image.path);
+	return published;
+}
+
 int nqiv_lookup_vips_png_comment(gchar** values, const char* key)
 {
 	const size_t keylen = strlen(key);
@@ -606,6 +1009,9 @@ void nqiv_image_manager_destroy(nqiv_image_manager* manager)
 	}
 	nqiv_log_write(manager->logger, NQIV_LOG_INFO, "Destroying image manager.\n");
 
+	if(manager->loaded != NULL) {
+		nqiv_array_destroy(manager->loaded);
+	}
 	if(manager->images != NULL) {
 		const int    num_images = nqiv_array_get_units_count(manager->images);
 		nqiv_image** images = manager->images->data;
@@ -618,6 +1024,9 @@ void nqiv_image_manager_destroy(nqiv_image_manager* manager)
 	if(manager->thumbnail.root != NULL) {
 		free(manager->thumbnail.root);
 	}
+	if(manager->color_lut != NULL) {
+		nqiv_color_lut_unref(manager->color_lut);
+	}
 	memset(manager, 0, sizeof(nqiv_image_manager));
 }
 
@@ -642,9 +1051,20 @@ bool nqiv_image_manager_init(nqiv_image_manager* manager,
 	}
 	nqiv_array_unlimit_data(images);
 	images->min_add_count = STARTING_QUEUE_LENGTH;
+	nqiv_array* loaded = nqiv_array_create(sizeof(nqiv_image*), starting_length);
+	if(loaded == NULL) {
+		nqiv_array_destroy(images);
+		nqiv_log_write(logger, NQIV_LOG_ERROR,
+		               "Cannot make image manager loaded images array with starting length of: %d",
+		               starting_length);
+		return false;
+	}
+	nqiv_array_unlimit_data(loaded);
+	loaded->min_add_count = STARTING_QUEUE_LENGTH;
 	nqiv_image_manager_destroy(manager);
 	manager->logger = logger;
 	manager->images = images;
+	manager->loaded = loaded;
 	manager->zoom.image_to_viewport_ratio_max = 1.0;
 	manager->zoom.image_to_viewport_ratio = 1.0;
 	manager->zoom.fit_level = 1.0;
@@ -671,6 +1091,8 @@ bool nqiv_image_manager_init(nqiv_image_manager* manager,
 	manager->thumbnail.size = 256;
 
 	manager->default_frame_time = 100;
+	manager->max_pixels = 100000000;
+	manager->max_decode_time = 30000;
 
 	nqiv_log_write(logger, NQIV_LOG_INFO,
 	               "Successfully made image manager with starting length of: %d\n",
@@ -678,6 +1100,17 @@ bool nqiv_image_manager_init(nqiv_image_manager* manager,
 	return true;
 }
 
+/* Update the index of each image from start on, after the ones before it were changed. */
+void nqiv_image_manager_reindex(nqiv_image_manager* manager, const int start)
+{
+	const int    num_images = nqiv_array_get_units_count(manager->images);
+	nqiv_image** images = manager->images->data;
+	int          idx;
+	for(idx = start; idx < num_images; ++idx) {
+		images[idx]->index = idx;
+	}
+}
+
 bool nqiv_image_manager_insert(nqiv_image_manager* manager, const char* path, const int index)
 {
 	nqiv_image* image = nqiv_image_create(manager->logger, path);
@@ -702,7 +1135,9 @@ bool nqiv_image_manager_insert(nqiv_image_manager* manager, const char* path, co
 	}
 	nqiv_log_write(manager->logger, NQIV_LOG_INFO,
 	               "Added image at path '%s' to image manager at index %d.\n", path, index);
+	nqiv_image_manager_reindex(manager, index);
 	image->parent = manager;
+	nqiv_image_set_interest(image, nqiv_image_manager_get_interest_generation(manager));
 	return true;
 }
 
@@ -720,8 +1155,10 @@ bool nqiv_image_manager_remove(nqiv_image_manager* manager, const int index)
 	}
 	nqiv_image* image = NULL;
 	nqiv_array_get(manager->images, index, &image);
+	nqiv_image_manager_unlist_loaded(manager, image);
 	nqiv_image_destroy(image);
 	nqiv_array_remove(manager->images, index);
+	nqiv_image_manager_reindex(manager, index);
 	return true;
 }
 
@@ -739,10 +1176,265 @@ bool nqiv_image_manager_append(nqiv_image_manager* manager, const char* path)
 	}
 	nqiv_log_write(manager->logger, NQIV_LOG_INFO, "Added image at path '%s' to image manager.\n",
 	               path);
+	image->index = nqiv_array_get_last_idx(manager->images);
 	image->parent = manager;
+	nqiv_image_set_interest(image, nqiv_image_manager_get_interest_generation(manager));
+	return true;
+}
+
+/* Generations wrap around, so they're compared by the sign of their unsigned difference. */
+int nqiv_image_interest_diff(const int a, const int b)
+{
+	return (int)((unsigned int)a - (unsigned int)b);
+}
+
+void nqiv_image_set_interest(nqiv_image* image, const int generation)
+{
+	SDL_AtomicSet(&image->interest, generation);
+}
+
+bool nqiv_image_is_of_interest(nqiv_image* image)
+{
+	return nqiv_image_interest_diff(SDL_AtomicGet(&image->interest),
+	                                SDL_AtomicGet(&image->parent->interest_generation))
+	       >= 0;
+}
+
+nqiv_image_orientation nqiv_image_orientation_from_exif(const int exif)
+{
+	/* Indexed by tag. Even tags are mirrored, and 5 to 8 are turned on their side. */
+	const nqiv_image_orientation orientations[] = {
+		{0, false}, {0, false}, {0, true}, {2, false}, {2, true},
+		{3, true},  {1, false}, {1, true}, {3, false},
+	};
+	if(exif < 1 || exif > 8) {
+		return orientations[0];
+	}
+	return orientations[exif];
+}
+
+nqiv_image_orientation nqiv_image_orientation_combine(const nqiv_image_orientation* first,
+                                                      const nqiv_image_orientation* second)
+{
+	/* Mirroring after turning is the same as turning the other way after mirroring. */
+	nqiv_image_orientation combined;
+	combined.flip = first->flip != second->flip;
+	combined.turns = second->flip ? second->turns - first->turns : second->turns + first->turns;
+	combined.turns = ((combined.turns % 4) + 4) % 4;
+	return combined;
+}
+
+bool nqiv_image_orientation_swaps_axes(const nqiv_image_orientation* orientation)
+{
+	return orientation->turns % 2 != 0;
+}
+
+void nqiv_image_orientation_unmap_rect(const nqiv_image_orientation* orientation,
+                                       const int                     width,
+                                       const int                     height,
+                                       SDL_Rect*                     rect)
+{
+	/* Undo each turn, then the mirroring. Each clockwise turn took the image from height by width
+	 * to width by height. */
+	int shown_width = width;
+	int shown_height = height;
+	int turn;
+	for(turn = 0; turn < orientation->turns; ++turn) {
+		const SDL_Rect turned = {rect->y, shown_width - rect->x - rect->w, rect->h, rect->w};
+		memcpy(rect, &turned, sizeof(SDL_Rect));
+		const int swap = shown_width;
+		shown_width = shown_height;
+		shown_height = swap;
+	}
+	if(orientation->flip) {
+		rect->x = shown_width - rect->x - rect->w;
+	}
+}
+
+nqiv_image* nqiv_image_event_get_image(const nqiv_event* event)
+{
+	switch(event->type) {
+	case NQIV_EVENT_IMAGE_LOAD:
+		return event->options.image_load.image;
+	case NQIV_EVENT_FORM_DECODE:
+		return event->options.form_decode.image;
+	case NQIV_EVENT_IMAGE_REFINE:
+		return event->options.image_refine.image;
+	default:
+		return NULL;
+	}
+}
+
+bool nqiv_image_event_is_current(const nqiv_event* event)
+{
+	nqiv_image* image = nqiv_image_event_get_image(event);
+	switch(event->lifetime) {
+	case NQIV_EVENT_LIFETIME_GENERATION:
+		assert(image != NULL);
+		return event->generation == nqiv_image_manager_get_interest_generation(image->parent);
+	case NQIV_EVENT_LIFETIME_INTEREST:
+		assert(image != NULL);
+		return nqiv_image_is_of_interest(image);
+	case NQIV_EVENT_LIFETIME_SELECTION:
+		assert(image != NULL);
+		return event->generation == nqiv_image_manager_get_selection_generation(image->parent)
+		       && nqiv_image_is_of_interest(image);
+	default:
+		return true;
+	}
+}
+
+void nqiv_image_event_discard(const nqiv_event* event)
+{
+	switch(event->type) {
+	case NQIV_EVENT_IMAGE_LOAD:
+		/* Don't leave the image waiting on an event that will never arrive, but leave the pending
+		 * load to any other event still queued for it. */
+		if(event->options.image_load.pending) {
+			nqiv_image_unsend_pending_load(event->options.image_load.image, event);
+		}
+		break;
+	case NQIV_EVENT_IMAGE_REFINE:
+		/* Let the master ask for it again, if it's still wanted once the image is shown again. */
+		SDL_AtomicSet(&event->options.image_refine.image->image.refinement.sent, 0);
+		break;
+	case NQIV_EVENT_FORM_DECODE:
+		/* Give the form up without decoding it, so another load may. */
+		nqiv_image_lock(event->options.form_decode.image);
+		nqiv_image_form_decode_finish(event->options.form_decode.image,
+		                              event->options.form_decode.decode);
+		nqiv_image_unlock(event->options.form_decode.image);
+		free(event->options.form_decode.decode);
+		break;
+	default:
+		break;
+	}
+}
+
+int nqiv_image_manager_get_interest_generation(nqiv_image_manager* manager)
+{
+	return SDL_AtomicGet(&manager->interest_generation);
+}
+
+void nqiv_image_manager_advance_interest_generation(nqiv_image_manager* manager)
+{
+	/* Only the master advances it, so there's no race between the read and the write. */
+	const int generation = SDL_AtomicGet(&manager->interest_generation);
+	SDL_AtomicSet(&manager->interest_generation, (int)((unsigned int)generation + 1));
+	nqiv_log_write(manager->logger, NQIV_LOG_DEBUG, "Advanced interest generation to %d.\n",
+	               SDL_AtomicGet(&manager->interest_generation));
+}
+
+void nqiv_image_manager_set_color_lut(nqiv_image_manager* manager, nqiv_color_lut* lut)
+{
+	if(lut != NULL) {
+		nqiv_color_lut_ref(lut);
+	}
+	SDL_AtomicLock(&manager->color_lut_lock);
+	nqiv_color_lut* old_lut = manager->color_lut;
+	manager->color_lut = lut;
+	SDL_AtomicUnlock(&manager->color_lut_lock);
+	/* A worker may still be converting with it. */
+	if(old_lut != NULL) {
+		nqiv_color_lut_unref(old_lut);
+	}
+}
+
+bool nqiv_image_manager_list_loaded(nqiv_image_manager* manager, nqiv_image* image)
+{
+	if(!nqiv_image_has_loaded_form(image)) {
+		return true;
+	}
+	SDL_AtomicLock(&manager->loaded_lock);
+	bool result = true;
+	if(image->loaded_position == 0) {
+		result = nqiv_array_push(manager->loaded, &image);
+		if(result) {
+			image->loaded_position = nqiv_array_get_units_count(manager->loaded);
+		}
+	}
+	SDL_AtomicUnlock(&manager->loaded_lock);
+	if(!result) {
+		nqiv_log_write(manager->logger, NQIV_LOG_ERROR,
+		               "Failed to list image %s as loaded. It won't be pruned.\n",
+		               image->image.path);
+	}
+	return result;
+}
+
+void nqiv_image_manager_unlist_loaded(nqiv_image_manager* manager, nqiv_image* image)
+{
+	SDL_AtomicLock(&manager->loaded_lock);
+	if(image->loaded_position != 0) {
+		/* The last image takes its place. */
+		nqiv_image** loaded = manager->loaded->data;
+		const int    last = nqiv_array_get_last_idx(manager->loaded);
+		loaded[image->loaded_position - 1] = loaded[last];
+		loaded[last]->loaded_position = image->loaded_position;
+		nqiv_array_remove(manager->loaded, last);
+		image->loaded_position = 0;
+	}
+	SDL_AtomicUnlock(&manager->loaded_lock);
+}
+
+bool nqiv_image_manager_get_loaded(nqiv_image_manager* manager, nqiv_array* output)
+{
+	nqiv_array_clear(output);
+	SDL_AtomicLock(&manager->loaded_lock);
+	const int  count = nqiv_array_get_units_count(manager->loaded);
+	const bool result = count == 0 || nqiv_array_push_count(output, manager->loaded->data, count);
+	SDL_AtomicUnlock(&manager->loaded_lock);
+	return result;
+}
+
+nqiv_color_lut* nqiv_image_manager_get_color_lut(nqiv_image_manager* manager)
+{
+	SDL_AtomicLock(&manager->color_lut_lock);
+	nqiv_color_lut* lut = manager->color_lut;
+	if(lut != NULL) {
+		nqiv_color_lut_ref(lut);
+	}
+	SDL_AtomicUnlock(&manager->color_lut_lock);
+	return lut;
+}
+
+int nqiv_image_manager_get_selection_generation(nqiv_image_manager* manager)
+{
+	return SDL_AtomicGet(&manager->selection_generation);
+}
+
+void nqiv_image_manager_advance_selection_generation(nqiv_image_manager* manager)
+{
+	/* Only the master advances it, so there's no race between the read and the write. */
+	const int generation = SDL_AtomicGet(&manager->selection_generation);
+	SDL_AtomicSet(&manager->selection_generation, (int)((unsigned int)generation + 1));
+}
+
+bool nqiv_image_manager_event_is_dead(const void* entry)
+{
+	const nqiv_event* event = entry;
+	if(nqiv_image_event_is_current(event)) {
+		return false;
+	}
+	/* Decodes are left for a worker to drop, since giving up their form takes the image lock, which
+	 * mustn't be taken under the queue's. */
+	if(event->type == NQIV_EVENT_FORM_DECODE) {
+		return false;
+	}
+	nqiv_image_event_discard(event);
 	return true;
 }
 
+int nqiv_image_manager_purge_events(nqiv_image_manager* manager, nqiv_priority_queue* queue)
+{
+	const int removed = nqiv_priority_queue_purge(queue, nqiv_image_manager_event_is_dead);
+	if(removed > 0) {
+		nqiv_log_write(manager->logger, NQIV_LOG_DEBUG, "Purged %d out of date events.\n",
+		               removed);
+	}
+	return removed;
+}
+
 bool nqiv_image_manager_set_thumbnail_root(nqiv_image_manager* manager, const char* path)
 {
 	if(manager->thumbnail.root != NULL) {
@@ -1144,7 +1836,6 @@ bool nqiv_image_manager_reattempt_thumbnails(nqiv_image_manager* manager, const
 			if(images[idx]->thumbnail.vips != NULL || images[idx]->thumbnail.surface != NULL) {
 				nqiv_event event = {0};
 				event.type = NQIV_EVENT_IMAGE_LOAD;
-				event.transaction_group = -1;
 				event.options.image_load.image = images[idx];
 				event.options.image_load.thumbnail_options.unload = true;
 				event.options.image_load.thumbnail_options.vips =
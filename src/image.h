@@ -6,9 +6,13 @@
 #include <SDL2/SDL.h>
 #include <vips/vips.h>
 
+#include "typedefs.h"
 #include "array.h"
 #include "queue.h"
 #include "logging.h"
+#include "event.h"
+#include "atlas.h"
+#include "color.h"
 
 /*
  * Image data is stored and managed within an nqiv_image_manager object, which
@@ -24,6 +28,43 @@
  * performed in a worker thread, except for texture loading and unloading, which
  * must be performed from the master, due to the constraints of OpenGL, which
  * backs SDL2's textures at the time of writing.
+ *
+ * Each image has at most one pending load event in the thread queue. Further
+ * load requests made before a worker picks it up are merged into the options
+ * held by the image, and only queue another event if they need to be handled
+ * at a higher priority. The worker takes the merged options when it pops any
+ * of these events, so the rest find nothing to do.
+ *
+ * Whether queued work is still worth doing is tracked per image. The image
+ * manager has an interest generation, which is advanced whenever the montage
+ * moves to a different range of images. Before advancing it, every image in
+ * the new range is marked with the new generation. An image is of interest if
+ * its mark is not behind the current generation, so work for images that stay
+ * within range survives the change. These are atomic, so workers may read them
+ * without locks.
+ *
+ * Forms with more pixels than the manager's max_pixels are never loaded, so
+ * a single enormous file can't exhaust memory. Decoding pixel data is watched
+ * as vips computes it. If it runs longer than max_decode_time, it is killed
+ * and the form marked as an error. If the image stops being of interest, it
+ * is killed without error, so it may be loaded again if wanted later.
+ *
+ * Separately, a selection generation is advanced whenever the montage
+ * selection moves. Events queued at a priority based on the old selection are
+ * then out of date, so they can be sent again at a new one.
+ *
+ * Once the view of an image has settled, a worker resamples the area in view,
+ * and a margin around it, from the VIPS image to the exact size it's drawn at.
+ * That's drawn instead of the texture while panning stays inside it, and the
+ * next is asked for right away once panning leaves it. While zooming, the last
+ * refinement is scaled by SDL until the next is made, as long as it isn't much
+ * coarser. If the VIPS image was pruned, the worker opens it again just for
+ * this. See nqiv_image_refinement.
+ *
+ * Images are turned upright by their EXIF orientation, and turned further by
+ * the user, as they're drawn. The pixels and textures are never rotated. Zooming
+ * and panning work on the image as it's shown, and the area of it in view is
+ * mapped back to the texture. See nqiv_image_orientation.
  */
 
 typedef struct nqiv_image_form_animation
@@ -36,6 +77,36 @@ typedef struct nqiv_image_form_animation
 	Uint32 delay;           /* Delay for the current frame- this can vary. */
 } nqiv_image_form_animation;
 
+/* Mirrored from left to right if flip is set, then turned clockwise by a quarter for each turn. */
+typedef struct nqiv_image_orientation
+{
+	int  turns;
+	bool flip;
+} nqiv_image_orientation;
+
+/* An area of the whole image, resampled to the size it's drawn at. Only the image form uses it.
+ * Protected by the lock, except the texture, which is reserved to the master. */
+typedef struct nqiv_image_refinement
+{
+	/* Asked for by the master. A zero width if nothing is. */
+	SDL_Rect     srcrect;
+	int          width;
+	int          height;
+	/* Has a worker been asked for it? Cleared if it is lost, or the event for it dropped, so it's
+	 * asked for again. Atomic, since events are dropped without the lock. */
+	SDL_atomic_t sent;
+	/* Published by a worker, until the master makes a texture of it. */
+	void*        data;
+	SDL_Surface* surface;
+	SDL_Texture* texture;
+	/* An earlier refinement, drawn while the one asked for is made, with the area and size it was
+	 * resampled to. Reserved to the master, like the texture. */
+	SDL_Texture* previous_texture;
+	SDL_Rect     previous_srcrect;
+	int          previous_width;
+	int          previous_height;
+} nqiv_image_refinement;
+
 typedef struct nqiv_image_form
 {
 	nqiv_image_form_animation animation;
@@ -62,27 +133,131 @@ typedef struct nqiv_image_form
 	SDL_Rect                  master_srcrect;
 	SDL_Rect                  master_dstrect;
 	bool                      master_dimensions_set;
+	/* If the texture is shared from an atlas, where in it the form is kept. Also reserved to the
+	 * master. */
+	nqiv_atlas_slot           atlas_slot;
+	nqiv_image_refinement     refinement;
+	/* Turns the form upright, from its EXIF orientation. Set with the vips image. */
+	nqiv_image_orientation    orientation;
+	/* Orientation the master last drew the form with, for the fallback texture. */
+	nqiv_image_orientation    master_orientation;
 	/* Have we tried and failed to load a thumbnail? If the thumbnail is
 	 * successfully created later on, this may be reset. */
 	bool                      thumbnail_load_failed;
+	/* A worker is decoding the surface without holding the image lock. See
+	 * nqiv_image_form_decode. */
+	bool                      decoding;
 } nqiv_image_form;
 
-typedef struct nqiv_image         nqiv_image;
+/* Decoding the pixels of a form into a surface is by far the slowest part of loading it. So, it is
+ * done on a private copy of the form without holding the image lock, leaving the master and pruner
+ * free to use the image meanwhile. The result is then published to the form under the lock, unless
+ * the form changed in the meantime, in which case it's discarded. */
+struct nqiv_image_form_decode
+{
+	/* Form the result will be published to. */
+	nqiv_image_form* target;
+	/* Private copy decoded into. It holds its own reference to the vips image. */
+	nqiv_image_form  staging;
+};
+
 typedef struct nqiv_image_manager nqiv_image_manager;
 
+typedef struct nqiv_image_pending_load
+{
+	/* Protected by its own lock, since the image lock is held for the whole of a load. */
+	omp_lock_t                    lock;
+	bool                          exists;
+	/* Highest priority (lowest level) an event has been queued at for it. */
+	int                           level;
+	/* Events queued for it, until a worker takes it. */
+	int                           queued;
+	/* Counts up every time a pending load is created, so events can tell theirs from a later one. */
+	int                           generation;
+	nqiv_event_image_load_options options;
+} nqiv_image_pending_load;
+
 struct nqiv_image
 {
-	nqiv_image_manager* parent;
-	omp_lock_t          lock;
+	nqiv_image_manager*     parent;
+	omp_lock_t              lock;
 	/* Have we tried to create a thumbnail, successfully or otherwise? Don't
 	 * retry. */
-	bool                thumbnail_attempted;
+	bool                    thumbnail_attempted;
 	/* Used to visually mark images and select them for certain operations. */
-	bool                marked;
-	nqiv_image_form     image;
-	nqiv_image_form     thumbnail;
+	bool                    marked;
+	/* Turned by the user, on top of the orientation of the image form. Reserved to the master. */
+	nqiv_image_orientation  rotation;
+	nqiv_image_form         image;
+	nqiv_image_form         thumbnail;
+	nqiv_image_pending_load pending_load;
+	/* Last interest generation the image was marked with. */
+	SDL_atomic_t            interest;
+	/* Index plus one of the worker that last loaded it, 0 for none. Its later loads are queued to
+	 * that worker, whose caches are likeliest to still hold the image's data. */
+	SDL_atomic_t            worker;
+	/* Position in the image manager's images. Reserved to the master. */
+	int                     index;
+	/* Position plus one in the image manager's list of loaded images, 0 if it's not in it. */
+	int                     loaded_position;
 };
 
+/* Merge a load event into the one pending for the image. Returns true if the event must be queued
+ * at the given level, because nothing was pending or it was only pending at a lower priority. The
+ * event then records whether it created the pending load or raised it from which level. */
+bool nqiv_image_add_pending_load(nqiv_image* image, nqiv_event* event, const int level);
+/* Undo adding an event which couldn't be queued, or was dropped from the queue. The pending load is
+ * dropped if no other event was queued for it, otherwise its level is restored if the event raised
+ * it. */
+void nqiv_image_unsend_pending_load(nqiv_image* image, const nqiv_event* event);
+/* Replace the options of the event with those pending for the image, which are then cleared.
+ * Returns false if nothing was pending. */
+bool nqiv_image_take_pending_load(nqiv_image* image, nqiv_event* event);
+
+/* Orientation for an EXIF orientation tag, from 1 to 8. */
+nqiv_image_orientation nqiv_image_orientation_from_exif(const int exif);
+/* Orientation of turning by first, then second. */
+nqiv_image_orientation nqiv_image_orientation_combine(const nqiv_image_orientation* first,
+                                                      const nqiv_image_orientation* second);
+/* Are width and height swapped when shown? */
+bool                   nqiv_image_orientation_swaps_axes(const nqiv_image_orientation* orientation);
+/* Map rect from an image of width and height as it's shown back to the unturned image. */
+void                   nqiv_image_orientation_unmap_rect(const nqiv_image_orientation* orientation,
+                                                         const int                     width,
+                                                         const int                     height,
+                                                         SDL_Rect*                     rect);
+
+/* Mark the image as of interest in the given generation. */
+void        nqiv_image_set_interest(nqiv_image* image, const int generation);
+bool        nqiv_image_is_of_interest(nqiv_image* image);
+/* Should a worker still act on this event? */
+bool        nqiv_image_event_is_current(const nqiv_event* event);
+/* Image the event is for, or NULL if it's not for one. */
+nqiv_image* nqiv_image_event_get_image(const nqiv_event* event);
+/* Release what an event that won't be handled holds: its share of the pending load of its image,
+ * the request for a refinement, or the decode it carries. The image lock must not be held. */
+void        nqiv_image_event_discard(const nqiv_event* event);
+
+/* Watches vips computing pixels for an image, and kills the computation if it runs over the decode
+ * time limit or the image is no longer of interest. */
+typedef struct nqiv_image_vips_watch
+{
+	nqiv_image* image;
+	/* A private image, since a killed image stays killed. */
+	VipsImage*  vips;
+	gulong      handler;
+	/* SDL ticks (milliseconds) when the watch was started. */
+	Uint64      start;
+	bool        timed_out;
+	bool        cancelled;
+} nqiv_image_vips_watch;
+
+/* Takes its own reference to vips. */
+void nqiv_image_vips_watch_start(nqiv_image_vips_watch* watch, nqiv_image* image, VipsImage* vips);
+/* Stop watching and release the reference. Returns true if the computation was killed, in which case
+ * the form is marked as an error if it timed out. */
+bool nqiv_image_vips_watch_finish(nqiv_image_vips_watch* watch, nqiv_image_form* form);
+
 bool nqiv_image_form_first_frame(nqiv_image* image, nqiv_image_form* form);
 bool nqiv_image_form_next_frame(nqiv_image* image, nqiv_image_form* form);
 
@@ -91,10 +266,28 @@ void nqiv_unload_image_form_texture(nqiv_image_form* form);
 void nqiv_unload_image_form_surface(nqiv_image_form* form);
 void nqiv_unload_image_form_fallback_texture(nqiv_image_form* form);
 void nqiv_unload_image_form_all_textures(nqiv_image_form* form);
+/* Free the refinement surface, without asking for it again. */
+void nqiv_unload_image_form_refinement_surface(nqiv_image_form* form);
+/* Throw out the refinement and what was asked for. The image must be locked, and this must be
+ * called from the master. */
+void nqiv_unload_image_form_refinement(nqiv_image_form* form);
 
 bool nqiv_image_load_vips(nqiv_image* image, nqiv_image_form* form);
 bool nqiv_image_load_texture(nqiv_image* image, nqiv_image_form* form);
 bool nqiv_image_load_surface(nqiv_image* image, nqiv_image_form* form);
+/* Start decoding the surface of a loaded form. The image must be locked, and decoding must not be
+ * already in progress. */
+void nqiv_image_form_decode_start(nqiv_image_form_decode* decode, nqiv_image_form* form);
+/* Decode, without the image locked. */
+bool nqiv_image_form_decode_run(nqiv_image* image, nqiv_image_form_decode* decode);
+/* Publish the result with the image locked, and release the private copy. Returns whether it was
+ * published. */
+bool nqiv_image_form_decode_finish(nqiv_image* image, nqiv_image_form_decode* decode);
+/* Resample the refinement asked for by the event, and publish it if it's still wanted. Takes the
+ * image lock itself. */
+bool nqiv_image_form_refine(nqiv_image* image, const nqiv_event_image_refine_options* options);
+/* "image" or "thumbnail", for logging. */
+const char* nqiv_image_form_name(const nqiv_image* image, const nqiv_image_form* form);
 
 /* Get thumbnail metadata. */
 int nqiv_lookup_vips_png_comment(gchar** values, const char* key);
@@ -166,6 +359,23 @@ struct nqiv_image_manager
 	int                                   max_texture_width;
 	nqiv_array*                           images;
 	nqiv_priority_queue*                  thread_queue;
+	/* See nqiv_image::interest */
+	SDL_atomic_t                          interest_generation;
+	/* See NQIV_EVENT_LIFETIME_SELECTION */
+	SDL_atomic_t                          selection_generation;
+	/* Forms with more pixels than this, over all frames, are not loaded. 0 for no limit. */
+	Uint64                                max_pixels;
+	/* Milliseconds decoding a form may take before it is killed. 0 for no limit. */
+	Uint64                                max_decode_time;
+	/* Converts loaded pixels for the display, or NULL to leave them as sRGB. Set by the master and
+	 * read by the workers, under the spinlock. */
+	nqiv_color_lut*                       color_lut;
+	SDL_SpinLock                          color_lut_lock;
+	/* Of nqiv_image*, in no order. Every image with a form loaded is in it, so the pruner need only
+	 * visit these. Workers add images as they load them, and the pruner takes them out once it
+	 * finds nothing of them loaded. Protected by the spinlock. */
+	nqiv_array*                           loaded;
+	SDL_SpinLock                          loaded_lock;
 };
 
 void nqiv_log_vips_exception(nqiv_log_ctx*          logger,
@@ -184,6 +394,29 @@ bool nqiv_image_manager_insert(nqiv_image_manager* manager, const char* path, co
 bool nqiv_image_manager_remove(nqiv_image_manager* manager, const int index);
 bool nqiv_image_manager_append(nqiv_image_manager* manager, const char* path);
 bool nqiv_image_manager_set_thumbnail_root(nqiv_image_manager* manager, const char* path);
+int  nqiv_image_manager_get_interest_generation(nqiv_image_manager* manager);
+/* Advance the interest generation after marking the images of interest with the next one. */
+void nqiv_image_manager_advance_interest_generation(nqiv_image_manager* manager);
+/* Convert images loaded from now on with lut, which may be NULL. The manager takes a reference. */
+void nqiv_image_manager_set_color_lut(nqiv_image_manager* manager, nqiv_color_lut* lut);
+/* The table images are converted with, referenced for the caller, or NULL. */
+nqiv_color_lut* nqiv_image_manager_get_color_lut(nqiv_image_manager* manager);
+/* If a form of the image is loaded, put it in the list of loaded images, unless it's there already.
+ * The image must be locked. */
+bool            nqiv_image_manager_list_loaded(nqiv_image_manager* manager, nqiv_image* image);
+/* Take the image out of the list of loaded images. The image must be locked, with nothing loaded,
+ * or about to be destroyed. */
+void            nqiv_image_manager_unlist_loaded(nqiv_image_manager* manager, nqiv_image* image);
+/* Replace the contents of output, an array of nqiv_image*, with the list of loaded images. */
+bool            nqiv_image_manager_get_loaded(nqiv_image_manager* manager, nqiv_array* output);
+int  nqiv_image_manager_get_selection_generation(nqiv_image_manager* manager);
+void nqiv_image_manager_advance_selection_generation(nqiv_image_manager* manager);
+/* Remove events from a thread queue which are out of date. Load events pending for images no longer
+ * of interest are dropped with them. Returns the number of events removed. */
+int  nqiv_image_manager_purge_events(nqiv_image_manager* manager, nqiv_priority_queue* queue);
+/* Is the event out of date? If so, any load pending for its image is dropped with it. Decodes are
+ * only dropped by the workers that take them. For use with nqiv_priority_queue_purge. */
+bool nqiv_image_manager_event_is_dead(const void* entry);
 
 void nqiv_image_manager_pan_left(nqiv_image_manager* manager);
 void nqiv_image_manager_pan_right(nqiv_image_manager* manager);
@@ -91,6 +91,10 @@ const char* const nqiv_keybind_action_names[] = {
 	"image_zoom_in_more",
 	"image_zoom_out_more",
 	"reload",
+	"rotate_right",
+	"rotate_left",
+	"flip_horizontal",
+	"flip_vertical",
 };
 
 nqiv_key_action nqiv_text_to_key_action(const char* text, const int length)
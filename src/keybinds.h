@@ -94,7 +94,11 @@ typedef enum nqiv_key_action
 	NQIV_KEY_ACTION_IMAGE_ZOOM_IN_MORE,
 	NQIV_KEY_ACTION_IMAGE_ZOOM_OUT_MORE,
 	NQIV_KEY_ACTION_RELOAD,
-	NQIV_KEY_ACTION_MAX = NQIV_KEY_ACTION_RELOAD,
+	NQIV_KEY_ACTION_ROTATE_RIGHT,
+	NQIV_KEY_ACTION_ROTATE_LEFT,
+	NQIV_KEY_ACTION_FLIP_HORIZONTAL,
+	NQIV_KEY_ACTION_FLIP_VERTICAL,
+	NQIV_KEY_ACTION_MAX = NQIV_KEY_ACTION_FLIP_VERTICAL,
 	NQIV_KEY_ACTION_LENGTH,
 } nqiv_key_action;
 
@@ -13,6 +13,8 @@
 #include "typedefs.h"
 #include "logging.h"
 #include "image.h"
+#include "atlas.h"
+#include "color.h"
 #include "worker.h"
 #include "array.h"
 #include "queue.h"
@@ -37,12 +39,14 @@
  * - Load a list of images as positional arguments.
  * - Start worker threads. See worker.h
  * - Start the master thread. The master thread follows this cycle:
- *   - Wait on an SDL event
- *   - If it's a key/mouse-related event, match and filter the keybind,
- *     then perform the related action. Otherwise, it can be a response from
- *     a worker or a command. Finally,update the state and do any needed rendering.
+ *   - Wait on an SDL event, and then until the display's next refresh.
+ *   - For each event queued by then, if it's a key/mouse-related event, match
+ *     and filter the keybind, then perform the related action. Otherwise, it
+ *     can be a response from a worker or a command.
+ *   - Finally, if any of them called for it, update the state and render once.
  *     - Do pruning if necessary.
- *     - Update transaction group depending on state of montage.
+ *     - Update images of interest depending on state of montage, purging
+ *       queued work for the rest.
  *     - Dispatch relevant loading events and load textures.
  *     - Set the title.
  *     - Render the image or montage.
@@ -62,9 +66,32 @@ void nqiv_close_log_streams(nqiv_state* state)
 	}
 }
 
+/* Events left in a queue may hold decodes and shares of pending loads, which are given up before
+ * the queue is destroyed. */
+void nqiv_drain_thread_queue(nqiv_priority_queue* queue)
+{
+	nqiv_event event;
+	while(nqiv_priority_queue_pop(queue, &event)) {
+		nqiv_image_event_discard(&event);
+	}
+}
+
 void nqiv_state_clear(nqiv_state* state)
 {
+	/* The workers have stopped, and the images are still there. */
+	nqiv_drain_thread_queue(&state->io_thread_queue);
+	nqiv_drain_thread_queue(&state->thread_queue);
+	if(state->worker_pool.locals != NULL) {
+		int idx;
+		for(idx = 0; idx < state->worker_pool.count; ++idx) {
+			nqiv_drain_thread_queue(&state->worker_pool.locals[idx]);
+		}
+	}
+	nqiv_worker_pool_destroy(&state->io_worker_pool);
+	nqiv_priority_queue_destroy(&state->io_thread_queue);
+	nqiv_worker_pool_destroy(&state->worker_pool);
 	nqiv_priority_queue_destroy(&state->thread_queue);
+	nqiv_priority_queue_batch_destroy(&state->thread_batch);
 	if(state->key_actions.array != NULL) {
 		nqiv_queue_destroy(&state->key_actions);
 	}
@@ -80,6 +107,8 @@ void nqiv_state_clear(nqiv_state* state)
 	if(state->pruner.pruners != NULL) {
 		nqiv_pruner_destroy(&state->pruner);
 	}
+	/* Images give back their slots first. */
+	nqiv_atlas_manager_destroy(&state->atlases);
 	if(state->logger.streams != NULL) {
 		nqiv_close_log_streams(state);
 		nqiv_log_destroy(&state->logger);
@@ -99,6 +128,12 @@ void nqiv_state_clear(nqiv_state* state)
 	if(state->texture_alpha_background != NULL) {
 		SDL_DestroyTexture(state->texture_alpha_background);
 	}
+	if(state->texture_montage != NULL) {
+		SDL_DestroyTexture(state->texture_montage);
+	}
+	if(state->montage_cells != NULL) {
+		free(state->montage_cells);
+	}
 	if(state->renderer != NULL) {
 		SDL_DestroyRenderer(state->renderer);
 	}
@@ -108,9 +143,6 @@ void nqiv_state_clear(nqiv_state* state)
 	if(state->SDL_inited) {
 		SDL_Quit();
 	}
-	if(state->thread_event_transaction_group > 0) {
-		omp_destroy_lock(&state->thread_event_transaction_group_lock);
-	}
 	memset(state, 0, sizeof(nqiv_state));
 	vips_shutdown();
 }
@@ -125,6 +157,27 @@ void nqiv_set_keyrate_defaults(nqiv_keyrate_manager* manager)
 	manager->send_on_down = false;
 }
 
+/* Make a color table for the display profile of the window, for images to be converted with as
+ * they're loaded. Without a profile, images are left as sRGB. */
+void nqiv_update_color_profile(nqiv_state* state)
+{
+	size_t          profile_size = 0;
+	void*           profile = SDL_GetWindowICCProfile(state->window, &profile_size);
+	nqiv_color_lut* lut = NULL;
+	if(profile != NULL && profile_size > 0
+	   && !nqiv_color_lut_create(&state->logger, profile, profile_size, &lut)) {
+		nqiv_log_write(&state->logger, NQIV_LOG_WARNING,
+		               "Failed to use display profile. Images will be shown as sRGB.\n");
+	}
+	if(profile != NULL) {
+		SDL_free(profile);
+	}
+	nqiv_image_manager_set_color_lut(&state->images, lut);
+	if(lut != NULL) {
+		nqiv_color_lut_unref(lut);
+	}
+}
+
 bool nqiv_setup_sdl(nqiv_state* state)
 {
 	if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
@@ -155,6 +208,24 @@ bool nqiv_setup_sdl(nqiv_state* state)
 	}
 	state->images.max_texture_width = renderer_info.max_texture_width;
 	state->images.max_texture_height = renderer_info.max_texture_height;
+	/* Vsync may be asked for through SDL_RENDER_VSYNC. */
+	state->render_vsync = (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+	state->render_software = (renderer_info.flags & SDL_RENDERER_SOFTWARE) != 0;
+	if(state->render_software) {
+		nqiv_log_write(&state->logger, NQIV_LOG_INFO,
+		               "Drawing with the software renderer (%s).\n", renderer_info.name);
+	}
+	/* Some renderers have no limit. */
+	int atlas_size = renderer_info.max_texture_width < renderer_info.max_texture_height
+	                     ? renderer_info.max_texture_width
+	                     : renderer_info.max_texture_height;
+	if(atlas_size <= 0) {
+		atlas_size = NQIV_ATLAS_MAX_SIZE;
+	}
+	if(!nqiv_atlas_manager_init(&state->atlases, &state->logger, state->renderer, atlas_size)) {
+		return false;
+	}
+	nqiv_update_color_profile(state);
 	if(SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255) != 0) {
 		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
 		               "Failed to set SDL Renderer draw color. SDL Error: %s\n", SDL_GetError());
@@ -168,7 +239,8 @@ bool nqiv_setup_sdl(nqiv_state* state)
 	   || !nqiv_state_create_single_color_texture(state, &state->error_color,
 	                                              &state->texture_montage_error_background)
 	   || !nqiv_state_create_thumbnail_selection_texture(state)
-	   || !nqiv_state_create_mark_texture(state)) {
+	   || !nqiv_state_create_mark_texture(state)
+	   || !nqiv_state_create_alpha_background_texture(state)) {
 		return false;
 	}
 
@@ -211,14 +283,83 @@ void nqiv_setup_montage(nqiv_state* state)
 	nqiv_update_montage_dimensions(state);
 }
 
+bool nqiv_init_thread_queue(nqiv_log_ctx* logger, nqiv_priority_queue* queue)
+{
+	if(!nqiv_priority_queue_init(queue, logger, sizeof(nqiv_event), STARTING_QUEUE_LENGTH,
+	                             THREAD_QUEUE_BIN_COUNT)
+	   || !nqiv_priority_queue_set_max_data_length(queue, THREAD_QUEUE_MAX_LENGTH)
+	   || !nqiv_priority_queue_set_min_add_count(queue, THREAD_QUEUE_ADD_COUNT)) {
+		nqiv_priority_queue_destroy(queue);
+		return false;
+	}
+	int fifo_level;
+	for(fifo_level = THREAD_QUEUE_FIFO_START; fifo_level < THREAD_QUEUE_BIN_COUNT; ++fifo_level) {
+		if(!nqiv_priority_queue_set_fifo(queue, fifo_level, THREAD_QUEUE_RING_LENGTH)) {
+			nqiv_priority_queue_destroy(queue);
+			return false;
+		}
+	}
+	return true;
+}
+
 bool nqiv_setup_thread_info(nqiv_state* state)
 {
 	if(state->thread_count == 0) {
 		state->thread_count = 1;
 	}
-	omp_init_lock(&state->thread_event_transaction_group_lock);
-	assert(state->thread_event_transaction_group == 0);
-	state->thread_event_transaction_group = 1;
+	nqiv_priority_queue* locals = calloc(state->thread_count, sizeof(nqiv_priority_queue));
+	if(locals == NULL) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+		               "Failed to allocate worker queues for %d threads.\n", state->thread_count);
+		return false;
+	}
+	int idx;
+	for(idx = 0; idx < state->thread_count; ++idx) {
+		if(!nqiv_init_thread_queue(&state->logger, &locals[idx])) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+			               "Failed to initialize queue for worker %d.\n", idx);
+			break;
+		}
+	}
+	if(idx < state->thread_count
+	   || !nqiv_worker_pool_init(&state->worker_pool, &state->logger, &state->thread_queue, locals,
+	                             state->thread_count)) {
+		/* A queue which failed to initialize cleaned up after itself. */
+		for(idx = idx - 1; idx >= 0; --idx) {
+			nqiv_priority_queue_destroy(&locals[idx]);
+		}
+		free(locals);
+		return false;
+	}
+	if(state->io_thread_count > 0
+	   && !nqiv_worker_pool_init(&state->io_worker_pool, &state->logger, &state->io_thread_queue,
+	                             NULL, state->io_thread_count)) {
+		return false;
+	}
+	/* No worker has started, so the queues may still be changed. */
+	for(idx = 0; idx < state->worker_pool.queue_count; ++idx) {
+		nqiv_priority_queue_set_aging(state->worker_pool.queues[idx],
+		                              (Uint32)state->thread_aging_interval);
+	}
+	nqiv_priority_queue_set_aging(&state->io_thread_queue, (Uint32)state->thread_aging_interval);
+	state->worker_pool.niceness = state->thread_niceness;
+	state->worker_pool.idle = state->thread_idle;
+	state->io_worker_pool.niceness = state->thread_niceness;
+	state->io_worker_pool.idle = state->thread_idle;
+	/* Threads inherit the processors of the thread which starts them. So, keep the workers, and the
+	 * VIPS threads they start, off the master's processor before any are started. */
+	if(state->thread_master_cpu >= 0 && !nqiv_set_thread_cpu(state->thread_master_cpu, true)) {
+		nqiv_log_write(&state->logger, NQIV_LOG_WARNING,
+		               "Failed to keep worker threads off processor %d. Not pinning the master "
+		               "thread.\n",
+		               state->thread_master_cpu);
+		state->thread_master_cpu = -1;
+	}
+	/* Start from a third of the processors, and let the governor find the right number. */
+	const int initial_workers = nqiv_get_available_cpus() / 3;
+	nqiv_governor_init(&state->governor, &state->logger, &state->worker_pool,
+	                   (Uint64)state->governor_interval, state->thread_min_count, initial_workers,
+	                   state->vips_threads);
 	return true;
 }
 
@@ -278,6 +419,10 @@ bool nqiv_load_builtin_config(nqiv_state* state, const char* exe, const char* de
 		"append keybind A=actual_size",
 		"append keybind D=toggle_kept_zoom",
 		"append keybind T=toggle_scale_mode",
+		"append keybind ]=rotate_right",
+		"append keybind [=rotate_left",
+		"append keybind H=flip_horizontal",
+		"append keybind V=flip_vertical",
 		"append keybind shift+F=keep_fit",
 		"append keybind shift+A=keep_actual_size",
 		"append keybind shift+D=keep_current_zoom",
@@ -348,16 +493,28 @@ nqiv_op_result nqiv_parse_args(char* argv[], nqiv_state* state)
 {
 	state->zoom_default = NQIV_ZOOM_DEFAULT_FIT;
 	state->texture_scale_mode = SDL_ScaleModeBest;
+	state->refine_delay = 250;
 	state->no_resample_oversized = true;
 	state->show_loading_indicator = true;
-	state->thread_count = omp_get_num_procs() / 3;
-	state->thread_count = state->thread_count > 0 ? state->thread_count : 1;
-	state->vips_threads = omp_get_num_procs() / 2;
+	const int cpus = nqiv_get_available_cpus();
+	/* Every worker has its own queue, so the pool is kept to a third of the processors. The
+	 * governor parks the workers it finds no use for. */
+	const int default_active = cpus / 3 > 0 ? cpus / 3 : 1;
+	state->thread_count = default_active;
+	state->thread_min_count = 1;
+	state->governor_interval = 500;
+	state->io_thread_count = cpus / 6;
+	state->io_thread_count = state->io_thread_count > 0 ? state->io_thread_count : 1;
+	state->vips_threads = cpus / 2;
 	state->vips_threads = state->vips_threads > 0 ? state->vips_threads : 1;
-	state->thread_event_interval = 100 / state->thread_count;
+	state->thread_event_interval = 100 / default_active;
 	state->thread_event_interval =
 		state->thread_event_interval > 0 ? state->thread_event_interval : 1;
-	state->extra_wakeup_delay = state->thread_count * 20;
+	state->thread_aging_interval = 250;
+	state->thread_master_cpu = -1;
+	state->thread_background_count = 1;
+	state->window_focused = true;
+	state->extra_wakeup_delay = default_active * 20;
 	state->prune_delay = 5000 / state->extra_wakeup_delay;
 	state->event_timeout = 250000 / state->extra_wakeup_delay;
 	vips_concurrency_set(state->vips_threads);
@@ -387,10 +544,10 @@ nqiv_op_result nqiv_parse_args(char* argv[], nqiv_state* state)
 		return NQIV_FAIL;
 	}
 	nqiv_set_keyrate_defaults(&state->keystates);
-	if(!nqiv_priority_queue_init(&state->thread_queue, &state->logger, sizeof(nqiv_event),
-	                             STARTING_QUEUE_LENGTH, THREAD_QUEUE_BIN_COUNT)
-	   || !nqiv_priority_queue_set_max_data_length(&state->thread_queue, THREAD_QUEUE_MAX_LENGTH)
-	   || !nqiv_priority_queue_set_min_add_count(&state->thread_queue, THREAD_QUEUE_ADD_COUNT)) {
+	if(!nqiv_init_thread_queue(&state->logger, &state->thread_queue)
+	   || !nqiv_init_thread_queue(&state->logger, &state->io_thread_queue)
+	   || !nqiv_priority_queue_batch_init(&state->thread_batch, &state->logger,
+	                                      sizeof(nqiv_event))) {
 		fputs("Failed to initialize thread queue.\n", stderr);
 		return NQIV_FAIL;
 	}
@@ -524,17 +681,25 @@ nqiv_op_result nqiv_parse_args(char* argv[], nqiv_state* state)
 	return NQIV_SUCCESS;
 } /* parse_args */
 
-bool nqiv_send_thread_event_base(nqiv_state*       state,
-                                 const int         level,
-                                 const nqiv_event* event,
-                                 const bool        force)
+bool nqiv_send_thread_event_base(nqiv_state*          state,
+                                 nqiv_priority_queue* queue,
+                                 const int            level,
+                                 const nqiv_event*    event,
+                                 const bool           force)
 {
+	if(!force && state->batch_thread_events) {
+		if(!nqiv_priority_queue_batch_add(&state->thread_batch, queue, level, event)) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to batch event.\n");
+			return false;
+		}
+		return true;
+	}
 	bool event_sent;
 	if(force) {
-		nqiv_priority_queue_push_force(&state->thread_queue, level, event);
+		nqiv_priority_queue_push_force(queue, level, event);
 		event_sent = true;
 	} else {
-		event_sent = nqiv_priority_queue_push(&state->thread_queue, level, event);
+		event_sent = nqiv_priority_queue_push(queue, level, event);
 	}
 	if(!event_sent) {
 		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to send event.\n");
@@ -543,48 +708,137 @@ bool nqiv_send_thread_event_base(nqiv_state*       state,
 	return true;
 }
 
+/* Don't leave the image of a batched event that couldn't be sent waiting on it. */
+void nqiv_thread_event_unsent(const void* entry)
+{
+	const nqiv_event* event = entry;
+	if(event->type == NQIV_EVENT_IMAGE_LOAD && event->options.image_load.pending) {
+		nqiv_image_unsend_pending_load(event->options.image_load.image, event);
+	}
+}
+
 bool nqiv_send_thread_event(nqiv_state* state, const int level, nqiv_event* event)
 {
-	omp_set_lock(&state->thread_event_transaction_group_lock);
-	event->transaction_group = state->thread_event_transaction_group;
-	omp_unset_lock(&state->thread_event_transaction_group_lock);
-	return nqiv_send_thread_event_base(state, level, event, false);
+	event->level = level;
+	/* Refinements are only worth making while the image may still be shown. */
+	if(event->type == NQIV_EVENT_IMAGE_REFINE) {
+		event->lifetime = NQIV_EVENT_LIFETIME_INTEREST;
+		return nqiv_send_thread_event_base(state, &state->thread_queue, level, event, false);
+	}
+	if(event->type != NQIV_EVENT_IMAGE_LOAD) {
+		event->lifetime = NQIV_EVENT_LIFETIME_FOREVER;
+		return nqiv_send_thread_event_base(state, &state->thread_queue, level, event, false);
+	}
+	/* Loads are only worth doing while the montage is interested in the image. Thumbnail loads
+	 * ordered by distance from the selection are sent again once it moves. */
+	if(level >= NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD
+	   && level < NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD + THREAD_QUEUE_THUMBNAIL_DISTANCES) {
+		event->lifetime = NQIV_EVENT_LIFETIME_SELECTION;
+		event->generation = nqiv_image_manager_get_selection_generation(&state->images);
+	} else {
+		event->lifetime = NQIV_EVENT_LIFETIME_INTEREST;
+	}
+	/* Merge with whatever is already pending for the image. Only queue an event if there's none
+	 * yet, or the existing one needs to be handled sooner. */
+	nqiv_image* image = event->options.image_load.image;
+	event->options.image_load.pending = true;
+	if(!nqiv_image_add_pending_load(image, event, level)) {
+		return true;
+	}
+	/* Have its files read first if there are I/O workers. Otherwise, keep the image with the
+	 * worker that last loaded it, if any. */
+	nqiv_priority_queue* queue = state->io_worker_pool.count > 0
+	                                     && nqiv_worker_event_reads_files(event)
+	                                 ? &state->io_thread_queue
+	                                 : nqiv_worker_pool_get_queue(&state->worker_pool, image);
+	if(!nqiv_send_thread_event_base(state, queue, level, event, false)) {
+		/* Don't leave the image waiting on an event that will never arrive. */
+		nqiv_image_unsend_pending_load(image, event);
+		return false;
+	}
+	return true;
 }
 
 bool nqiv_send_thread_event_force(nqiv_state* state, const int level, nqiv_event* event)
 {
-	event->transaction_group = -1;
-	return nqiv_send_thread_event_base(state, level, event, true);
+	event->level = level;
+	event->lifetime = NQIV_EVENT_LIFETIME_FOREVER;
+	return nqiv_send_thread_event_base(state, &state->thread_queue, level, event, true);
 }
 
-bool render_texture(bool*           cleared,
-                    const SDL_Rect* cleardst,
-                    nqiv_state*     state,
-                    SDL_Texture*    texture,
-                    SDL_Rect*       srcrect,
-                    const SDL_Rect* dstrect)
+/* Cover dstrect, or all of the render target if NULL, with the background color. The software
+ * renderer is slow to stretch even the single pixel background texture, so it fills the area
+ * instead, blending only if the color is translucent. */
+bool render_background(nqiv_state* state, const SDL_Rect* dstrect)
 {
-	if(dstrect == NULL) {
-		return true;
+	if(!state->render_software) {
+		return SDL_RenderCopy(state->renderer, state->texture_background, NULL, dstrect) == 0;
+	}
+	const SDL_Color*    color = &state->background_color;
+	const SDL_BlendMode blend = color->a == 255 ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND;
+	bool                result = true;
+	if(SDL_SetRenderDrawBlendMode(state->renderer, blend) != 0
+	   || SDL_SetRenderDrawColor(state->renderer, color->r, color->g, color->b, color->a) != 0
+	   || SDL_RenderFillRect(state->renderer, dstrect) != 0) {
+		result = false;
+	}
+	/* The renderer is otherwise always cleared to black. */
+	if(SDL_SetRenderDrawColor(state->renderer, 0, 0, 0, 255) != 0) {
+		result = false;
 	}
+	return result;
+}
+
+/* Clear the display, if it hasn't been yet, and then cleardst, if any. */
+bool render_clear(bool* cleared, const SDL_Rect* cleardst, nqiv_state* state)
+{
 	if(!*cleared) {
-		if(SDL_RenderClear(state->renderer) != 0) {
+		/* An opaque background covers everything anyway. */
+		if((!state->render_software || state->background_color.a != 255)
+		   && SDL_RenderClear(state->renderer) != 0) {
 			nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to clear renderer.\n");
 			return false;
 		}
-		if(SDL_RenderCopy(state->renderer, state->texture_background, NULL, NULL) != 0) {
+		if(!render_background(state, NULL)) {
 			nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to copy texture background.\n");
 			return false;
 		}
 		*cleared = true;
 		state->render_cleared = true;
 	}
-	if(cleardst != NULL
-	   && SDL_RenderCopy(state->renderer, state->texture_background, NULL, cleardst) != 0) {
+	if(cleardst != NULL && !render_background(state, cleardst)) {
 		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
 		               "Failed to clear rendering space using texture background.\n");
 		return false;
 	}
+	return true;
+}
+
+bool render_texture(bool*           cleared,
+                    const SDL_Rect* cleardst,
+                    nqiv_state*     state,
+                    SDL_Texture*    texture,
+                    SDL_Rect*       srcrect,
+                    const SDL_Rect* dstrect)
+{
+	if(dstrect == NULL) {
+		return true;
+	}
+	if(!render_clear(cleared, cleardst, state)) {
+		return false;
+	}
+	/* While the montage is batched, the boxes drawn over thumbnails must wait until they've been
+	 * drawn. See render_montage. */
+	if(state->atlases.batching) {
+		if(texture == state->texture_montage_selection || texture == state->texture_montage_mark) {
+			return true;
+		}
+		nqiv_atlas* atlas = nqiv_atlas_manager_find(&state->atlases, texture);
+		if(atlas != NULL) {
+			assert(srcrect != NULL);
+			return nqiv_atlas_queue(atlas, srcrect, dstrect);
+		}
+	}
 	if(SDL_SetTextureScaleMode(texture, state->texture_scale_mode) != 0) {
 		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to set texture scale mode.\n");
 		return false;
@@ -596,6 +850,91 @@ bool render_texture(bool*           cleared,
 	return true;
 }
 
+/* Like render_texture, but turned by orientation. dstrect is the area the turned texture covers. */
+bool render_texture_oriented(bool*                         cleared,
+                             const SDL_Rect*               cleardst,
+                             nqiv_state*                   state,
+                             SDL_Texture*                  texture,
+                             SDL_Rect*                     srcrect,
+                             const SDL_Rect*               dstrect,
+                             const nqiv_image_orientation* orientation)
+{
+	if(orientation->turns == 0 && !orientation->flip) {
+		return render_texture(cleared, cleardst, state, texture, srcrect, dstrect);
+	}
+	if(dstrect == NULL) {
+		return true;
+	}
+	if(!render_clear(cleared, cleardst, state)) {
+		return false;
+	}
+	/* SDL turns the texture about the center of the rect it's given, so a texture turned on its side
+	 * is given a rect turned the other way. */
+	SDL_Rect unturned;
+	memcpy(&unturned, dstrect, sizeof(SDL_Rect));
+	if(nqiv_image_orientation_swaps_axes(orientation)) {
+		unturned.w = dstrect->h;
+		unturned.h = dstrect->w;
+		unturned.x = dstrect->x + (dstrect->w - dstrect->h) / 2;
+		unturned.y = dstrect->y + (dstrect->h - dstrect->w) / 2;
+	}
+	if(SDL_SetTextureScaleMode(texture, state->texture_scale_mode) != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to set texture scale mode.\n");
+		return false;
+	}
+	if(SDL_RenderCopyEx(state->renderer, texture, srcrect, &unturned, 90.0 * orientation->turns,
+	                    NULL, orientation->flip ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE)
+	   != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to copy turned texture.\n");
+		return false;
+	}
+	return true;
+}
+
+/* Cover dstrect with checks, by drawing the alpha background tile as many times as it takes. The
+ * tile is scaled so checks are the same size as they'd be drawn whole, and clipped at the edges. */
+bool render_alpha_background(bool*           cleared,
+                             const SDL_Rect* cleardst,
+                             nqiv_state*     state,
+                             const SDL_Rect* dstrect)
+{
+	if(dstrect == NULL || dstrect->w <= 0 || dstrect->h <= 0) {
+		return true;
+	}
+	if(!render_clear(cleared, cleardst, state)) {
+		return false;
+	}
+	int check_size = (dstrect->h / 2) / ALPHA_BACKGROUND_CHECKER_PROPORTION;
+	check_size = check_size > 0 ? check_size : 1;
+	const int tile_size = check_size * ALPHA_BACKGROUND_TILE_CHECKERS;
+	if(SDL_RenderSetClipRect(state->renderer, dstrect) != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+		               "Failed to clip alpha background. SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+	bool result = true;
+	int  y;
+	int  x;
+	for(y = dstrect->y; result && y < dstrect->y + dstrect->h; y += tile_size) {
+		for(x = dstrect->x; result && x < dstrect->x + dstrect->w; x += tile_size) {
+			const SDL_Rect tile = {x, y, tile_size, tile_size};
+			if(SDL_RenderCopy(state->renderer, state->texture_alpha_background, NULL, &tile)
+			   != 0) {
+				nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+				               "Failed to draw alpha background. SDL Error: %s\n",
+				               SDL_GetError());
+				result = false;
+			}
+		}
+	}
+	if(SDL_RenderSetClipRect(state->renderer, NULL) != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+		               "Failed to unclip alpha background. SDL Error: %s\n", SDL_GetError());
+		result = false;
+	}
+	return result;
+}
+
 void nqiv_apply_zoom_default(nqiv_state* state, const bool first_frame)
 {
 	if(first_frame || state->first_frame_pending) {
@@ -627,6 +966,242 @@ void nqiv_apply_zoom_modifications(nqiv_state* state, const bool first_frame)
 	}
 }
 
+/* A form's texture shared from an atlas is drawn from its slot. Returns the srcrect to draw the
+ * texture with. */
+SDL_Rect* nqiv_get_form_srcrect(const nqiv_image_form* form,
+                                const SDL_Texture*     texture,
+                                SDL_Rect*              srcrect,
+                                SDL_Rect*              atlas_srcrect)
+{
+	const nqiv_atlas_slot* slot = &form->atlas_slot;
+	if(slot->atlas == NULL || texture != slot->atlas->texture) {
+		return srcrect;
+	}
+	memcpy(atlas_srcrect, &slot->rect, sizeof(SDL_Rect));
+	if(srcrect != NULL) {
+		atlas_srcrect->x += srcrect->x;
+		atlas_srcrect->y += srcrect->y;
+		atlas_srcrect->w = srcrect->w;
+		atlas_srcrect->h = srcrect->h;
+	}
+	return atlas_srcrect;
+}
+
+/* Animation frames are streamed into one texture of the frame size, kept as the fallback texture
+ * from one frame to the next, rather than a texture being made and destroyed for each. Returns the
+ * texture with the surface of the form uploaded to it, or NULL if it failed. */
+SDL_Texture* nqiv_stream_form_frame(nqiv_state* state, nqiv_image_form* form)
+{
+	SDL_Surface* surface = form->surface;
+	SDL_Texture* texture = form->fallback_texture;
+	if(texture != NULL) {
+		Uint32 format;
+		int    access;
+		int    width;
+		int    height;
+		if(SDL_QueryTexture(texture, &format, &access, &width, &height) != 0
+		   || format != surface->format->format || access != SDL_TEXTUREACCESS_STREAMING
+		   || width != surface->w || height != surface->h) {
+			texture = NULL;
+		}
+	}
+	if(texture == NULL) {
+		texture = SDL_CreateTexture(state->renderer, surface->format->format,
+		                            SDL_TEXTUREACCESS_STREAMING, surface->w, surface->h);
+		if(texture == NULL) {
+			return NULL;
+		}
+		if(SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND) != 0) {
+			SDL_DestroyTexture(texture);
+			return NULL;
+		}
+	}
+	/* Frames from VIPS are whole, with no record of what changed from the last, so all of it is
+	 * uploaded. */
+	if(SDL_UpdateTexture(texture, NULL, surface->pixels, surface->pitch) != 0) {
+		if(texture != form->fallback_texture) {
+			SDL_DestroyTexture(texture);
+		}
+		return NULL;
+	}
+	return texture;
+}
+
+/* Would wanted be within a pixel of size, in a refinement of srcrect resampled to width and height?
+ */
+bool nqiv_refinement_has_scale(const SDL_Rect* srcrect,
+                               const int       width,
+                               const int       height,
+                               const SDL_Rect* wanted,
+                               const SDL_Rect* size)
+{
+	if(width <= 0 || height <= 0) {
+		return false;
+	}
+	const int scaled_width = (int)((double)wanted->w * (double)width / (double)srcrect->w + 0.5);
+	const int scaled_height = (int)((double)wanted->h * (double)height / (double)srcrect->h + 0.5);
+	return abs(scaled_width - size->w) <= 1 && abs(scaled_height - size->h) <= 1;
+}
+
+/* The area of a refinement of srcrect, resampled to width and height, showing wanted. Made exactly
+ * size, if it has the scale for that, so it's copied without scaling. Returns false if the
+ * refinement doesn't cover wanted. */
+bool nqiv_get_refinement_srcrect(const SDL_Rect* srcrect,
+                                 const int       width,
+                                 const int       height,
+                                 const SDL_Rect* wanted,
+                                 const SDL_Rect* size,
+                                 SDL_Rect*       area)
+{
+	if(width <= 0 || height <= 0 || wanted->x < srcrect->x || wanted->y < srcrect->y
+	   || wanted->x + wanted->w > srcrect->x + srcrect->w
+	   || wanted->y + wanted->h > srcrect->y + srcrect->h) {
+		return false;
+	}
+	const double x_ratio = (double)width / (double)srcrect->w;
+	const double y_ratio = (double)height / (double)srcrect->h;
+	area->x = (int)((double)(wanted->x - srcrect->x) * x_ratio + 0.5);
+	area->y = (int)((double)(wanted->y - srcrect->y) * y_ratio + 0.5);
+	area->w = (int)((double)wanted->w * x_ratio + 0.5);
+	area->h = (int)((double)wanted->h * y_ratio + 0.5);
+	if(nqiv_refinement_has_scale(srcrect, width, height, wanted, size)) {
+		area->w = size->w;
+		area->h = size->h;
+	}
+	area->x = area->x + area->w > width ? width - area->w : area->x;
+	area->y = area->y + area->h > height ? height - area->h : area->y;
+	return area->x >= 0 && area->y >= 0;
+}
+
+/* Once the view of a shrunken image has stayed the same for refine_delay, ask a worker to resample
+ * the area in view, with a margin for panning, from the VIPS image to the size it's drawn at. With
+ * the software renderer, enlarged images are resampled too, unless they're scaled by nearest pixel,
+ * which SDL does quickly enough. Once panning leaves the margin, the next is asked for right away.
+ * srcrect is the area of the texture in view, or NULL for all of it. The image must be locked.
+ * Returns the refined texture, to be drawn from refined_srcrect to dstrect in place of the form's,
+ * or NULL if there's none yet. */
+SDL_Texture* nqiv_refine_image_form(nqiv_state*      state,
+                                    nqiv_image*      image,
+                                    nqiv_image_form* form,
+                                    const SDL_Rect*  srcrect,
+                                    const SDL_Rect*  dstrect,
+                                    SDL_Rect*        refined_srcrect)
+{
+	nqiv_image_refinement* refinement = &form->refinement;
+	/* The area in view, in the coordinates of the whole image. The texture may be of a cropped or
+	 * shrunken part of it. */
+	SDL_Rect wanted = {0};
+	/* Detail of the texture, in its pixels to the image's. */
+	double   texture_scale = 0.0;
+	if(state->refine_delay > 0 && !form->animation.exists && form->effective_width > 0
+	   && form->effective_height > 0 && form->srcrect.w > 0 && form->srcrect.h > 0) {
+		const double    x_ratio = (double)form->srcrect.w / (double)form->effective_width;
+		const double    y_ratio = (double)form->srcrect.h / (double)form->effective_height;
+		const SDL_Rect  whole = {0, 0, form->effective_width, form->effective_height};
+		const SDL_Rect* area = srcrect != NULL ? srcrect : &whole;
+		wanted.x = form->srcrect.x + (int)((double)area->x * x_ratio);
+		wanted.y = form->srcrect.y + (int)((double)area->y * y_ratio);
+		wanted.w = (int)((double)area->w * x_ratio);
+		wanted.h = (int)((double)area->h * y_ratio);
+		wanted.w = wanted.x + wanted.w > form->width ? form->width - wanted.x : wanted.w;
+		wanted.h = wanted.y + wanted.h > form->height ? form->height - wanted.y : wanted.h;
+		texture_scale = 1.0 / x_ratio;
+	}
+	/* Otherwise, scaling up is left to SDL, since there's nothing to gain from resampling. */
+	const bool enlarge =
+		state->render_software && state->texture_scale_mode != SDL_ScaleModeNearest;
+	if(wanted.w <= 0 || wanted.h <= 0 || (wanted.w == dstrect->w && wanted.h == dstrect->h)
+	   || (!enlarge && wanted.w <= dstrect->w && wanted.h <= dstrect->h)) {
+		if(refinement->width != 0 || refinement->previous_texture != NULL) {
+			nqiv_unload_image_form_refinement(form);
+		}
+		state->refine_time = 0;
+		return NULL;
+	}
+	/* Has the view only panned since the refinement was asked for? */
+	const bool panned = nqiv_refinement_has_scale(&refinement->srcrect, refinement->width,
+	                                              refinement->height, &wanted, dstrect);
+	SDL_Rect   area;
+	if(!panned
+	   || !nqiv_get_refinement_srcrect(&refinement->srcrect, refinement->width, refinement->height,
+	                                   &wanted, dstrect, &area)) {
+		/* The last refinement is kept to draw until this one is made. */
+		if(refinement->texture != NULL) {
+			if(refinement->previous_texture != NULL) {
+				SDL_DestroyTexture(refinement->previous_texture);
+			}
+			refinement->previous_texture = refinement->texture;
+			memcpy(&refinement->previous_srcrect, &refinement->srcrect, sizeof(SDL_Rect));
+			refinement->previous_width = refinement->width;
+			refinement->previous_height = refinement->height;
+			refinement->texture = NULL;
+		}
+		nqiv_unload_image_form_refinement_surface(form);
+		SDL_Rect margin = {wanted.x - wanted.w / REFINE_MARGIN_PROPORTION,
+		                   wanted.y - wanted.h / REFINE_MARGIN_PROPORTION, 0, 0};
+		margin.x = margin.x < 0 ? 0 : margin.x;
+		margin.y = margin.y < 0 ? 0 : margin.y;
+		margin.w = wanted.x + wanted.w + wanted.w / REFINE_MARGIN_PROPORTION - margin.x;
+		margin.h = wanted.y + wanted.h + wanted.h / REFINE_MARGIN_PROPORTION - margin.y;
+		margin.w = margin.x + margin.w > form->width ? form->width - margin.x : margin.w;
+		margin.h = margin.y + margin.h > form->height ? form->height - margin.y : margin.h;
+		memcpy(&refinement->srcrect, &margin, sizeof(SDL_Rect));
+		refinement->width =
+			(int)((double)margin.w * (double)dstrect->w / (double)wanted.w + 0.5);
+		refinement->height =
+			(int)((double)margin.h * (double)dstrect->h / (double)wanted.h + 0.5);
+		SDL_AtomicSet(&refinement->sent, 0);
+		/* If only panned, it's asked for right away. */
+		state->refine_time =
+			SDL_GetTicks64() + (panned ? (Uint64)0 : (Uint64)state->refine_delay);
+	}
+	if(refinement->texture == NULL && refinement->surface != NULL) {
+		refinement->texture = SDL_CreateTextureFromSurface(state->renderer, refinement->surface);
+		nqiv_unload_image_form_refinement_surface(form);
+		if(refinement->texture == NULL) {
+			nqiv_log_write(&state->logger, NQIV_LOG_WARNING,
+			               "Failed to load refined texture for image %s (%s).\n",
+			               image->image.path, SDL_GetError());
+		} else if(refinement->previous_texture != NULL) {
+			SDL_DestroyTexture(refinement->previous_texture);
+			refinement->previous_texture = NULL;
+		}
+	}
+	if(SDL_AtomicGet(&refinement->sent) == 0 && refinement->texture == NULL
+	   && SDL_GetTicks64() >= state->refine_time) {
+		nqiv_event event = {0};
+		event.type = NQIV_EVENT_IMAGE_REFINE;
+		event.options.image_refine.image = image;
+		memcpy(&event.options.image_refine.srcrect, &refinement->srcrect, sizeof(SDL_Rect));
+		event.options.image_refine.width = refinement->width;
+		event.options.image_refine.height = refinement->height;
+		if(!nqiv_send_thread_event(state, NQIV_EVENT_PRIORITY_IMAGE_LOAD, &event)) {
+			nqiv_log_write(&state->logger, NQIV_LOG_WARNING,
+			               "Failed to ask for refinement of image %s.\n", image->image.path);
+		}
+		SDL_AtomicSet(&refinement->sent, 1);
+		state->refine_time = 0;
+	}
+	if(refinement->texture != NULL
+	   && nqiv_get_refinement_srcrect(&refinement->srcrect, refinement->width, refinement->height,
+	                                  &wanted, dstrect, refined_srcrect)) {
+		return refinement->texture;
+	}
+	/* While zooming, the last refinement is scaled instead of the texture, unless it's both
+	 * coarser than the texture and blown up by more than double. */
+	if(refinement->previous_texture != NULL
+	   && nqiv_get_refinement_srcrect(&refinement->previous_srcrect, refinement->previous_width,
+	                                  refinement->previous_height, &wanted, dstrect,
+	                                  refined_srcrect)) {
+		const double previous_scale =
+			(double)refinement->previous_width / (double)refinement->previous_srcrect.w;
+		if(previous_scale >= texture_scale || refined_srcrect->w * 2 >= dstrect->w) {
+			return refinement->previous_texture;
+		}
+	}
+	return NULL;
+}
+
 /* TODO STEP FRAME? */
 /* TODO Reset frame */
 bool render_from_form(nqiv_state*     state,
@@ -640,20 +1215,32 @@ bool render_from_form(nqiv_state*     state,
                       const bool      selected,
                       /* Force reload */
                       const bool      hard,
-                      /* Preload events will have lower priority (higher number), so actual priority
-                         is added to this. */
-                      const int       base_priority)
+                      /* From the selection. Further thumbnails load later. See
+                         nqiv_montage_get_distance. */
+                      const int       distance)
 {
+	const int distance_level =
+		distance < THREAD_QUEUE_THUMBNAIL_DISTANCES ? distance : THREAD_QUEUE_THUMBNAIL_DISTANCES - 1;
+	const int thumbnail_load_level = NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD + distance_level;
 	bool             cleared = is_montage;
 	nqiv_image_form* form = is_montage ? &image->thumbnail : &image->image;
 	/* We try to lock the image. Don't wait on it and block the whole program, if not. Just use
-	 * its fallback texture and return early. */
-	if(!nqiv_image_test_lock(image)) {
+	 * its fallback texture and return early. The same goes for a form a worker is still decoding,
+	 * since it will be published once done. */
+	state->drawn_texture = NULL;
+	state->drawn_slot = 0;
+	bool locked = nqiv_image_test_lock(image);
+	if(locked && form->decoding) {
+		nqiv_image_unlock(image);
+		locked = false;
+	}
+	if(!locked) {
 		/* If this is a preload, there won't be a location to write to, so don't bother. Nowhere to
 		 * render. */
 		if(dstrect != NULL) {
 			/* Track our own dimensions for the fallback texture. */
 			SDL_Rect        tmp_srcrect;
+			SDL_Rect        tmp_atlas_srcrect;
 			SDL_Rect        tmp_dstrect;
 			const SDL_Rect* tmp_dstrect_ptr = dstrect;
 			if(form->master_srcrect.w > 0 && form->master_srcrect.h > 0
@@ -672,24 +1259,27 @@ bool render_from_form(nqiv_state*     state,
 				nqiv_apply_zoom_modifications(state, first_frame);
 				nqiv_image_manager_retrieve_zoomrect(
 					&state->images, !is_montage, state->stretch_images, &tmp_srcrect, &tmp_dstrect);
-				if(!nqiv_state_update_alpha_background_dimensions(state, tmp_dstrect.w,
-				                                                  tmp_dstrect.h)) {
+				nqiv_image_orientation_unmap_rect(&form->master_orientation, form->master_srcrect.w,
+				                                  form->master_srcrect.h, &tmp_srcrect);
+				if(!render_alpha_background(&cleared, NULL, state, &tmp_dstrect)) {
 					return false;
 				}
-				if(!render_texture(&cleared, NULL, state, state->texture_alpha_background, NULL,
-				                   &tmp_dstrect)) {
+				if(!render_texture_oriented(&cleared, NULL, state, form->fallback_texture,
+				                            nqiv_get_form_srcrect(form, form->fallback_texture,
+				                                                  &tmp_srcrect, &tmp_atlas_srcrect),
+				                            &tmp_dstrect, &form->master_orientation)) {
 					return false;
 				}
-				if(!render_texture(&cleared, NULL, state, form->fallback_texture, &tmp_srcrect,
-				                   &tmp_dstrect)) {
+				state->drawn_texture = form->fallback_texture;
+				state->drawn_slot = form->atlas_slot.id;
+				/* Don't clear display if we're just drawing the loading indicator. */
+			} else if(state->show_loading_indicator) {
+				if(!render_texture(&clearedtmp, dstrect, state,
+				                   state->texture_montage_unloaded_background, NULL,
+				                   tmp_dstrect_ptr)) {
 					return false;
 				}
-				/* Don't clear display if we're just drawing the loading indicator. */
-			} else if(state->show_loading_indicator
-			          && !render_texture(&clearedtmp, dstrect, state,
-			                             state->texture_montage_unloaded_background, NULL,
-			                             tmp_dstrect_ptr)) {
-				return false;
+				state->drawn_texture = state->texture_montage_unloaded_background;
 			}
 			if(selected && is_montage) {
 				if(!render_texture(&cleared, NULL, state, state->texture_montage_selection, NULL,
@@ -709,9 +1299,17 @@ bool render_from_form(nqiv_state*     state,
 	/* We must have locked the image by this point. */
 	SDL_Rect  srcrect = {0};
 	SDL_Rect* srcrect_ptr = &srcrect;
+	SDL_Rect  atlas_srcrect = {0};
 	SDL_Rect  dstrect_zoom = {0};
 	SDL_Rect* dstrect_zoom_ptr = NULL;
 	bool      resample_zoom = false; /* Do we have to reload a massive image? */
+	/* Zooming and panning are of the image as it's shown. Thumbnails are never turned. */
+	nqiv_image_orientation orientation = {0};
+	if(!is_montage) {
+		orientation = nqiv_image_orientation_combine(&form->orientation, &image->rotation);
+	}
+	const bool swap_axes = nqiv_image_orientation_swaps_axes(&orientation);
+	memcpy(&form->master_orientation, &orientation, sizeof(nqiv_image_orientation));
 	/* Sane dimensions- sometimes the image or display may not be ready. */
 	if(form->width > 0 && form->height > 0 && image->image.width > 0 && image->image.height > 0
 	   && dstrect != NULL) {
@@ -731,8 +1329,8 @@ bool render_from_form(nqiv_state*     state,
 				srcrect.h = (int)((double)srcrect.h * multiplier);
 			}
 		} else {
-			srcrect.w = form->width;
-			srcrect.h = form->height;
+			srcrect.w = swap_axes ? form->height : form->width;
+			srcrect.h = swap_axes ? form->width : form->height;
 		}
 		dstrect_zoom.w = dstrect->w;
 		dstrect_zoom.h = dstrect->h;
@@ -747,6 +1345,8 @@ bool render_from_form(nqiv_state*     state,
 		nqiv_apply_zoom_modifications(state, first_frame);
 		nqiv_image_manager_retrieve_zoomrect(&state->images, !is_montage, state->stretch_images,
 		                                     &srcrect, dstrect_zoom_ptr);
+		nqiv_image_orientation_unmap_rect(&orientation, form->master_srcrect.w,
+		                                  form->master_srcrect.h, &srcrect);
 		if(!state->no_resample_oversized
 		   && (form->height > state->images.max_texture_height
 		       || form->width > state->images.max_texture_width)) {
@@ -780,8 +1380,8 @@ bool render_from_form(nqiv_state*     state,
 			} else {
 				srcrect.x = 0;
 				srcrect.y = 0;
-				srcrect.w = form->effective_width;
-				srcrect.h = form->effective_height;
+				srcrect.w = swap_axes ? form->effective_height : form->effective_width;
+				srcrect.h = swap_axes ? form->effective_width : form->effective_height;
 				dstrect_zoom.w = dstrect->w;
 				dstrect_zoom.h = dstrect->h;
 				dstrect_zoom.x = dstrect->x;
@@ -794,6 +1394,8 @@ bool render_from_form(nqiv_state*     state,
 				nqiv_apply_zoom_modifications(state, first_frame);
 				nqiv_image_manager_retrieve_zoomrect(
 					&state->images, !is_montage, state->stretch_images, &srcrect, dstrect_zoom_ptr);
+				nqiv_image_orientation_unmap_rect(&orientation, form->master_srcrect.w,
+				                                  form->master_srcrect.h, &srcrect);
 			}
 		}
 	}
@@ -808,7 +1410,7 @@ bool render_from_form(nqiv_state*     state,
 			event.options.image_load.thumbnail_options.clear_error = true;
 			event.options.image_load.create_thumbnail = true;
 			if(!nqiv_send_thread_event(
-				   state, base_priority + NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_NO, &event)) {
+				   state, NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_NO, &event)) {
 				nqiv_image_unlock(image);
 				return false;
 			}
@@ -825,6 +1427,7 @@ bool render_from_form(nqiv_state*     state,
 					nqiv_image_unlock(image);
 					return false;
 				}
+				state->drawn_texture = state->texture_montage_unloaded_background;
 			}
 			if(!image->thumbnail_attempted && state->images.thumbnail.save) {
 				nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
@@ -837,8 +1440,7 @@ bool render_from_form(nqiv_state*     state,
 					state->images.thumbnail.save;
 				event.options.image_load.create_thumbnail = true;
 				if(!nqiv_send_thread_event(
-					   state, base_priority + NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_FAIL,
-					   &event)) {
+					   state, NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_FAIL, &event)) {
 					nqiv_image_unlock(image);
 					return false;
 				}
@@ -855,9 +1457,7 @@ bool render_from_form(nqiv_state*     state,
 				} else {
 					event.options.image_load.thumbnail_options.vips_soft = true;
 				}
-				if(!nqiv_send_thread_event(
-					   state, base_priority + NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD_EPHEMERAL,
-					   &event)) {
+				if(!nqiv_send_thread_event(state, thumbnail_load_level, &event)) {
 					nqiv_image_unlock(image);
 					return false;
 				}
@@ -872,6 +1472,7 @@ bool render_from_form(nqiv_state*     state,
 				nqiv_image_unlock(image);
 				return false;
 			}
+			state->drawn_texture = state->texture_montage_error_background;
 		}
 		/* No error */
 	} else {
@@ -888,8 +1489,25 @@ bool render_from_form(nqiv_state*     state,
 		          && (is_montage || !first_frame || !form->animation.exists)) {
 			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Loading texture for image %s\n",
 			               image->image.path);
-			form->texture = SDL_CreateTextureFromSurface(state->renderer, form->surface);
-			nqiv_unload_image_form_fallback_texture(form);
+			/* Thumbnails go in an atlas if they can, taking the place of the fallback's slot. */
+			if(is_montage) {
+				assert(form->texture == NULL);
+				nqiv_unload_image_form_fallback_texture(form);
+				if(nqiv_atlas_manager_add(&state->atlases, form->surface,
+				                          state->images.thumbnail.size, &form->atlas_slot)) {
+					form->texture = form->atlas_slot.atlas->texture;
+				} else {
+					form->texture = SDL_CreateTextureFromSurface(state->renderer, form->surface);
+				}
+			} else if(form->animation.exists) {
+				form->texture = nqiv_stream_form_frame(state, form);
+				if(form->texture != form->fallback_texture) {
+					nqiv_unload_image_form_fallback_texture(form);
+				}
+			} else {
+				form->texture = SDL_CreateTextureFromSurface(state->renderer, form->surface);
+				nqiv_unload_image_form_fallback_texture(form);
+			}
 			form->fallback_texture = form->texture;
 			if(form->texture == NULL) {
 				nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
@@ -902,12 +1520,14 @@ bool render_from_form(nqiv_state*     state,
 		} else {
 			if(first_frame || hard) {
 				state->is_loading = true;
-				if(state->show_loading_indicator
-				   && !render_texture(&cleared, dstrect, state,
-				                      state->texture_montage_unloaded_background, NULL,
-				                      dstrect_zoom_ptr == NULL ? dstrect : dstrect_zoom_ptr)) {
-					nqiv_image_unlock(image);
-					return false;
+				if(state->show_loading_indicator) {
+					if(!render_texture(&cleared, dstrect, state,
+					                   state->texture_montage_unloaded_background, NULL,
+					                   dstrect_zoom_ptr == NULL ? dstrect : dstrect_zoom_ptr)) {
+						nqiv_image_unlock(image);
+						return false;
+					}
+					state->drawn_texture = state->texture_montage_unloaded_background;
 				}
 			}
 			if(is_montage) {
@@ -939,8 +1559,7 @@ bool render_from_form(nqiv_state*     state,
 				event.options.image_load.thumbnail_options.first_frame = first_frame;
 				event.options.image_load.thumbnail_options.next_frame =
 					next_frame && !first_frame && form->animation.frame_rendered;
-				if(!nqiv_send_thread_event(
-					   state, base_priority + NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD, &event)) {
+				if(!nqiv_send_thread_event(state, thumbnail_load_level, &event)) {
 					nqiv_image_unlock(image);
 					return false;
 				}
@@ -967,8 +1586,7 @@ bool render_from_form(nqiv_state*     state,
 				event.options.image_load.image_options.first_frame = first_frame;
 				event.options.image_load.image_options.next_frame =
 					next_frame && !first_frame && form->animation.frame_rendered;
-				if(!nqiv_send_thread_event(state, base_priority + NQIV_EVENT_PRIORITY_IMAGE_LOAD,
-				                           &event)) {
+				if(!nqiv_send_thread_event(state, NQIV_EVENT_PRIORITY_IMAGE_LOAD, &event)) {
 					nqiv_image_unlock(image);
 					return false;
 				}
@@ -976,25 +1594,38 @@ bool render_from_form(nqiv_state*     state,
 		}
 		/* Draw thumbnail if it exists. */
 		if(form->texture != NULL) {
-			if(dstrect_zoom_ptr != NULL
-			   && !nqiv_state_update_alpha_background_dimensions(state, dstrect_zoom_ptr->w,
-			                                                     dstrect_zoom_ptr->h)) {
-				nqiv_image_unlock(image);
-				return false;
-			}
-			if(!render_texture(&cleared, dstrect, state, state->texture_alpha_background, NULL,
-			                   dstrect_zoom_ptr)) {
+			SDL_Texture* texture = form->texture;
+			SDL_Rect*    texture_srcrect =
+				nqiv_get_form_srcrect(form, form->texture, srcrect_ptr, &atlas_srcrect);
+			SDL_Texture* refined = NULL;
+			SDL_Rect     refined_srcrect;
+			if(!is_montage && dstrect_zoom_ptr != NULL) {
+				/* The refinement is of the unturned texture. */
+				SDL_Rect refined_dstrect;
+				memcpy(&refined_dstrect, dstrect_zoom_ptr, sizeof(SDL_Rect));
+				refined_dstrect.w = swap_axes ? dstrect_zoom_ptr->h : dstrect_zoom_ptr->w;
+				refined_dstrect.h = swap_axes ? dstrect_zoom_ptr->w : dstrect_zoom_ptr->h;
+				refined = nqiv_refine_image_form(state, image, form, srcrect_ptr, &refined_dstrect,
+				                                 &refined_srcrect);
+			}
+			if(refined != NULL) {
+				texture = refined;
+				texture_srcrect = &refined_srcrect;
+			}
+			if(!render_alpha_background(&cleared, dstrect, state, dstrect_zoom_ptr)) {
 				nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
 				               "Failed to draw image alpha background.\n");
 				nqiv_image_unlock(image);
 				return false;
 			}
-			if(!render_texture(&cleared, NULL, state, form->texture, srcrect_ptr,
-			                   dstrect_zoom_ptr)) {
+			if(!render_texture_oriented(&cleared, NULL, state, texture, texture_srcrect,
+			                            dstrect_zoom_ptr, &orientation)) {
 				nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to draw image texture.\n");
 				nqiv_image_unlock(image);
 				return false;
 			}
+			state->drawn_texture = form->texture;
+			state->drawn_slot = form->atlas_slot.id;
 			if(dstrect != NULL) {
 				state->is_loading = false;
 			}
@@ -1015,8 +1646,8 @@ bool render_from_form(nqiv_state*     state,
 				event.options.image_load.image_options.first_frame = first_frame;
 				event.options.image_load.image_options.next_frame =
 					next_frame && !first_frame && form->animation.frame_rendered;
-				if(!nqiv_send_thread_event(
-					   state, base_priority + NQIV_EVENT_PRIORITY_IMAGE_LOAD_ANIMATION, &event)) {
+				if(!nqiv_send_thread_event(state, NQIV_EVENT_PRIORITY_IMAGE_LOAD_ANIMATION,
+				                           &event)) {
 					nqiv_image_unlock(image);
 					return false;
 				}
@@ -1103,50 +1734,217 @@ bool set_title(nqiv_state* state, nqiv_image* image)
 }
 #undef INT_MAX_STRLEN
 
-bool render_montage(nqiv_state* state, const bool hard, const bool preload_only)
+void nqiv_get_montage_look(nqiv_state* state, nqiv_montage_look* look)
 {
-	nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Rendering montage.\n");
-	if(!preload_only && SDL_RenderClear(state->renderer) != 0) {
-		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to clear renderer for montage.\n");
-		return false;
+	/* Compared whole, so padding must be zeroed. */
+	memset(look, 0, sizeof(nqiv_montage_look));
+	SDL_GetWindowSizeInPixels(state->window, &look->width, &look->height);
+	look->thumbnail_size = state->images.thumbnail.size;
+	look->texture_scale_mode = state->texture_scale_mode;
+	look->show_loading_indicator = state->show_loading_indicator;
+	look->stretch_images = state->stretch_images;
+	look->background_color = state->background_color;
+	look->error_color = state->error_color;
+	look->loading_color = state->loading_color;
+	look->selection_color = state->selection_color;
+	look->mark_color = state->mark_color;
+	look->alpha_checker_color_one = state->alpha_checker_color_one;
+	look->alpha_checker_color_two = state->alpha_checker_color_two;
+}
+
+/* Make texture_montage the render target, recreating it or its cells if they no longer fit. Sets
+ * redraw if the whole montage must be drawn again, in which case it's cleared. */
+bool nqiv_prepare_montage_texture(nqiv_state* state, const bool hard, bool* redraw)
+{
+	nqiv_montage_look look;
+	nqiv_get_montage_look(state, &look);
+	*redraw = hard || !state->montage_shown
+	          || memcmp(&look, &state->montage_look, sizeof(nqiv_montage_look)) != 0;
+	if(state->texture_montage == NULL || look.width != state->montage_look.width
+	   || look.height != state->montage_look.height) {
+		if(state->texture_montage != NULL) {
+			SDL_DestroyTexture(state->texture_montage);
+		}
+		state->texture_montage = SDL_CreateTexture(state->renderer, SDL_PIXELFORMAT_ARGB8888,
+		                                           SDL_TEXTUREACCESS_TARGET, look.width,
+		                                           look.height);
+		if(state->texture_montage == NULL) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+			               "Failed to create montage texture. SDL Error: %s\n", SDL_GetError());
+			return false;
+		}
+		*redraw = true;
+	}
+	if(state->montage_cell_count != state->montage.dimensions.count) {
+		nqiv_montage_cell* cells =
+			calloc(state->montage.dimensions.count, sizeof(nqiv_montage_cell));
+		if(cells == NULL) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+			               "Failed to allocate %d montage cells.\n",
+			               state->montage.dimensions.count);
+			return false;
+		}
+		if(state->montage_cells != NULL) {
+			free(state->montage_cells);
+		}
+		state->montage_cells = cells;
+		state->montage_cell_count = state->montage.dimensions.count;
+		*redraw = true;
 	}
-	if(!preload_only
-	   && SDL_RenderCopy(state->renderer, state->texture_background, NULL, NULL) != 0) {
+	if(SDL_SetRenderTarget(state->renderer, state->texture_montage) != 0) {
 		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
-		               "Failed to copy texture background for montage.\n");
+		               "Failed to draw to montage texture. SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+	if(*redraw) {
+		if(SDL_RenderClear(state->renderer) != 0 || !render_background(state, NULL)) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+			               "Failed to clear montage texture. SDL Error: %s\n", SDL_GetError());
+			return false;
+		}
+		memset(state->montage_cells, 0, state->montage_cell_count * sizeof(nqiv_montage_cell));
+		memcpy(&state->montage_look, &look, sizeof(nqiv_montage_look));
+	}
+	return true;
+}
+
+/* A cell showing the thumbnail texture of the same image, just as before, needs nothing done. So,
+ * it's not even locked. Textures are only changed by the master. */
+bool nqiv_montage_cell_is_current(const nqiv_montage_cell* cell,
+                                  nqiv_image*              image,
+                                  const SDL_Rect*          dstrect,
+                                  const bool               selected)
+{
+	return cell->image == image && cell->texture != NULL
+	       && cell->texture == image->thumbnail.texture
+	       && cell->slot == image->thumbnail.atlas_slot.id && cell->selected == selected
+	       && cell->marked == image->marked && cell->dstrect.x == dstrect->x
+	       && cell->dstrect.y == dstrect->y && cell->dstrect.w == dstrect->w
+	       && cell->dstrect.h == dstrect->h;
+}
+
+/* Clear a cell of the montage texture to draw it again. */
+bool nqiv_clear_montage_cell(nqiv_state* state, const SDL_Rect* dstrect)
+{
+	if(!render_background(state, dstrect)) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to clear montage cell.\n");
 		return false;
 	}
-	state->render_cleared = !preload_only;
-	const int    images_len = nqiv_array_get_units_count(state->images.images);
-	const int    raw_start_idx = state->montage.positions.start - state->montage.preload.behind;
-	const int    raw_end = state->montage.positions.end + state->montage.preload.ahead;
-	const int    start_idx = raw_start_idx >= 0 ? raw_start_idx : 0;
-	const int    end = raw_end <= images_len ? raw_end : images_len;
+	return true;
+}
+
+bool render_montage(nqiv_state* state, const bool hard, const bool preload_only)
+{
+	nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Rendering montage.\n");
+	bool redraw = false;
+	if(!preload_only && !nqiv_prepare_montage_texture(state, hard, &redraw)) {
+		return false;
+	}
+	/* Only present if a cell looks different from before. */
+	bool         changed = redraw;
+	const int    generation = nqiv_image_manager_get_interest_generation(&state->images);
+	int          start_idx;
+	int          end;
 	nqiv_image** images = state->images.images->data;
 	int          idx;
+	nqiv_montage_get_preload_range(&state->montage, &start_idx, &end);
 	nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
 	               "Preload Start: %d Preload End: %d Montage Start: %d Montage Selection: %d "
 	               "Montage End %d\n",
 	               start_idx, end, state->montage.positions.start,
 	               state->montage.positions.selection, state->montage.positions.end);
+	/* Thumbnails in atlases are drawn together once every cell has been gone through. */
+	state->atlases.batching = !preload_only;
 	for(idx = start_idx; idx < end; ++idx) {
 		nqiv_image* image = images[idx];
+		const bool  selected = state->montage.positions.selection == idx;
+		/* Images may have moved into range without it changing, by being added or removed. */
+		nqiv_image_set_interest(image, generation);
 		if(idx >= state->montage.positions.start && idx < state->montage.positions.end
 		   && !preload_only) {
-			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Rendering montage image %s at %d.\n",
-			               image->image.path, idx);
 			SDL_Rect dstrect;
 			nqiv_montage_get_image_rect(&state->montage, idx, &dstrect);
-			if(!render_from_form(state, image, true, &dstrect, true, false,
-			                     state->montage.positions.selection == idx, hard, 0)
-			   || (idx == state->montage.positions.selection && !set_title(state, image))) {
+			nqiv_montage_cell* cell =
+				&state->montage_cells[idx - state->montage.positions.start];
+			if(!nqiv_montage_cell_is_current(cell, image, &dstrect, selected)) {
+				nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
+				               "Rendering montage image %s at %d.\n", image->image.path, idx);
+				if(!nqiv_clear_montage_cell(state, &dstrect)
+				   || !render_from_form(state, image, true, &dstrect, true, false, selected, hard,
+				                        nqiv_montage_get_distance(&state->montage, idx))) {
+					return false;
+				}
+				/* Drawing a cell the same as before, such as while it's loading, doesn't change
+				 * it. */
+				changed = changed || cell->image != image || cell->texture != state->drawn_texture
+				          || cell->slot != state->drawn_slot || cell->selected != selected
+				          || cell->marked != image->marked
+				          || memcmp(&cell->dstrect, &dstrect, sizeof(SDL_Rect)) != 0;
+				cell->image = image;
+				cell->texture = state->drawn_texture;
+				cell->slot = state->drawn_slot;
+				memcpy(&cell->dstrect, &dstrect, sizeof(SDL_Rect));
+				cell->selected = selected;
+				cell->marked = image->marked;
+				cell->boxes_pending = true;
+			}
+			if(selected && !set_title(state, image)) {
 				return false;
 			}
-		} else if(!render_from_form(state, image, true, NULL, true, false,
-		                            state->montage.positions.selection == idx, hard, 1)) {
+		} else if(!render_from_form(state, image, true, NULL, true, false, selected, hard,
+		                            nqiv_montage_get_distance(&state->montage, idx))) {
 			return false;
 		}
 	}
+	if(preload_only) {
+		return true;
+	}
+	state->atlases.batching = false;
+	if(!nqiv_atlas_manager_flush(&state->atlases, state->texture_scale_mode)) {
+		return false;
+	}
+	for(idx = 0; idx < state->montage_cell_count; ++idx) {
+		nqiv_montage_cell* cell = &state->montage_cells[idx];
+		bool               cleared = true;
+		if(!cell->boxes_pending) {
+			continue;
+		}
+		cell->boxes_pending = false;
+		if((cell->selected
+		    && !render_texture(&cleared, NULL, state, state->texture_montage_selection, NULL,
+		                       &cell->dstrect))
+		   || (cell->marked
+		       && !render_texture(&cleared, NULL, state, state->texture_montage_mark, NULL,
+		                          &cell->dstrect))) {
+			return false;
+		}
+	}
+	/* Cells past the last image, on the last page. */
+	for(idx = state->montage.positions.end - state->montage.positions.start;
+	    idx < state->montage_cell_count; ++idx) {
+		nqiv_montage_cell* cell = &state->montage_cells[idx];
+		if(cell->image != NULL) {
+			if(!nqiv_clear_montage_cell(state, &cell->dstrect)) {
+				return false;
+			}
+			memset(cell, 0, sizeof(nqiv_montage_cell));
+			changed = true;
+		}
+	}
+	if(SDL_SetRenderTarget(state->renderer, NULL) != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+		               "Failed to draw to the window. SDL Error: %s\n", SDL_GetError());
+		return false;
+	}
+	if(changed) {
+		if(SDL_RenderCopy(state->renderer, state->texture_montage, NULL, NULL) != 0) {
+			nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+			               "Failed to copy montage texture. SDL Error: %s\n", SDL_GetError());
+			return false;
+		}
+		state->render_cleared = true;
+	}
+	state->montage_shown = true;
 	return true;
 }
 
@@ -1161,6 +1959,8 @@ bool render_image(nqiv_state* state, const bool start, const bool hard)
 	nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Rendering selected image.\n");
 	nqiv_image* image =
 		((nqiv_image**)state->images.images->data)[state->montage.positions.selection];
+	/* The montage will have to be presented again. */
+	state->montage_shown = false;
 	SDL_Rect dstrect = {0};
 	SDL_GetWindowSizeInPixels(state->window, &dstrect.w, &dstrect.h);
 	if(!render_from_form(state, image, false, &dstrect, start, true, false, hard, 0)) {
@@ -1193,23 +1993,50 @@ void nqiv_check_pruning(nqiv_state* state, bool* running, bool* result)
 void render_and_update(
 	nqiv_state* state, bool* running, bool* result, const bool first_render, const bool hard)
 {
+	/* While the master drains queued events, renders are put off to be done once afterward. */
+	if(state->defer_render) {
+		state->render_pending = true;
+		state->render_pending_first = state->render_pending_first || first_render;
+		state->render_pending_hard = state->render_pending_hard || hard;
+		return;
+	}
 	/* Hard forces reload. first_render basically means to show the first frame. */
 	/* Adapt screen dimensions to montage. */
 	nqiv_update_montage_dimensions(state);
 
 	nqiv_check_pruning(state, running, result);
+	nqiv_governor_update(&state->governor);
+	/* Nothing is drawn while the window can't be seen, so nothing more is loaded to be drawn. It's
+	 * drawn in full once shown again. */
+	if(state->window_hidden) {
+		state->montage_shown = false;
+		return;
+	}
 
-	/* Update transaction group. */
-	if(state->montage.range_changed) {
-		omp_set_lock(&state->thread_event_transaction_group_lock);
-		state->thread_event_transaction_group += 1;
-		state->pruner.thread_event_transaction_group = state->thread_event_transaction_group;
-		nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
-		               "Increased transaction group value to %" PRIi64 " at position %d.\n",
-		               state->thread_event_transaction_group, state->montage.positions.selection);
-		omp_unset_lock(&state->thread_event_transaction_group_lock);
+	/* Update which images are of interest, and throw out queued work for the rest. Thumbnail loads
+	 * are thrown out when the selection moves, too, so they are sent again closest first. */
+	if(state->montage.range_changed || state->montage.selection_changed) {
+		if(state->montage.range_changed) {
+			nqiv_montage_update_interest(&state->montage);
+			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
+			               "Updated images of interest at position %d.\n",
+			               state->montage.positions.selection);
+		}
+		if(state->montage.selection_changed) {
+			nqiv_image_manager_advance_selection_generation(&state->images);
+		}
+		int idx;
+		for(idx = 0; idx < state->worker_pool.queue_count; ++idx) {
+			nqiv_image_manager_purge_events(&state->images, state->worker_pool.queues[idx]);
+		}
+		if(state->io_worker_pool.count > 0) {
+			nqiv_image_manager_purge_events(&state->images, &state->io_thread_queue);
+		}
 		state->montage.range_changed = false;
+		state->montage.selection_changed = false;
 	}
+	/* Send the events of the whole render together. */
+	state->batch_thread_events = true;
 	if(state->in_montage) {
 		if(!render_montage(state, hard, false)) {
 			*running = false;
@@ -1221,10 +2048,36 @@ void render_and_update(
 			*result = false;
 		}
 	}
+	state->batch_thread_events = false;
+	if(!nqiv_priority_queue_batch_submit(&state->thread_batch, nqiv_thread_event_unsent)) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR, "Failed to send events.\n");
+		*running = false;
+		*result = false;
+	}
 	if(*result != false && state->render_cleared) {
 		SDL_RenderPresent(state->renderer);
 		state->render_cleared = false;
 	}
+	state->time_of_last_render = SDL_GetTicks64();
+}
+
+/* Wait out the rest of the display's refresh period since the last render, so events arriving in the
+ * meantime are handled by the same render. With vsync, presenting waits for the display already. */
+void nqiv_wait_for_refresh(nqiv_state* state)
+{
+	if(state->render_vsync) {
+		return;
+	}
+	SDL_DisplayMode mode = {0};
+	int             refresh_rate = DEFAULT_REFRESH_RATE;
+	if(SDL_GetWindowDisplayMode(state->window, &mode) == 0 && mode.refresh_rate > 0) {
+		refresh_rate = mode.refresh_rate;
+	}
+	const Uint64 period = 1000 / (Uint64)refresh_rate;
+	const Uint64 elapsed = SDL_GetTicks64() - state->time_of_last_render;
+	if(elapsed < period) {
+		SDL_Delay((Uint32)(period - elapsed));
+	}
 }
 
 void nqiv_handle_thumbnail_resize_action(nqiv_state* state,
@@ -1250,6 +2103,19 @@ void nqiv_mark_op(
 	render_and_update(state, running, result, false, false);
 }
 
+/* Turn the image further as it's shown. Only its orientation changes, so nothing is reloaded. */
+void nqiv_rotate_op(nqiv_state* state,
+                    bool*       running,
+                    bool*       result,
+                    nqiv_image* image,
+                    const int   turns,
+                    const bool  flip)
+{
+	const nqiv_image_orientation turn = {turns, flip};
+	image->rotation = nqiv_image_orientation_combine(&image->rotation, &turn);
+	render_and_update(state, running, result, false, false);
+}
+
 void nqiv_mark_op_toggle(nqiv_state* state, bool* running, bool* result, nqiv_image* image)
 {
 	nqiv_mark_op(state, running, result, image, !image->marked);
@@ -1620,6 +2486,19 @@ void nqiv_handle_keyactions(nqiv_state*                       state,
 		} else if(pair->action == NQIV_KEY_ACTION_RELOAD) {
 			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Received nqiv action reload.\n");
 			render_and_update(state, running, result, true, true);
+		} else if(pair->action == NQIV_KEY_ACTION_ROTATE_RIGHT) {
+			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Received nqiv action rotate right.\n");
+			nqiv_rotate_op(state, running, result, image, 1, false);
+		} else if(pair->action == NQIV_KEY_ACTION_ROTATE_LEFT) {
+			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Received nqiv action rotate left.\n");
+			nqiv_rotate_op(state, running, result, image, 3, false);
+		} else if(pair->action == NQIV_KEY_ACTION_FLIP_HORIZONTAL) {
+			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
+			               "Received nqiv action flip horizontal.\n");
+			nqiv_rotate_op(state, running, result, image, 0, true);
+		} else if(pair->action == NQIV_KEY_ACTION_FLIP_VERTICAL) {
+			nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Received nqiv action flip vertical.\n");
+			nqiv_rotate_op(state, running, result, image, 2, true);
 		} else {
 			assert(false);
 		}
@@ -1637,19 +2516,212 @@ void nqiv_set_match_keymods(nqiv_key_match* match)
 	}
 }
 
+/* Track whether the window can be seen, and whether it's in the background, where the workers are
+ * held to thread_background_count. */
+void nqiv_handle_window_visibility(nqiv_state* state, const Uint8 window_event)
+{
+	switch(window_event) {
+	case SDL_WINDOWEVENT_HIDDEN:
+	case SDL_WINDOWEVENT_MINIMIZED:
+		state->window_hidden = true;
+		break;
+	case SDL_WINDOWEVENT_SHOWN:
+	case SDL_WINDOWEVENT_EXPOSED:
+	case SDL_WINDOWEVENT_RESTORED:
+	case SDL_WINDOWEVENT_MAXIMIZED:
+		state->window_hidden = false;
+		break;
+	case SDL_WINDOWEVENT_FOCUS_LOST:
+		state->window_focused = false;
+		break;
+	case SDL_WINDOWEVENT_FOCUS_GAINED:
+		state->window_focused = true;
+		break;
+	default:
+		return;
+	}
+	const bool background = state->window_hidden || !state->window_focused;
+	const int  cap = background ? state->thread_background_count : 0;
+	nqiv_governor_set_max_workers(&state->governor, cap > 0 ? cap : state->worker_pool.count);
+	/* The I/O workers would otherwise read ahead at full speed for workers which are held back. */
+	const int io_count = state->io_worker_pool.count;
+	if(io_count > 0) {
+		nqiv_worker_pool_set_active(&state->io_worker_pool,
+		                            cap > 0 && cap < io_count ? cap : io_count);
+	}
+}
+
+/* Apply the changes an SDL event calls for. */
+void nqiv_handle_sdl_event(nqiv_state*      state,
+                           const SDL_Event* input_event,
+                           bool*            running,
+                           bool*            result)
+{
+	switch(input_event->type) {
+	case SDL_USEREVENT:
+		if(input_event->user.code >= 0) {
+			if((Uint32)input_event->user.code == state->thread_event_number) {
+				render_and_update(state, running, result, false, false);
+			} else if((Uint32)input_event->user.code == state->cfg_event_number) {
+				nqiv_handle_keyactions(state, running, result, true, NQIV_KEYRATE_ON_DOWN);
+				render_and_update(state, running, result, false, false);
+			}
+		}
+		break;
+	case SDL_WINDOWEVENT:
+		nqiv_handle_window_visibility(state, input_event->window.event);
+		if(input_event->window.event == SDL_WINDOWEVENT_RESIZED
+		   || input_event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED
+		   || input_event->window.event == SDL_WINDOWEVENT_EXPOSED
+		   || input_event->window.event == SDL_WINDOWEVENT_MAXIMIZED
+		   || input_event->window.event == SDL_WINDOWEVENT_RESTORED
+		   || input_event->window.event == SDL_WINDOWEVENT_SHOWN
+		   || input_event->window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED) {
+			/* The window must be presented again, even if nothing in it changed. */
+			state->montage_shown = false;
+			render_and_update(state, running, result, false, false);
+		} else if(input_event->window.event == SDL_WINDOWEVENT_ICCPROF_CHANGED) {
+			/* What's shown was converted for the old profile, so it's loaded again. Other images
+			 * keep the old conversion until they're unloaded. */
+			nqiv_update_color_profile(state);
+			state->montage_shown = false;
+			render_and_update(state, running, result, false, true);
+		}
+		break;
+	case SDL_RENDER_TARGETS_RESET:
+	case SDL_RENDER_DEVICE_RESET:
+		/* The contents of texture_montage may have been lost. */
+		state->montage_shown = false;
+		render_and_update(state, running, result, false, false);
+		break;
+	case SDL_QUIT:
+		*running = false;
+		break;
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		assert(input_event->type == SDL_KEYDOWN || input_event->type == SDL_KEYUP);
+		{
+			nqiv_key_match match = {0};
+			if(input_event->key.keysym.scancode != SDL_SCANCODE_UNKNOWN) {
+				match.mode |= NQIV_KEY_MATCH_MODE_KEY;
+			}
+			if((input_event->key.keysym.mod & ~KMOD_GUI & ~KMOD_SCROLL & ~KMOD_NUM) != 0) {
+				match.mode |= NQIV_KEY_MATCH_MODE_KEY_MOD;
+			}
+			memcpy(&match.data.key, &input_event->key.keysym, sizeof(SDL_Keysym));
+			const nqiv_op_result lookup_summary =
+				nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
+			if(lookup_summary == NQIV_FAIL) {
+				*running = false;
+				*result = false;
+			} else if(lookup_summary == NQIV_SUCCESS) {
+				nqiv_handle_keyactions(state, running, result, false,
+				                       input_event->type == SDL_KEYUP ? NQIV_KEYRATE_ON_UP
+				                                                      : NQIV_KEYRATE_ON_DOWN);
+				render_and_update(state, running, result, false, false);
+			}
+		}
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		assert(input_event->type == SDL_MOUSEBUTTONDOWN || input_event->type == SDL_MOUSEBUTTONUP);
+		{
+			nqiv_key_match match = {0};
+			match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_BUTTON;
+			memcpy(&match.data.mouse_button, &input_event->button, sizeof(SDL_MouseButtonEvent));
+			nqiv_set_match_keymods(&match);
+			const nqiv_op_result lookup_summary =
+				nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
+			if(lookup_summary == NQIV_FAIL) {
+				*running = false;
+				*result = false;
+			} else if(lookup_summary == NQIV_SUCCESS) {
+				nqiv_handle_keyactions(state, running, result, false,
+				                       input_event->type == SDL_MOUSEBUTTONUP
+				                           ? NQIV_KEYRATE_ON_UP
+				                           : NQIV_KEYRATE_ON_DOWN);
+				render_and_update(state, running, result, false, false);
+			}
+		}
+		break;
+	case SDL_MOUSEWHEEL:
+		assert(input_event->type == SDL_MOUSEWHEEL);
+		{
+			nqiv_key_match match = {0};
+			if(input_event->wheel.x < 0) {
+				match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_LEFT;
+			}
+			if(input_event->wheel.x > 0) {
+				match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_RIGHT;
+			}
+			if(input_event->wheel.y < 0) {
+				match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_BACKWARD;
+			}
+			if(input_event->wheel.y > 0) {
+				match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_FORWARD;
+			}
+			nqiv_set_match_keymods(&match);
+			const nqiv_op_result lookup_summary =
+				nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
+			if(lookup_summary == NQIV_FAIL) {
+				*running = false;
+				*result = false;
+			} else if(lookup_summary == NQIV_SUCCESS) {
+				nqiv_handle_keyactions(state, running, result, false,
+				                       NQIV_KEYRATE_ON_DOWN | NQIV_KEYRATE_ON_UP);
+				render_and_update(state, running, result, false, false);
+			}
+		}
+		break;
+	case SDL_MOUSEMOTION:
+		if(state->is_mouse_panning && !state->in_montage) {
+			SDL_Rect coordinates = {0};
+			SDL_GetWindowSizeInPixels(state->window, &coordinates.w, &coordinates.h);
+			coordinates.x = input_event->motion.xrel;
+			coordinates.y = input_event->motion.yrel;
+			nqiv_image_manager_pan_coordinates(&state->images, &coordinates);
+			render_and_update(state, running, result, false, false);
+		}
+		break;
+	default:
+		assert(true);
+	}
+}
+
+/* Milliseconds to wait on an SDL event, or 0 for no limit. It's cut short to render once a
+ * refinement comes due. If it couldn't be asked for then, the next render will. */
+int nqiv_get_event_timeout(const nqiv_state* state)
+{
+	const Uint64 now = SDL_GetTicks64();
+	if(state->in_montage || state->refine_time <= now) {
+		return state->event_timeout;
+	}
+	const int refine_timeout = (int)(state->refine_time - now);
+	return state->event_timeout > 0 && state->event_timeout < refine_timeout
+	           ? state->event_timeout
+	           : refine_timeout;
+}
+
 bool nqiv_master_thread(nqiv_state* state)
 {
 	bool result = true;
 	bool running = true;
+	/* Everything else was kept off this processor by nqiv_setup_thread_info. */
+	if(state->thread_master_cpu >= 0 && !nqiv_set_thread_cpu(state->thread_master_cpu, false)) {
+		nqiv_log_write(&state->logger, NQIV_LOG_WARNING,
+		               "Failed to pin the master thread to processor %d.\n",
+		               state->thread_master_cpu);
+	}
 	while(running) {
 		SDL_PumpEvents();
 		SDL_Event    input_event = {0};
 		const Uint64 wait_start = SDL_GetTicks64();
-		const int    event_result = state->event_timeout > 0
-		                                ? SDL_WaitEventTimeout(&input_event, state->event_timeout)
+		const int    event_timeout = nqiv_get_event_timeout(state);
+		const int    event_result = event_timeout > 0
+		                                ? SDL_WaitEventTimeout(&input_event, event_timeout)
 		                                : SDL_WaitEvent(&input_event);
 		if(event_result == 0) {
-			if(state->event_timeout == 0) {
+			if(event_timeout == 0) {
 				nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
 				               "Failed to wait on an SDL event (with limitless waiting period). "
 				               "SDL Error: %s\n",
@@ -1663,131 +2735,37 @@ bool nqiv_master_thread(nqiv_state* state)
 				 * functions. During testing, the ticks/ms slept for were sometimes
 				 * off by one. For now, deciding this error check is not worthwhile.*/
 				nqiv_log_write(&state->logger, NQIV_LOG_DEBUG,
-				               "Waited for %" PRIu64 "ms with expected delay of %" PRIu64
+				               "Waited for %" PRIu64 "ms with expected delay of %d"
 				               "ms Checking if a prune is needed.\n",
-				               wait_diff, state->event_timeout);
+				               wait_diff, event_timeout);
 				render_and_update(state, &running, &result, false, false);
 			}
 			continue;
 		}
-		switch(input_event.type) {
-		case SDL_USEREVENT:
-			if(input_event.user.code >= 0) {
-				if((Uint32)input_event.user.code == state->thread_event_number) {
-					render_and_update(state, &running, &result, false, false);
-				} else if((Uint32)input_event.user.code == state->cfg_event_number) {
-					nqiv_handle_keyactions(state, &running, &result, true, NQIV_KEYRATE_ON_DOWN);
-					render_and_update(state, &running, &result, false, false);
-				}
-			}
-			break;
-		case SDL_WINDOWEVENT:
-			if(input_event.window.event == SDL_WINDOWEVENT_RESIZED
-			   || input_event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED
-			   || input_event.window.event == SDL_WINDOWEVENT_EXPOSED
-			   || input_event.window.event == SDL_WINDOWEVENT_MAXIMIZED
-			   || input_event.window.event == SDL_WINDOWEVENT_RESTORED
-			   || input_event.window.event == SDL_WINDOWEVENT_SHOWN
-			   || input_event.window.event == SDL_WINDOWEVENT_ICCPROF_CHANGED
-			   || input_event.window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED) {
-				render_and_update(state, &running, &result, false, false);
-			}
-			break;
-		case SDL_QUIT:
-			running = false;
-			break;
-		case SDL_KEYDOWN:
-		case SDL_KEYUP:
-			assert(input_event.type == SDL_KEYDOWN || input_event.type == SDL_KEYUP);
-			{
-				nqiv_key_match match = {0};
-				if(input_event.key.keysym.scancode != SDL_SCANCODE_UNKNOWN) {
-					match.mode |= NQIV_KEY_MATCH_MODE_KEY;
-				}
-				if((input_event.key.keysym.mod & ~KMOD_GUI & ~KMOD_SCROLL & ~KMOD_NUM) != 0) {
-					match.mode |= NQIV_KEY_MATCH_MODE_KEY_MOD;
-				}
-				memcpy(&match.data.key, &input_event.key.keysym, sizeof(SDL_Keysym));
-				const nqiv_op_result lookup_summary =
-					nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
-				if(lookup_summary == NQIV_FAIL) {
-					running = false;
-					result = false;
-				} else if(lookup_summary == NQIV_SUCCESS) {
-					nqiv_handle_keyactions(state, &running, &result, false,
-					                       input_event.type == SDL_KEYUP ? NQIV_KEYRATE_ON_UP
-					                                                     : NQIV_KEYRATE_ON_DOWN);
-					render_and_update(state, &running, &result, false, false);
-				}
-			}
-			break;
-		case SDL_MOUSEBUTTONDOWN:
-		case SDL_MOUSEBUTTONUP:
-			assert(input_event.type == SDL_MOUSEBUTTONDOWN
-			       || input_event.type == SDL_MOUSEBUTTONUP);
-			{
-				nqiv_key_match match = {0};
-				match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_BUTTON;
-				memcpy(&match.data.mouse_button, &input_event.button, sizeof(SDL_MouseButtonEvent));
-				nqiv_set_match_keymods(&match);
-				const nqiv_op_result lookup_summary =
-					nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
-				if(lookup_summary == NQIV_FAIL) {
-					running = false;
-					result = false;
-				} else if(lookup_summary == NQIV_SUCCESS) {
-					nqiv_handle_keyactions(state, &running, &result, false,
-					                       input_event.type == SDL_MOUSEBUTTONUP
-					                           ? NQIV_KEYRATE_ON_UP
-					                           : NQIV_KEYRATE_ON_DOWN);
-					render_and_update(state, &running, &result, false, false);
-				}
-			}
-			break;
-		case SDL_MOUSEWHEEL:
-			assert(input_event.type == SDL_MOUSEWHEEL);
-			{
-				nqiv_key_match match = {0};
-				if(input_event.wheel.x < 0) {
-					match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_LEFT;
-				}
-				if(input_event.wheel.x > 0) {
-					match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_RIGHT;
-				}
-				if(input_event.wheel.y < 0) {
-					match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_BACKWARD;
-				}
-				if(input_event.wheel.y > 0) {
-					match.mode |= NQIV_KEY_MATCH_MODE_MOUSE_WHEEL_FORWARD;
-				}
-				nqiv_set_match_keymods(&match);
-				const nqiv_op_result lookup_summary =
-					nqiv_keybind_lookup(&state->keybinds, &match, &state->key_actions);
-				if(lookup_summary == NQIV_FAIL) {
-					running = false;
-					result = false;
-				} else if(lookup_summary == NQIV_SUCCESS) {
-					nqiv_handle_keyactions(state, &running, &result, false,
-					                       NQIV_KEYRATE_ON_DOWN | NQIV_KEYRATE_ON_UP);
-					render_and_update(state, &running, &result, false, false);
-				}
-			}
-			break;
-		case SDL_MOUSEMOTION:
-			if(state->is_mouse_panning && !state->in_montage) {
-				SDL_Rect coordinates = {0};
-				SDL_GetWindowSizeInPixels(state->window, &coordinates.w, &coordinates.h);
-				coordinates.x = input_event.motion.xrel;
-				coordinates.y = input_event.motion.yrel;
-				nqiv_image_manager_pan_coordinates(&state->images, &coordinates);
-				render_and_update(state, &running, &result, false, false);
-			}
-			break;
-		default:
-			assert(true);
+		/* Handle every event queued by the next refresh, then render once for all of them. */
+		nqiv_wait_for_refresh(state);
+		state->defer_render = true;
+		do {
+			nqiv_handle_sdl_event(state, &input_event, &running, &result);
+		} while(running && SDL_PollEvent(&input_event) == 1);
+		state->defer_render = false;
+		if(running && state->render_pending) {
+			const bool first_render = state->render_pending_first;
+			const bool hard = state->render_pending_hard;
+			state->render_pending = false;
+			state->render_pending_first = false;
+			state->render_pending_hard = false;
+			/* Whatever workers finished so far will be shown, and anything after wakes us again. */
+			nqiv_worker_pool_consume_wake(&state->worker_pool);
+			render_and_update(state, &running, &result, first_render, hard);
 		}
 	}
 	nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Finished waiting on events.\n");
+	/* Parked workers have to be active to receive their stop event. */
+	nqiv_worker_pool_set_active(&state->worker_pool, state->worker_pool.count);
+	if(state->io_worker_pool.count > 0) {
+		nqiv_worker_pool_set_active(&state->io_worker_pool, state->io_worker_pool.count);
+	}
 	int idx;
 	for(idx = 0; idx < state->thread_count; ++idx) {
 		nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Killing worker %d.\n", idx);
@@ -1795,6 +2773,12 @@ bool nqiv_master_thread(nqiv_state* state)
 		output_event.type = NQIV_EVENT_WORKER_STOP;
 		nqiv_send_thread_event_force(state, 0, &output_event);
 	}
+	for(idx = 0; idx < state->io_worker_pool.count; ++idx) {
+		nqiv_log_write(&state->logger, NQIV_LOG_DEBUG, "Killing I/O worker %d.\n", idx);
+		nqiv_event output_event = {0};
+		output_event.type = NQIV_EVENT_WORKER_STOP;
+		nqiv_priority_queue_push_force(&state->io_thread_queue, 0, &output_event);
+	}
 	return result;
 }
 
@@ -1803,28 +2787,28 @@ bool nqiv_run(nqiv_state* state)
 	bool                 result;
 	bool*                result_ptr = &result;
 	const int            thread_count = state->thread_count;
+	const int            io_thread_count = state->io_worker_pool.count;
 	const int            thread_event_interval = state->thread_event_interval;
 	const int            extra_wakeup_delay = state->extra_wakeup_delay;
 	nqiv_log_ctx*        logger = &state->logger;
-	nqiv_priority_queue* thread_queue = &state->thread_queue;
-	const int64_t*       thread_event_transaction_group = &state->thread_event_transaction_group;
-	omp_lock_t*  thread_event_transaction_group_lock = &state->thread_event_transaction_group_lock;
-	const Uint32 event_code = state->thread_event_number;
+	nqiv_worker_pool*    worker_pool = &state->worker_pool;
+	nqiv_worker_pool*    io_worker_pool = &state->io_worker_pool;
+	const Uint32         event_code = state->thread_event_number;
 	/* clang-format insists on unindenting pragmas. */
 	/* clang-format off */
-	#pragma omp parallel                                  \
-		default(none)                                     \
-		firstprivate(state,                               \
-					 logger,                              \
-					 thread_count,                        \
-					 extra_wakeup_delay,                  \
-					 thread_event_interval,               \
-					 thread_queue,                        \
-					 event_code,                          \
-					 result_ptr,                          \
-					 thread_event_transaction_group,      \
-					 thread_event_transaction_group_lock) \
-		num_threads(thread_count + 1)
+	#pragma omp parallel                    \
+		default(none)                       \
+		firstprivate(state,                 \
+					 logger,                \
+					 thread_count,          \
+					 io_thread_count,       \
+					 extra_wakeup_delay,    \
+					 thread_event_interval, \
+					 worker_pool,           \
+					 io_worker_pool,        \
+					 event_code,            \
+					 result_ptr)            \
+		num_threads(thread_count + io_thread_count + 1)
 	/* clang-format on */
 	{
 		/* clang-format off */
@@ -1834,19 +2818,30 @@ bool nqiv_run(nqiv_state* state)
 			int thread;
 			for(thread = 0; thread < thread_count; ++thread) {
 				/* clang-format off */
-				#pragma omp task                                      \
-					default(none)                                     \
-					firstprivate(logger,                              \
-								 thread_queue,                        \
-								 extra_wakeup_delay,                  \
-								 thread_event_interval,               \
-								 event_code,                          \
-								 thread_event_transaction_group,      \
-								 thread_event_transaction_group_lock)
+				#pragma omp task                        \
+					default(none)                       \
+					firstprivate(logger,                \
+								 worker_pool,           \
+								 thread,                \
+								 extra_wakeup_delay,    \
+								 thread_event_interval, \
+								 event_code)
+				/* clang-format on */
+				nqiv_worker_main(logger, worker_pool, thread, extra_wakeup_delay,
+				                 thread_event_interval, event_code);
+			}
+			for(thread = 0; thread < io_thread_count; ++thread) {
+				/* clang-format off */
+				#pragma omp task                        \
+					default(none)                       \
+					firstprivate(logger,                \
+								 io_worker_pool,        \
+								 worker_pool,           \
+								 thread,                \
+								 extra_wakeup_delay)
 				/* clang-format on */
-				nqiv_worker_main(logger, thread_queue, extra_wakeup_delay, thread_event_interval,
-				                 event_code, thread_event_transaction_group,
-				                 thread_event_transaction_group_lock);
+				nqiv_worker_io_main(logger, io_worker_pool, worker_pool, thread,
+				                    extra_wakeup_delay);
 			}
 			*result_ptr = nqiv_master_thread(state);
 		}
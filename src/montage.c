@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
 
 #include <SDL2/SDL.h>
 
@@ -42,6 +43,7 @@ void nqiv_montage_set_selection(nqiv_montage_state* state, const int idx)
 	if(new_idx < 0) {
 		new_idx = 0;
 	}
+	state->selection_changed = state->selection_changed || new_idx != state->positions.selection;
 
 	if(state->positions.start != state->positions.end && new_idx >= state->positions.start
 	   && new_idx < state->positions.end
@@ -211,3 +213,44 @@ int nqiv_montage_find_index_at_point(nqiv_montage_state* state, const int x, con
 	}
 	return -1;
 }
+
+int nqiv_montage_get_distance(nqiv_montage_state* state, const int idx)
+{
+	const int per_row =
+		state->dimensions.count_per_row > 0 ? state->dimensions.count_per_row : 1;
+	const int selection = state->positions.selection;
+	const int rows = abs(idx / per_row - selection / per_row);
+	const int columns = abs(idx % per_row - selection % per_row);
+	int       distance = rows > columns ? rows : columns;
+	if(idx < state->positions.start || idx >= state->positions.end) {
+		const int rows_per_page = state->dimensions.count / per_row;
+		distance += rows_per_page > per_row ? rows_per_page : per_row;
+	}
+	return distance;
+}
+
+void nqiv_montage_get_preload_range(nqiv_montage_state* state, int* start, int* end)
+{
+	const int images_len = nqiv_array_get_units_count(state->images->images);
+	const int raw_start = state->positions.start - state->preload.behind;
+	const int raw_end = state->positions.end + state->preload.ahead;
+	*start = raw_start >= 0 ? raw_start : 0;
+	*end = raw_end <= images_len ? raw_end : images_len;
+}
+
+void nqiv_montage_update_interest(nqiv_montage_state* state)
+{
+	/* Mark the new range before advancing, so images staying in range are never seen as out of
+	 * it. */
+	const int next_generation =
+		(int)((unsigned int)nqiv_image_manager_get_interest_generation(state->images) + 1);
+	nqiv_image** images = state->images->images->data;
+	int          start;
+	int          end;
+	int          idx;
+	nqiv_montage_get_preload_range(state, &start, &end);
+	for(idx = start; idx < end; ++idx) {
+		nqiv_image_set_interest(images[idx], next_generation);
+	}
+	nqiv_image_manager_advance_interest_generation(state->images);
+}
@@ -46,9 +46,11 @@ typedef struct nqiv_montage_state
 	nqiv_montage_positions  positions;
 	nqiv_montage_preload    preload;
 	/* Are we viewing a different set/page of thumbnails now?
-	 * Used to set loading 'transaction group' to discard queued out of sight thumbnails.
+	 * Used to update which images are of interest, to discard queued out of sight thumbnails.
 	 */
 	bool                    range_changed;
+	/* Has the selection moved? Used to send thumbnail loads again, ordered by the new selection. */
+	bool                    selection_changed;
 } nqiv_montage_state;
 
 /* Set operations set to a specific value, jump operations set to an offset from the current value,
@@ -73,6 +75,17 @@ void nqiv_montage_previous_selection_page(nqiv_montage_state* state);
 void nqiv_montage_jump_selection_start(nqiv_montage_state* state);
 void nqiv_montage_jump_selection_end(nqiv_montage_state* state);
 
+/* Indexes of images from the first to be preloaded behind start, up to (not including) the last to
+ * be preloaded ahead of end. */
+void nqiv_montage_get_preload_range(nqiv_montage_state* state, int* start, int* end);
+/* Mark the images in the preload range as those of interest. See nqiv_image::interest */
+void nqiv_montage_update_interest(nqiv_montage_state* state);
+
+/* How far the image is from the selection, in rows or columns, whichever is greater. Images outside
+ * the montage are placed further than any inside it. Used to load the selection first, then spiral
+ * outward. */
+int nqiv_montage_get_distance(nqiv_montage_state* state, const int idx);
+
 /* Get image index of thumbnail at particular X/Y coordinates. */
 int nqiv_montage_find_index_at_point(nqiv_montage_state* state, const int x, const int y);
 
@@ -6,6 +6,10 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+#include <time.h>
+
+#include <omp.h>
 
 // NOLINTBEGIN
 #include <glib.h>
@@ -183,3 +187,139 @@ FILE* nqiv_fopen(const char* filename, const char* mode)
 	}
 	return fopen(path, mode);
 }
+
+#if defined(__linux__)
+	#include <sched.h>
+/* Processors allowed by a cgroup quota file holding '<quota> <period>' or just '<quota>', the
+ * period being read from a separate file if necessary. 0 if there's no quota. */
+int nqiv_get_cgroup_cpu_quota(const char* quota_path, const char* period_path)
+{
+	FILE* file = fopen(quota_path, "r");
+	if(file == NULL) {
+		return 0;
+	}
+	char quota_string[32] = {0};
+	long period = 0;
+	/* cgroup v2 has 'max' for no quota. */
+	const int matched = fscanf(file, "%31s %ld", quota_string, &period);
+	fclose(file);
+	if(matched < 1 || strcmp(quota_string, "max") == 0) {
+		return 0;
+	}
+	const long quota = strtol(quota_string, NULL, 10);
+	if(matched < 2 && period_path != NULL) {
+		file = fopen(period_path, "r");
+		if(file == NULL) {
+			return 0;
+		}
+		if(fscanf(file, "%ld", &period) != 1) {
+			period = 0;
+		}
+		fclose(file);
+	}
+	if(quota <= 0 || period <= 0) {
+		return 0;
+	}
+	/* Round up, so a quota of 1.5 processors can still keep two threads busy half the time. */
+	const long cpus = (quota + period - 1) / period;
+	return cpus < INT_MAX ? (int)cpus : INT_MAX;
+}
+
+int nqiv_get_available_cpus(void)
+{
+	int       cpus = omp_get_num_procs();
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0 && CPU_COUNT(&set) > 0) {
+		cpus = CPU_COUNT(&set);
+	}
+	int quota = nqiv_get_cgroup_cpu_quota("/sys/fs/cgroup/cpu.max", NULL);
+	if(quota == 0) {
+		quota = nqiv_get_cgroup_cpu_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us",
+		                                  "/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+	}
+	if(quota > 0 && quota < cpus) {
+		cpus = quota;
+	}
+	return cpus > 0 ? cpus : 1;
+}
+#else
+int nqiv_get_available_cpus(void)
+{
+	const int cpus = omp_get_num_procs();
+	return cpus > 0 ? cpus : 1;
+}
+#endif
+
+#if defined(__MINGW32__)
+bool nqiv_get_process_cpu_time(double* seconds)
+{
+	/* clock() measures wall time on Windows. */
+	(void)seconds;
+	return false;
+}
+#else
+bool nqiv_get_process_cpu_time(double* seconds)
+{
+	struct timespec time;
+	if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+		return false;
+	}
+	*seconds = (double)time.tv_sec + (double)time.tv_nsec / 1000000000.0;
+	return true;
+}
+#endif
+
+#if defined(__linux__)
+	#include <sched.h>
+	#include <unistd.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+bool nqiv_set_thread_background(const int niceness, const bool idle)
+{
+	assert(niceness >= 0);
+	bool result = true;
+	/* On Linux, niceness is per thread, given the thread ID. */
+	if(niceness > 0 && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), niceness) != 0) {
+		result = false;
+	}
+	if(idle) {
+		struct sched_param param = {0};
+		result = sched_setscheduler(0, SCHED_IDLE, &param) == 0 && result;
+	}
+	return result;
+}
+
+bool nqiv_set_thread_cpu(const int cpu, const bool exclude)
+{
+	if(cpu < 0 || cpu >= CPU_SETSIZE) {
+		return false;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(exclude) {
+		if(sched_getaffinity(0, sizeof(cpu_set_t), &set) != 0) {
+			return false;
+		}
+		CPU_CLR(cpu, &set);
+		if(CPU_COUNT(&set) == 0) {
+			return false;
+		}
+	} else {
+		CPU_SET(cpu, &set);
+	}
+	return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+}
+#else
+bool nqiv_set_thread_background(const int niceness, const bool idle)
+{
+	return niceness == 0 && !idle;
+}
+
+bool nqiv_set_thread_cpu(const int cpu, const bool exclude)
+{
+	(void)cpu;
+	(void)exclude;
+	return false;
+}
+#endif
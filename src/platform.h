@@ -73,5 +73,18 @@ int   nqiv_ptrdiff(const void* a, const void* b);
 bool  nqiv_expand_path(char* output, const int length, const char* input);
 /* Expand a path, open it, and return its file object. */
 FILE* nqiv_fopen(const char* filename, const char* mode);
+/* Number of processors the process may actually use. On Linux, this respects the CPU affinity mask
+ * and any cgroup CPU quota, which is how containers are usually limited. At least 1. */
+int   nqiv_get_available_cpus(void);
+/* Seconds of processor time used by all threads of the process so far. False if unknown. */
+bool  nqiv_get_process_cpu_time(double* seconds);
+/* Lower the scheduling priority of the calling thread to the given niceness (0 to 19), and to the
+ * idle scheduling class if idle is set. Threads it creates afterward inherit this. False if it
+ * failed or isn't supported. */
+bool  nqiv_set_thread_background(const int niceness, const bool idle);
+/* Restrict the calling thread to the given processor, or if exclude is set, to the processors it
+ * may use other than that one. Threads it creates afterward inherit this. False if it failed or
+ * isn't supported. */
+bool  nqiv_set_thread_cpu(const int cpu, const bool exclude);
 
 #endif /* NQIV_PLATFORM_H */
@@ -17,6 +17,10 @@ void nqiv_pruner_destroy(nqiv_pruner* pruner)
 	if(pruner->pruners != NULL) {
 		nqiv_array_destroy(pruner->pruners);
 	}
+	if(pruner->loaded != NULL) {
+		nqiv_array_destroy(pruner->loaded);
+	}
+	nqiv_priority_queue_batch_destroy(&pruner->batch);
 	memset(pruner, 0, sizeof(nqiv_pruner));
 }
 
@@ -28,9 +32,24 @@ bool nqiv_pruner_init(nqiv_pruner* pruner, nqiv_log_ctx* logger, const int queue
 		               "Failed to create queue of length %d for pruners array.\n", queue_length);
 		return false;
 	}
+	nqiv_array* new_loaded = nqiv_array_create(sizeof(nqiv_image*), queue_length);
+	if(new_loaded == NULL) {
+		nqiv_array_destroy(new_pruners);
+		nqiv_log_write(logger, NQIV_LOG_ERROR,
+		               "Failed to create queue of length %d for pruned images array.\n",
+		               queue_length);
+		return false;
+	}
+	nqiv_array_unlimit_data(new_loaded);
 	nqiv_pruner_destroy(pruner);
+	if(!nqiv_priority_queue_batch_init(&pruner->batch, logger, sizeof(nqiv_event))) {
+		nqiv_array_destroy(new_pruners);
+		nqiv_array_destroy(new_loaded);
+		return false;
+	}
 	pruner->logger = logger;
 	pruner->pruners = new_pruners;
+	pruner->loaded = new_loaded;
 	return true;
 }
 
@@ -195,6 +214,8 @@ int nqiv_pruner_run_image(nqiv_pruner*         pruner,
 		return 0;
 	}
 	if(!nqiv_image_has_loaded_form(image)) {
+		/* A worker puts it back as soon as it loads something again. */
+		nqiv_image_manager_unlist_loaded(image->parent, image);
 		nqiv_image_unlock(image);
 		return 0;
 	}
@@ -280,8 +301,11 @@ int nqiv_pruner_run_image(nqiv_pruner*         pruner,
 	nqiv_log_write(pruner->logger, NQIV_LOG_DEBUG, "%sending prune event for image %d.\n",
 	               send_event ? "S" : "Not s", iidx);
 	if(send_event) {
-		event.transaction_group = pruner->thread_event_transaction_group;
-		if(!nqiv_priority_queue_push(thread_queue, NQIV_EVENT_PRIORITY_PRUNE, &event)) {
+		/* Pruning decisions are only good until the montage moves. */
+		event.lifetime = NQIV_EVENT_LIFETIME_GENERATION;
+		event.generation = nqiv_image_manager_get_interest_generation(image->parent);
+		if(!nqiv_priority_queue_batch_add(&pruner->batch, thread_queue, NQIV_EVENT_PRIORITY_PRUNE,
+		                                  &event)) {
 			nqiv_image_unlock(image);
 			return false;
 		}
@@ -312,23 +336,41 @@ void nqiv_pruner_clean_desc(nqiv_pruner_desc* desc)
 	nqiv_pruner_clean_desc_set(&desc->thumbnail_texture_set);
 }
 
+int nqiv_pruner_compare_index(const void* first, const void* second)
+{
+	return (*(nqiv_image* const*)first)->index - (*(nqiv_image* const*)second)->index;
+}
+
 int nqiv_pruner_run(nqiv_pruner*         pruner,
                     nqiv_montage_state*  montage,
                     nqiv_image_manager*  images,
                     nqiv_priority_queue* thread_queue)
 {
+	/* Only loaded images are visited, rather than every image. Counts ahead and behind depend on
+	 * them being visited in order. */
+	if(!nqiv_image_manager_get_loaded(images, pruner->loaded)) {
+		nqiv_log_write(pruner->logger, NQIV_LOG_ERROR, "Failed to list loaded images to prune.\n");
+		return -1;
+	}
 	int          output = 0;
-	const int    num_images = nqiv_array_get_units_count(images->images);
-	nqiv_image** images_array = images->images->data;
-	int          iidx;
+	const int    num_images = nqiv_array_get_units_count(pruner->loaded);
+	nqiv_image** images_array = pruner->loaded->data;
+	qsort(images_array, num_images, sizeof(nqiv_image*), nqiv_pruner_compare_index);
+	int iidx;
 	for(iidx = 0; iidx < num_images; ++iidx) {
-		const int result =
-			nqiv_pruner_run_image(pruner, montage, thread_queue, iidx, images_array[iidx]);
+		nqiv_image* image = images_array[iidx];
+		const int   result =
+			nqiv_pruner_run_image(pruner, montage, thread_queue, image->index, image);
 		if(result == -1) {
+			nqiv_priority_queue_batch_submit(&pruner->batch, NULL);
 			return result;
 		}
 		output += result;
 	}
+	if(!nqiv_priority_queue_batch_submit(&pruner->batch, NULL)) {
+		nqiv_log_write(pruner->logger, NQIV_LOG_ERROR, "Failed to send prune events.\n");
+		return -1;
+	}
 	int               idx;
 	const int         num_descs = nqiv_array_get_units_count(pruner->pruners);
 	nqiv_pruner_desc* descs_array = pruner->pruners->data;
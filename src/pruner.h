@@ -113,10 +113,13 @@ typedef struct nqiv_pruner_desc
 
 typedef struct nqiv_pruner
 {
-	nqiv_log_ctx*     logger;
-	nqiv_array*       pruners;
-	nqiv_pruner_state state;
-	int64_t           thread_event_transaction_group;
+	nqiv_log_ctx*             logger;
+	nqiv_array*               pruners;
+	/* Of nqiv_image*, the loaded images visited by a run, in order. */
+	nqiv_array*               loaded;
+	nqiv_pruner_state         state;
+	/* Prune events of a run are collected here and sent together at the end. */
+	nqiv_priority_queue_batch batch;
 } nqiv_pruner;
 
 void nqiv_pruner_destroy(nqiv_pruner* pruner);
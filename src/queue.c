@@ -2,7 +2,9 @@
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <limits.h>
 
+#include <SDL2/SDL.h>
 #include <omp.h>
 
 #include "logging.h"
@@ -98,6 +100,29 @@ void nqiv_queue_push_force(nqiv_queue* queue, const void* entry)
 	omp_unset_lock(&queue->lock);
 }
 
+bool nqiv_queue_push_count(nqiv_queue* queue, const void* entries, const int count)
+{
+	assert(entries != NULL);
+	assert(queue != NULL);
+	assert(queue->array != NULL);
+	assert(count > 0);
+	bool result = true;
+	omp_set_lock(&queue->lock);
+	const int old_length = queue->array->data_length;
+	if(!nqiv_array_push_count(queue->array, entries, count)) {
+		nqiv_log_write(queue->logger, NQIV_LOG_WARNING,
+		               "Failed to push %d entries to array of length %d.\n", count,
+		               queue->array->data_length);
+		result = false;
+	}
+	if(old_length != queue->array->data_length) {
+		nqiv_log_write(queue->logger, NQIV_LOG_DEBUG, "Expanded queue from length %d to %d.\n",
+		               old_length, queue->array->data_length);
+	}
+	omp_unset_lock(&queue->lock);
+	return result;
+}
+
 bool nqiv_queue_pop(nqiv_queue* queue, void* entry)
 {
 	assert(entry != NULL);
@@ -128,8 +153,197 @@ bool nqiv_queue_pop_front(nqiv_queue* queue, void* entry)
 	return result;
 }
 
+bool nqiv_queue_is_empty(nqiv_queue* queue)
+{
+	assert(queue != NULL);
+	assert(queue->array != NULL);
+	omp_set_lock(&queue->lock);
+	const bool result = queue->array->position == 0;
+	omp_unset_lock(&queue->lock);
+	return result;
+}
+
+int nqiv_queue_get_count(nqiv_queue* queue)
+{
+	assert(queue != NULL);
+	assert(queue->array != NULL);
+	omp_set_lock(&queue->lock);
+	const int result = nqiv_array_get_units_count(queue->array);
+	omp_unset_lock(&queue->lock);
+	return result;
+}
+
+int nqiv_queue_purge(nqiv_queue* queue, bool (*is_dead)(const void*))
+{
+	assert(queue != NULL);
+	assert(queue->array != NULL);
+	omp_set_lock(&queue->lock);
+	const int count = nqiv_array_get_units_count(queue->array);
+	const int unit_length = queue->array->unit_length;
+	char*     data = queue->array->data;
+	int       kept = 0;
+	int       idx;
+	for(idx = 0; idx < count; ++idx) {
+		if(is_dead(&data[idx * unit_length])) {
+			continue;
+		}
+		if(kept != idx) {
+			memcpy(&data[kept * unit_length], &data[idx * unit_length], unit_length);
+		}
+		kept += 1;
+	}
+	nqiv_array_remove_count(queue->array, kept, count - kept);
+	omp_unset_lock(&queue->lock);
+	if(count != kept) {
+		nqiv_log_write(queue->logger, NQIV_LOG_DEBUG, "Purged %d of %d entries from queue.\n",
+		               count - kept, count);
+	}
+	return count - kept;
+}
+
+void nqiv_ring_destroy(nqiv_ring* ring)
+{
+	if(ring == NULL) {
+		return;
+	}
+	if(ring->sequences != NULL) {
+		free(ring->sequences);
+	}
+	if(ring->data != NULL) {
+		free(ring->data);
+	}
+	memset(ring, 0, sizeof(nqiv_ring));
+}
+
+bool nqiv_ring_init(nqiv_ring* ring, nqiv_log_ctx* logger, const int unit_size, const int unit_count)
+{
+	if(ring == NULL) {
+		return false;
+	}
+	if(logger == NULL) {
+		return false;
+	}
+	if(unit_size <= 0 || unit_count <= 0 || unit_count > INT_MAX / 2) {
+		return false;
+	}
+	nqiv_ring_destroy(ring);
+	int capacity = 1;
+	while(capacity < unit_count) {
+		capacity *= 2;
+	}
+	ring->sequences = (SDL_atomic_t*)calloc(capacity, sizeof(SDL_atomic_t));
+	ring->data = (char*)calloc(capacity, unit_size);
+	if(ring->sequences == NULL || ring->data == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR,
+		               "Failed to allocate memory to create ring of %d %d-sized units\n.",
+		               capacity, unit_size);
+		nqiv_ring_destroy(ring);
+		return false;
+	}
+	int idx;
+	for(idx = 0; idx < capacity; ++idx) {
+		SDL_AtomicSet(&ring->sequences[idx], idx);
+	}
+	SDL_AtomicSet(&ring->head, 0);
+	SDL_AtomicSet(&ring->tail, 0);
+	ring->unit_size = unit_size;
+	ring->mask = capacity - 1;
+	nqiv_log_write(logger, NQIV_LOG_INFO, "Initialized ring of %d %d-sized units.\n", capacity,
+	               unit_size);
+	return true;
+}
+
+/* Positions wrap around, so they're compared by the sign of their unsigned difference. */
+int nqiv_ring_position_diff(const int a, const int b)
+{
+	return (int)((unsigned int)a - (unsigned int)b);
+}
+
+int nqiv_ring_position_add(const int a, const int b)
+{
+	return (int)((unsigned int)a + (unsigned int)b);
+}
+
+bool nqiv_ring_push(nqiv_ring* ring, const void* entry)
+{
+	assert(ring != NULL);
+	assert(ring->data != NULL);
+	assert(entry != NULL);
+	int position = SDL_AtomicGet(&ring->tail);
+	int cell;
+	while(true) {
+		cell = position & ring->mask;
+		const int diff =
+			nqiv_ring_position_diff(SDL_AtomicGet(&ring->sequences[cell]), position);
+		if(diff == 0) {
+			if(SDL_AtomicCAS(&ring->tail, position, nqiv_ring_position_add(position, 1))) {
+				break;
+			}
+		} else if(diff < 0) {
+			/* The cell still holds an entry from a lap ago. */
+			return false;
+		}
+		position = SDL_AtomicGet(&ring->tail);
+	}
+	memcpy(ring->data + (size_t)cell * ring->unit_size, entry, ring->unit_size);
+	SDL_AtomicSet(&ring->sequences[cell], nqiv_ring_position_add(position, 1));
+	return true;
+}
+
+bool nqiv_ring_pop(nqiv_ring* ring, void* entry)
+{
+	assert(ring != NULL);
+	assert(ring->data != NULL);
+	assert(entry != NULL);
+	int position = SDL_AtomicGet(&ring->head);
+	int cell;
+	while(true) {
+		cell = position & ring->mask;
+		const int diff = nqiv_ring_position_diff(SDL_AtomicGet(&ring->sequences[cell]),
+		                                         nqiv_ring_position_add(position, 1));
+		if(diff == 0) {
+			if(SDL_AtomicCAS(&ring->head, position, nqiv_ring_position_add(position, 1))) {
+				break;
+			}
+		} else if(diff < 0) {
+			/* The cell hasn't been written yet. */
+			return false;
+		}
+		position = SDL_AtomicGet(&ring->head);
+	}
+	memcpy(entry, ring->data + (size_t)cell * ring->unit_size, ring->unit_size);
+	SDL_AtomicSet(&ring->sequences[cell], nqiv_ring_position_add(position, ring->mask + 1));
+	return true;
+}
+
+bool nqiv_ring_is_empty(nqiv_ring* ring)
+{
+	assert(ring != NULL);
+	return SDL_AtomicGet(&ring->head) == SDL_AtomicGet(&ring->tail);
+}
+
+int nqiv_ring_get_count(nqiv_ring* ring)
+{
+	assert(ring != NULL);
+	const int count = nqiv_ring_position_diff(SDL_AtomicGet(&ring->tail), SDL_AtomicGet(&ring->head));
+	return count > 0 ? count : 0;
+}
+
 void nqiv_priority_queue_destroy(nqiv_priority_queue* queue)
 {
+	if(queue->wakeup_cond != NULL && !queue->shares_wakeup) {
+		SDL_DestroyCond(queue->wakeup_cond);
+	}
+	if(queue->wakeup_mutex != NULL && !queue->shares_wakeup) {
+		SDL_DestroyMutex(queue->wakeup_mutex);
+	}
+	if(queue->rings != NULL) {
+		int idx;
+		for(idx = 0; idx < queue->bin_count; ++idx) {
+			nqiv_ring_destroy(&(queue->rings[idx]));
+		}
+		free(queue->rings);
+	}
 	if(queue->bins != NULL) {
 		int idx;
 		for(idx = 0; idx < queue->bin_count; ++idx) {
@@ -137,6 +351,9 @@ void nqiv_priority_queue_destroy(nqiv_priority_queue* queue)
 		}
 		free(queue->bins);
 	}
+	if(queue->served_times != NULL) {
+		free(queue->served_times);
+	}
 	memset(queue, 0, sizeof(nqiv_priority_queue));
 }
 
@@ -149,15 +366,34 @@ bool nqiv_priority_queue_init(nqiv_priority_queue* queue,
 	if(queue == NULL) {
 		return false;
 	}
-	if(bin_count == 0) {
+	if(bin_count == 0 || bin_count > NQIV_PRIORITY_QUEUE_MAX_BINS) {
 		return false;
 	}
-	nqiv_priority_queue tmp;
+	nqiv_priority_queue tmp = {0};
 	tmp.bins = (nqiv_queue*)calloc(bin_count, sizeof(nqiv_queue));
 	if(tmp.bins == NULL) {
 		return false;
 	}
 	tmp.bin_count = bin_count;
+	tmp.rings = (nqiv_ring*)calloc(bin_count, sizeof(nqiv_ring));
+	if(tmp.rings == NULL) {
+		nqiv_priority_queue_destroy(&tmp);
+		return false;
+	}
+	tmp.served_times = (SDL_atomic_t*)calloc(bin_count, sizeof(SDL_atomic_t));
+	if(tmp.served_times == NULL) {
+		nqiv_priority_queue_destroy(&tmp);
+		return false;
+	}
+	tmp.wakeup_mutex = SDL_CreateMutex();
+	tmp.wakeup_cond = SDL_CreateCond();
+	if(tmp.wakeup_mutex == NULL || tmp.wakeup_cond == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR,
+		               "Failed to create priority queue wakeup primitives. SDL Error: %s\n",
+		               SDL_GetError());
+		nqiv_priority_queue_destroy(&tmp);
+		return false;
+	}
 	int idx;
 	for(idx = 0; idx < tmp.bin_count; ++idx) {
 		if(!nqiv_queue_init(&(tmp.bins[idx]), logger, unit_size, unit_count)) {
@@ -165,16 +401,168 @@ bool nqiv_priority_queue_init(nqiv_priority_queue* queue,
 			return false;
 		}
 	}
+	SDL_AtomicSet(&tmp.nonempty_bins, 0);
+	tmp.get_ticks = SDL_GetTicks64;
 	memcpy(queue, &tmp, sizeof(nqiv_priority_queue));
 	return true;
 }
 
+bool nqiv_priority_queue_set_fifo(nqiv_priority_queue* queue, const int level, const int unit_count)
+{
+	assert(queue != NULL);
+	assert(level >= 0);
+	assert(level < queue->bin_count);
+	assert(nqiv_ring_is_empty(&(queue->rings[level])));
+	return nqiv_ring_init(&(queue->rings[level]), queue->bins[level].logger,
+	                      queue->bins[level].array->unit_length, unit_count);
+}
+
+void nqiv_priority_queue_share_wakeup(nqiv_priority_queue* queue, nqiv_priority_queue* source)
+{
+	assert(queue != NULL);
+	assert(source != NULL);
+	assert(!source->shares_wakeup);
+	if(!queue->shares_wakeup) {
+		SDL_DestroyCond(queue->wakeup_cond);
+		SDL_DestroyMutex(queue->wakeup_mutex);
+	}
+	queue->wakeup_mutex = source->wakeup_mutex;
+	queue->wakeup_cond = source->wakeup_cond;
+	queue->shares_wakeup = true;
+}
+
+void nqiv_priority_queue_set_aging(nqiv_priority_queue* queue, const Uint32 interval)
+{
+	assert(queue != NULL);
+	const int now = (int)(Uint32)queue->get_ticks();
+	int       idx;
+	for(idx = 0; idx < queue->bin_count; ++idx) {
+		SDL_AtomicSet(&queue->served_times[idx], now);
+	}
+	queue->age_interval = interval;
+}
+
+void nqiv_priority_queue_set_clock(nqiv_priority_queue* queue, Uint64 (*get_ticks)(void))
+{
+	assert(queue != NULL);
+	assert(get_ticks != NULL);
+	queue->get_ticks = get_ticks;
+}
+
+/* Level of the bin, lowered by one for every interval it has waited since it was last served. */
+int nqiv_priority_queue_aged_level(nqiv_priority_queue* queue, const int level, const Uint32 now)
+{
+	/* Ticks are truncated, so wrapping is handled by unsigned subtraction. */
+	const Uint32 waited = now - (Uint32)SDL_AtomicGet(&queue->served_times[level]);
+	const Uint32 steps = waited / queue->age_interval;
+	return steps >= (Uint32)level ? 0 : level - (int)steps;
+}
+
+/* Bin to pop from next, or -1 if none may hold an entry. If given, aged_level is set to its aged
+ * level. */
+int nqiv_priority_queue_next_level(nqiv_priority_queue* queue, int* aged_level)
+{
+	const int    bits = SDL_AtomicGet(&queue->nonempty_bins);
+	const Uint32 now = queue->age_interval > 0 ? (Uint32)queue->get_ticks() : 0;
+	int          best = -1;
+	int          best_aged = -1;
+	int          idx;
+	for(idx = 0; idx < queue->bin_count; ++idx) {
+		if((bits & (1 << idx)) == 0) {
+			continue;
+		}
+		if(queue->age_interval == 0) {
+			best = idx;
+			best_aged = idx;
+			break;
+		}
+		const int aged = nqiv_priority_queue_aged_level(queue, idx, now);
+		/* Ties go to the actual level. */
+		if(best == -1 || aged < best_aged) {
+			best = idx;
+			best_aged = aged;
+		}
+	}
+	if(aged_level != NULL) {
+		*aged_level = best_aged;
+	}
+	return best;
+}
+
+void nqiv_priority_queue_signal(nqiv_priority_queue* queue)
+{
+	SDL_LockMutex(queue->wakeup_mutex);
+	SDL_CondSignal(queue->wakeup_cond);
+	SDL_UnlockMutex(queue->wakeup_mutex);
+}
+
+/* Wake as many waiters as there are new entries, if there are that many. */
+void nqiv_priority_queue_signal_count(nqiv_priority_queue* queue, const int count)
+{
+	SDL_LockMutex(queue->wakeup_mutex);
+	int idx;
+	for(idx = 0; idx < count; ++idx) {
+		SDL_CondSignal(queue->wakeup_cond);
+	}
+	SDL_UnlockMutex(queue->wakeup_mutex);
+}
+
+void nqiv_priority_queue_mark_nonempty(nqiv_priority_queue* queue, const int level)
+{
+	const int bit = 1 << level;
+	int       bits;
+	do {
+		bits = SDL_AtomicGet(&queue->nonempty_bins);
+		if((bits & bit) != 0) {
+			return;
+		}
+	} while(!SDL_AtomicCAS(&queue->nonempty_bins, bits, bits | bit));
+	/* The bin starts waiting now. */
+	if(queue->age_interval > 0) {
+		SDL_AtomicSet(&queue->served_times[level], (int)(Uint32)queue->get_ticks());
+	}
+}
+
+bool nqiv_priority_queue_level_is_empty(nqiv_priority_queue* queue, const int level)
+{
+	if(queue->rings[level].data != NULL && !nqiv_ring_is_empty(&(queue->rings[level]))) {
+		return false;
+	}
+	return nqiv_queue_is_empty(&(queue->bins[level]));
+}
+
+/* Returns false if a push raced with clearing the bit, and the bin isn't empty after all. */
+bool nqiv_priority_queue_mark_empty(nqiv_priority_queue* queue, const int level)
+{
+	const int bit = 1 << level;
+	int       bits;
+	do {
+		bits = SDL_AtomicGet(&queue->nonempty_bins);
+	} while(!SDL_AtomicCAS(&queue->nonempty_bins, bits, bits & ~bit));
+	if(!nqiv_priority_queue_level_is_empty(queue, level)) {
+		nqiv_priority_queue_mark_nonempty(queue, level);
+		return false;
+	}
+	return true;
+}
+
 bool nqiv_priority_queue_push(nqiv_priority_queue* queue, const int level, const void* entry)
 {
 	assert(queue != NULL);
 	assert(level >= 0);
 	assert(level < queue->bin_count);
-	return nqiv_queue_push(&(queue->bins[level]), entry);
+	bool result = false;
+	if(queue->rings[level].data != NULL) {
+		result = nqiv_ring_push(&(queue->rings[level]), entry);
+	}
+	if(!result) {
+		result = nqiv_queue_push(&(queue->bins[level]), entry);
+	}
+	if(result) {
+		nqiv_priority_queue_mark_nonempty(queue, level);
+		nqiv_priority_queue_signal(queue);
+	}
+	return result;
 }
 
 void nqiv_priority_queue_push_force(nqiv_priority_queue* queue, const int level, const void* entry)
@@ -182,25 +570,142 @@ void nqiv_priority_queue_push_force(nqiv_priority_queue* queue, const int level,
 	assert(queue != NULL);
 	assert(level >= 0);
 	assert(level < queue->bin_count);
-	nqiv_queue_push_force(&(queue->bins[level]), entry);
+	if(queue->rings[level].data == NULL || !nqiv_ring_push(&(queue->rings[level]), entry)) {
+		nqiv_queue_push_force(&(queue->bins[level]), entry);
+	}
+	nqiv_priority_queue_mark_nonempty(queue, level);
+	nqiv_priority_queue_signal(queue);
 }
 
-bool nqiv_priority_queue_pop_op(nqiv_priority_queue* queue,
-                                void*                entry,
-                                bool (*op)(nqiv_queue*, void*))
+bool nqiv_priority_queue_pop(nqiv_priority_queue* queue, void* entry)
 {
+	assert(queue != NULL);
+	while(true) {
+		const int idx = nqiv_priority_queue_next_level(queue, NULL);
+		if(idx == -1) {
+			return false;
+		}
+		/* The ring is drained first. Its bin only has entries if the ring overflowed. */
+		if((queue->rings[idx].data != NULL && nqiv_ring_pop(&(queue->rings[idx]), entry))
+		   || nqiv_queue_pop(&(queue->bins[idx]), entry)) {
+			if(queue->age_interval > 0) {
+				SDL_AtomicSet(&queue->served_times[idx], (int)(Uint32)queue->get_ticks());
+			}
+			return true;
+		}
+		/* Either the bin is marked empty, or something was pushed while we were looking and it
+		 * will be tried again. */
+		nqiv_priority_queue_mark_empty(queue, idx);
+	}
+}
+
+int nqiv_priority_queue_get_count(nqiv_priority_queue* queue)
+{
+	assert(queue != NULL);
+	int count = 0;
 	int idx;
 	for(idx = 0; idx < queue->bin_count; ++idx) {
-		if(op(&(queue->bins[idx]), entry)) {
-			return true;
+		if(queue->rings[idx].data != NULL) {
+			count += nqiv_ring_get_count(&(queue->rings[idx]));
 		}
+		count += nqiv_queue_get_count(&(queue->bins[idx]));
 	}
-	return false;
+	return count;
 }
 
-bool nqiv_priority_queue_pop(nqiv_priority_queue* queue, void* entry)
+int nqiv_priority_queue_first_level(nqiv_priority_queue* queue)
+{
+	assert(queue != NULL);
+	int aged_level;
+	nqiv_priority_queue_next_level(queue, &aged_level);
+	return aged_level;
+}
+
+bool nqiv_priority_queue_is_empty(nqiv_priority_queue* queue)
+{
+	assert(queue != NULL);
+	int idx;
+	for(idx = 0; idx < queue->bin_count; ++idx) {
+		if((SDL_AtomicGet(&queue->nonempty_bins) & (1 << idx)) != 0
+		   && (!nqiv_priority_queue_level_is_empty(queue, idx)
+		       || !nqiv_priority_queue_mark_empty(queue, idx))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int nqiv_priority_queue_purge(nqiv_priority_queue* queue, bool (*is_dead)(const void*))
+{
+	assert(queue != NULL);
+	int removed = 0;
+	int idx;
+	for(idx = 0; idx < queue->bin_count; ++idx) {
+		nqiv_ring* ring = &(queue->rings[idx]);
+		void*      entry = ring->data != NULL ? malloc(ring->unit_size) : NULL;
+		int        kept = 0;
+		if(entry != NULL) {
+			/* Only look at what's there now, so we don't chase entries we push back. */
+			const int count =
+				nqiv_ring_position_diff(SDL_AtomicGet(&ring->tail), SDL_AtomicGet(&ring->head));
+			int ridx;
+			for(ridx = 0; ridx < count && nqiv_ring_pop(ring, entry); ++ridx) {
+				if(is_dead(entry)) {
+					removed += 1;
+					continue;
+				}
+				if(!nqiv_ring_push(ring, entry)) {
+					nqiv_queue_push_force(&(queue->bins[idx]), entry);
+				}
+				kept += 1;
+			}
+			free(entry);
+		}
+		/* A pop may have found the ring empty and cleared the bin's bit while the survivors were
+		 * out of it, and waiters may have gone to sleep. */
+		if(kept > 0) {
+			nqiv_priority_queue_mark_nonempty(queue, idx);
+			nqiv_priority_queue_signal_count(queue, kept);
+		}
+		removed += nqiv_queue_purge(&(queue->bins[idx]), is_dead);
+	}
+	return removed;
+}
+
+bool nqiv_priority_queue_wait_many(nqiv_priority_queue* const* queues,
+                                   const int                   count,
+                                   const int                   timeout)
 {
-	return nqiv_priority_queue_pop_op(queue, entry, nqiv_queue_pop);
+	assert(queues != NULL);
+	assert(count > 0);
+	assert(timeout >= 0);
+	SDL_mutex* mutex = queues[0]->wakeup_mutex;
+	SDL_cond*  cond = queues[0]->wakeup_cond;
+	bool       empty = true;
+	bool       result = true;
+	/* Pushes signal while holding the wakeup mutex, so checking for emptiness under it means a
+	 * push can't slip in between the check and the wait. */
+	SDL_LockMutex(mutex);
+	int idx;
+	for(idx = 0; idx < count && empty; ++idx) {
+		assert(queues[idx]->wakeup_mutex == mutex);
+		empty = nqiv_priority_queue_is_empty(queues[idx]);
+	}
+	if(empty) {
+		if(timeout > 0) {
+			result = SDL_CondWaitTimeout(cond, mutex, timeout) == 0;
+		} else {
+			result = SDL_CondWait(cond, mutex) == 0;
+		}
+	}
+	SDL_UnlockMutex(mutex);
+	return result;
+}
+
+bool nqiv_priority_queue_wait(nqiv_priority_queue* queue, const int timeout)
+{
+	assert(queue != NULL);
+	return nqiv_priority_queue_wait_many(&queue, 1, timeout);
 }
 
 bool nqiv_queue_set_max_data_length(nqiv_queue* queue, const int count)
@@ -237,3 +742,176 @@ bool nqiv_priority_queue_set_min_add_count(nqiv_priority_queue* queue, const int
 {
 	return nqiv_priority_queue_apply_int(queue, nqiv_queue_set_min_add_count, count);
 }
+
+void nqiv_priority_queue_batch_destroy(nqiv_priority_queue_batch* batch)
+{
+	int idx;
+	for(idx = 0; idx < NQIV_PRIORITY_QUEUE_MAX_BINS; ++idx) {
+		if(batch->levels[idx] != NULL) {
+			nqiv_array_destroy(batch->levels[idx]);
+		}
+	}
+	if(batch->group != NULL) {
+		nqiv_array_destroy(batch->group);
+	}
+	if(batch->entry != NULL) {
+		free(batch->entry);
+	}
+	memset(batch, 0, sizeof(nqiv_priority_queue_batch));
+}
+
+bool nqiv_priority_queue_batch_init(nqiv_priority_queue_batch* batch,
+                                    nqiv_log_ctx*              logger,
+                                    const int                  unit_size)
+{
+	assert(batch != NULL);
+	assert(unit_size > 0);
+	nqiv_priority_queue_batch tmp = {0};
+	tmp.logger = logger;
+	tmp.unit_size = unit_size;
+	tmp.group = nqiv_array_create(unit_size, 1);
+	tmp.entry = malloc(sizeof(nqiv_priority_queue*) + unit_size);
+	if(tmp.group == NULL || tmp.entry == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR, "Failed to allocate priority queue batch.\n");
+		nqiv_priority_queue_batch_destroy(&tmp);
+		return false;
+	}
+	nqiv_array_unlimit_data(tmp.group);
+	memcpy(batch, &tmp, sizeof(nqiv_priority_queue_batch));
+	return true;
+}
+
+bool nqiv_priority_queue_batch_add(nqiv_priority_queue_batch* batch,
+                                   nqiv_priority_queue*       queue,
+                                   const int                  level,
+                                   const void*                entry)
+{
+	assert(batch != NULL);
+	assert(queue != NULL);
+	assert(level >= 0);
+	assert(level < queue->bin_count);
+	assert(entry != NULL);
+	const int record_size = (int)sizeof(nqiv_priority_queue*) + batch->unit_size;
+	if(batch->levels[level] == NULL) {
+		batch->levels[level] = nqiv_array_create(record_size, 1);
+		if(batch->levels[level] == NULL) {
+			nqiv_log_write(batch->logger, NQIV_LOG_ERROR,
+			               "Failed to allocate priority queue batch level %d.\n", level);
+			return false;
+		}
+		nqiv_array_unlimit_data(batch->levels[level]);
+	}
+	/* Records aren't necessarily aligned for either part, so they're only accessed by copying. */
+	char* record = batch->entry;
+	memcpy(record, &queue, sizeof(nqiv_priority_queue*));
+	memcpy(record + sizeof(nqiv_priority_queue*), entry, batch->unit_size);
+	if(!nqiv_array_push(batch->levels[level], record)) {
+		nqiv_log_write(batch->logger, NQIV_LOG_ERROR,
+		               "Failed to grow priority queue batch level %d.\n", level);
+		return false;
+	}
+	return true;
+}
+
+bool nqiv_priority_queue_batch_is_empty(nqiv_priority_queue_batch* batch)
+{
+	int idx;
+	for(idx = 0; idx < NQIV_PRIORITY_QUEUE_MAX_BINS; ++idx) {
+		if(batch->levels[idx] != NULL && nqiv_array_get_units_count(batch->levels[idx]) > 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Push the gathered group of entries to one bin. Returns the number pushed. */
+int nqiv_priority_queue_batch_push_group(nqiv_priority_queue_batch* batch,
+                                         nqiv_priority_queue*       queue,
+                                         const int                  level,
+                                         void (*failed)(const void*))
+{
+	const int count = nqiv_array_get_units_count(batch->group);
+	char*     entries = batch->group->data;
+	int       pushed = 0;
+	if(queue->rings[level].data != NULL) {
+		while(pushed < count
+		      && nqiv_ring_push(&(queue->rings[level]),
+		                        entries + (size_t)pushed * (size_t)batch->unit_size)) {
+			++pushed;
+		}
+	}
+	if(pushed < count) {
+		if(nqiv_queue_push_count(&(queue->bins[level]),
+		                         entries + (size_t)pushed * (size_t)batch->unit_size,
+		                         count - pushed)) {
+			pushed = count;
+		} else if(failed != NULL) {
+			int idx;
+			for(idx = pushed; idx < count; ++idx) {
+				memcpy(batch->entry, entries + (size_t)idx * (size_t)batch->unit_size,
+				       batch->unit_size);
+				failed(batch->entry);
+			}
+		}
+	}
+	if(pushed > 0) {
+		nqiv_priority_queue_mark_nonempty(queue, level);
+		nqiv_priority_queue_signal_count(queue, pushed);
+	}
+	return pushed;
+}
+
+bool nqiv_priority_queue_batch_submit(nqiv_priority_queue_batch* batch, void (*failed)(const void*))
+{
+	assert(batch != NULL);
+	const int record_size = (int)sizeof(nqiv_priority_queue*) + batch->unit_size;
+	bool      result = true;
+	int       level;
+	for(level = 0; level < NQIV_PRIORITY_QUEUE_MAX_BINS; ++level) {
+		nqiv_array* records = batch->levels[level];
+		if(records == NULL) {
+			continue;
+		}
+		const int count = nqiv_array_get_units_count(records);
+		char*     data = records->data;
+		int       first;
+		/* Gather everything for the queue of the first record left, and mark those records done
+		 * by clearing their queue. */
+		for(first = 0; first < count; ++first) {
+			nqiv_priority_queue* queue;
+			memcpy(&queue, data + (size_t)first * (size_t)record_size,
+			       sizeof(nqiv_priority_queue*));
+			if(queue == NULL) {
+				continue;
+			}
+			nqiv_array_clear(batch->group);
+			int idx;
+			for(idx = first; idx < count; ++idx) {
+				char*                record = data + (size_t)idx * (size_t)record_size;
+				nqiv_priority_queue* record_queue;
+				memcpy(&record_queue, record, sizeof(nqiv_priority_queue*));
+				if(record_queue != queue) {
+					continue;
+				}
+				memset(record, 0, sizeof(nqiv_priority_queue*));
+				if(!nqiv_array_push(batch->group, record + sizeof(nqiv_priority_queue*))) {
+					nqiv_log_write(batch->logger, NQIV_LOG_ERROR,
+					               "Failed to gather priority queue batch entry.\n");
+					memcpy(batch->entry, record + sizeof(nqiv_priority_queue*),
+					       batch->unit_size);
+					if(failed != NULL) {
+						failed(batch->entry);
+					}
+					result = false;
+				}
+			}
+			if(nqiv_array_get_units_count(batch->group) > 0
+			   && nqiv_priority_queue_batch_push_group(batch, queue, level, failed)
+			          < nqiv_array_get_units_count(batch->group)) {
+				result = false;
+			}
+		}
+		nqiv_array_clear(records);
+	}
+	return result;
+}
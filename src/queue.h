@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 
+#include <SDL2/SDL.h>
 #include <omp.h>
 
 #include "logging.h"
@@ -12,13 +13,51 @@
  * mutex lock for thread safe operation, and a logger for feedback. See array.h
  * for documentation related to how lengths and units are managed.
  *
+ * nqiv_ring is a bounded multi-producer, multi-consumer FIFO that takes no
+ * locks. Each cell carries a sequence number, which producers and consumers use
+ * to claim it with a single compare-and-swap on the tail or head position. Its
+ * capacity is rounded up to a power of two and never changes.
+ *
  * nqiv_priority_queue is backed by an array of nqiv_queue objects of unchanging
  * length. We will call these individual queues 'bins' and say individual
  * entries are sorted into them by priority. To retrieve an item from the
  * priority queue, the bins are iterated through from first and last, until one
  * of them returns an entry.
+ *
+ * By default, every bin is LIFO. nqiv_priority_queue_set_fifo gives a bin a
+ * lock-free ring, making it FIFO. If the ring fills, entries spill over to the
+ * locked bin behind it, which is drained after the ring. This must only be
+ * done before the queue is shared between threads.
+ *
+ * An atomic bitmap tracks which bins may hold entries, so finding work (or
+ * finding that there is none) skips empty bins without taking their locks. A
+ * bit is set after every push. It is cleared when a pop finds the bin empty,
+ * and set again if a push raced with clearing it.
+ *
+ * Bins may be made to age with nqiv_priority_queue_set_aging, so low priority
+ * entries are never starved by a steady stream of higher priority ones. Each bin
+ * remembers when it last became nonempty or was popped from. While it holds
+ * entries, its level is lowered by one for every interval that has passed
+ * since, down to 0. Bins are popped in order of these aged levels, and then of
+ * their actual ones.
+ *
+ * Entries may be collected in an nqiv_priority_queue_batch and pushed together,
+ * to any number of queues and levels. Each bin's lock is then taken once per
+ * submission rather than once per entry, and each queue's wakeup mutex is taken
+ * once to signal as many waiters as entries were pushed to it.
+ *
+ * The priority queue also carries a condition variable so consumers may block
+ * until something is pushed, instead of polling. Every successful push signals
+ * one waiter. nqiv_priority_queue_wait returns immediately if any bin holds
+ * an entry, otherwise it sleeps until signalled or until the timeout (in
+ * milliseconds, 0 to wait indefinitely) elapses. Several queues may share one
+ * queue's wakeup primitives, so a consumer can wait on all of them at once with
+ * nqiv_priority_queue_wait_many.
  */
 
+/* One bit for each bin in an SDL_atomic_t. */
+#define NQIV_PRIORITY_QUEUE_MAX_BINS 31
+
 typedef struct nqiv_queue
 {
 	omp_lock_t    lock;
@@ -26,12 +65,44 @@ typedef struct nqiv_queue
 	nqiv_log_ctx* logger;
 } nqiv_queue;
 
+typedef struct nqiv_ring
+{
+	SDL_atomic_t  head;      /* Position of the next entry to pop. */
+	SDL_atomic_t  tail;      /* Position of the next entry to push. */
+	SDL_atomic_t* sequences; /* For each cell, which position may claim it next. */
+	char*         data;
+	int           unit_size;
+	int           mask; /* Capacity minus one. */
+} nqiv_ring;
+
 typedef struct nqiv_priority_queue
 {
-	nqiv_queue* bins;
-	int         bin_count;
+	nqiv_queue*   bins;
+	nqiv_ring*    rings; /* Rings without data are unused, meaning their bin is LIFO. */
+	int           bin_count;
+	SDL_atomic_t  nonempty_bins; /* Bit for each bin that may hold an entry. */
+	SDL_mutex*    wakeup_mutex;  /* Guards waiting on wakeup_cond. */
+	SDL_cond*     wakeup_cond;   /* Signalled once for every push. */
+	bool          shares_wakeup; /* Wakeup primitives belong to another queue. */
+	/* For each bin, the low bits of get_ticks when it became nonempty or was last popped. */
+	SDL_atomic_t* served_times;
+	Uint32        age_interval; /* Milliseconds for a waiting bin to rise a level. 0 for none. */
+	Uint64 (*get_ticks)(void);  /* Milliseconds bins age by. SDL_GetTicks64 by default. */
 } nqiv_priority_queue;
 
+typedef struct nqiv_priority_queue_batch
+{
+	nqiv_log_ctx* logger;
+	int           unit_size;
+	/* For each level, entries to push, each preceded by a pointer to its queue. Created when first
+	 * needed. */
+	nqiv_array*   levels[NQIV_PRIORITY_QUEUE_MAX_BINS];
+	/* Entries of one queue and level, gathered to be pushed together. */
+	nqiv_array*   group;
+	/* For composing records, and copying entries out of them so they're suitably aligned. */
+	void*         entry;
+} nqiv_priority_queue_batch;
+
 void nqiv_queue_destroy(nqiv_queue* queue);
 bool nqiv_queue_init(nqiv_queue*   queue,
                      nqiv_log_ctx* logger,
@@ -39,8 +110,24 @@ bool nqiv_queue_init(nqiv_queue*   queue,
                      const int     unit_count);
 bool nqiv_queue_push(nqiv_queue* queue, const void* entry);
 void nqiv_queue_push_force(nqiv_queue* queue, const void* entry);
+/* Push count entries, laid out one after another, taking the lock once. Nothing is pushed on
+ * failure. */
+bool nqiv_queue_push_count(nqiv_queue* queue, const void* entries, const int count);
 bool nqiv_queue_pop(nqiv_queue* queue, void* entry);
 bool nqiv_queue_pop_front(nqiv_queue* queue, void* entry);
+bool nqiv_queue_is_empty(nqiv_queue* queue);
+int  nqiv_queue_get_count(nqiv_queue* queue);
+/* Remove every entry for which is_dead returns true, keeping the order of the rest. Returns the
+ * number removed. */
+int  nqiv_queue_purge(nqiv_queue* queue, bool (*is_dead)(const void*));
+
+void nqiv_ring_destroy(nqiv_ring* ring);
+bool nqiv_ring_init(nqiv_ring* ring, nqiv_log_ctx* logger, const int unit_size, const int unit_count);
+bool nqiv_ring_push(nqiv_ring* ring, const void* entry);
+bool nqiv_ring_pop(nqiv_ring* ring, void* entry);
+bool nqiv_ring_is_empty(nqiv_ring* ring);
+/* Only a snapshot while other threads use the ring. */
+int  nqiv_ring_get_count(nqiv_ring* ring);
 
 void nqiv_priority_queue_destroy(nqiv_priority_queue* queue);
 bool nqiv_priority_queue_init(nqiv_priority_queue* queue,
@@ -48,10 +135,48 @@ bool nqiv_priority_queue_init(nqiv_priority_queue* queue,
                               const int            unit_size,
                               const int            unit_count,
                               const int            bin_count);
+/* Make a bin FIFO, backed by a ring of at least unit_count entries. */
+bool nqiv_priority_queue_set_fifo(nqiv_priority_queue* queue, const int level, const int unit_count);
 bool nqiv_priority_queue_push(nqiv_priority_queue* queue, const int level, const void* entry);
 void nqiv_priority_queue_push_force(nqiv_priority_queue* queue, const int level, const void* entry);
 bool nqiv_priority_queue_pop(nqiv_priority_queue* queue, void* entry);
+/* Lowest aged level of the bins which may hold an entry, or -1 if none. Without aging, this is the
+ * lowest level which may hold an entry. */
+int  nqiv_priority_queue_first_level(nqiv_priority_queue* queue);
+/* Let bins age by a level every interval milliseconds. 0 to stop aging. */
+void nqiv_priority_queue_set_aging(nqiv_priority_queue* queue, const Uint32 interval);
+/* Age bins by get_ticks instead of SDL_GetTicks64, such as to test aging without waiting. Must be
+ * done before aging is set, and before the queue is shared between threads. */
+void nqiv_priority_queue_set_clock(nqiv_priority_queue* queue, Uint64 (*get_ticks)(void));
+/* Use the wakeup primitives of source, which must outlive the queue. */
+void nqiv_priority_queue_share_wakeup(nqiv_priority_queue* queue, nqiv_priority_queue* source);
+bool nqiv_priority_queue_is_empty(nqiv_priority_queue* queue);
+/* Number of entries in every bin. Only a snapshot while other threads use the queue. */
+int  nqiv_priority_queue_get_count(nqiv_priority_queue* queue);
+/* Like nqiv_queue_purge, for every bin. Ring entries are popped and the survivors pushed again, so
+ * they may be reordered with pushes made at the same time. */
+int  nqiv_priority_queue_purge(nqiv_priority_queue* queue, bool (*is_dead)(const void*));
+/* Returns true if the queue may have an entry, false on timeout. */
+bool nqiv_priority_queue_wait(nqiv_priority_queue* queue, const int timeout);
+/* Wait until any of the queues, which must share wakeup primitives, may have an entry. */
+bool nqiv_priority_queue_wait_many(nqiv_priority_queue* const* queues,
+                                   const int                   count,
+                                   const int                   timeout);
 bool nqiv_priority_queue_set_max_data_length(nqiv_priority_queue* queue, const int count);
 bool nqiv_priority_queue_set_min_add_count(nqiv_priority_queue* queue, const int count);
 
+void nqiv_priority_queue_batch_destroy(nqiv_priority_queue_batch* batch);
+bool nqiv_priority_queue_batch_init(nqiv_priority_queue_batch* batch,
+                                    nqiv_log_ctx*              logger,
+                                    const int                  unit_size);
+bool nqiv_priority_queue_batch_add(nqiv_priority_queue_batch* batch,
+                                   nqiv_priority_queue*       queue,
+                                   const int                  level,
+                                   const void*                entry);
+bool nqiv_priority_queue_batch_is_empty(nqiv_priority_queue_batch* batch);
+/* Push everything collected, in the order it was added for each queue and level, then empty the
+ * batch. Entries which could not be pushed are passed to failed, if given. Returns false if there
+ * were any. */
+bool nqiv_priority_queue_batch_submit(nqiv_priority_queue_batch* batch, void (*failed)(const void*));
+
 #endif /* NQIV_QUEUE_H */
@@ -274,17 +274,24 @@ bool nqiv_state_recreate_mark_texture(nqiv_state* state)
 
 bool nqiv_state_create_alpha_background_texture(nqiv_state* state)
 {
-	SDL_Rect window_rect;
-	window_rect.x = 0;
-	window_rect.y = 0;
-	window_rect.w = state->alpha_background_width;
-	window_rect.h = state->alpha_background_height;
-	if(!nqiv_create_alpha_background_texture(state, &window_rect,
-	                                         ((window_rect.x + window_rect.h) / 2)
-	                                             / ALPHA_BACKGROUND_CHECKER_PROPORTION,
+	SDL_Rect tile_rect;
+	tile_rect.x = 0;
+	tile_rect.y = 0;
+	tile_rect.w = ALPHA_BACKGROUND_TILE_CHECKERS;
+	tile_rect.h = ALPHA_BACKGROUND_TILE_CHECKERS;
+	if(!nqiv_create_alpha_background_texture(state, &tile_rect, 1,
 	                                         &state->texture_alpha_background)) {
 		return false;
 	}
+	/* Checks must stay sharp as they're scaled up. */
+	if(SDL_SetTextureScaleMode(state->texture_alpha_background, SDL_ScaleModeNearest) != 0) {
+		nqiv_log_write(&state->logger, NQIV_LOG_ERROR,
+		               "Failed to set alpha background scale mode. SDL Error: %s\n",
+		               SDL_GetError());
+		SDL_DestroyTexture(state->texture_alpha_background);
+		state->texture_alpha_background = NULL;
+		return false;
+	}
 	return true;
 }
 
@@ -337,9 +344,6 @@ bool nqiv_state_recreate_loading_texture(nqiv_state* state)
 
 bool nqiv_state_recreate_all_alpha_background_textures(nqiv_state* state)
 {
-	if(state->alpha_background_width == 0 || state->alpha_background_height == 0) {
-		return true;
-	}
 	SDL_Texture* old_alpha_background = state->texture_alpha_background;
 	state->texture_alpha_background = NULL;
 	nqiv_state_create_alpha_background_texture(state);
@@ -352,23 +356,3 @@ bool nqiv_state_recreate_all_alpha_background_textures(nqiv_state* state)
 	}
 	return true;
 }
-
-bool nqiv_state_update_alpha_background_dimensions(nqiv_state* state,
-                                                   const int   alpha_background_width,
-                                                   const int   alpha_background_height)
-{
-	if(alpha_background_width == state->alpha_background_width
-	   && alpha_background_height == state->alpha_background_height) {
-		return true;
-	}
-	const int old_alpha_background_width = state->alpha_background_width;
-	const int old_alpha_background_height = state->alpha_background_height;
-	state->alpha_background_width = alpha_background_width;
-	state->alpha_background_height = alpha_background_height;
-	if(!nqiv_state_recreate_all_alpha_background_textures(state)) {
-		state->alpha_background_width = old_alpha_background_width;
-		state->alpha_background_height = old_alpha_background_height;
-		return false;
-	}
-	return true;
-}
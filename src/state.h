@@ -17,23 +17,42 @@
 #include "queue.h"
 #include "cmd.h"
 #include "pruner.h"
+#include "worker.h"
+#include "governor.h"
+#include "atlas.h"
 
 #include <SDL2/SDL.h>
 #include <omp.h>
 
 /* Common, sufficient queue length in respective units. */
 #define STARTING_QUEUE_LENGTH 512
-/* Bins for thread priority queue. This is one bigger than necessary so preload events can be placed
- * after events for currently-displayed images. See nqiv_event_priority. */
-#define THREAD_QUEUE_BIN_COUNT 10
+/* Thumbnail loads are queued at one of this many levels, by how far they are from the selection.
+ * See nqiv_event_priority. */
+#define THREAD_QUEUE_THUMBNAIL_DISTANCES 8
+/* Bins for thread priority queue. See nqiv_event_priority. */
+#define THREAD_QUEUE_BIN_COUNT NQIV_EVENT_PRIORITY_COUNT
 /* min_add_count for thread queue bin arrays. It's pretty big to prevent a lot of reallocations. */
 #define THREAD_QUEUE_ADD_COUNT 10000
 /* Max length in units for thread queue bin arrays. Will influence max_data_length. If a queue
  * reaches this size, there's probably something wrong. */
 #define THREAD_QUEUE_MAX_LENGTH 1000000
-/* Used to calculate the dimensions of alpha background checks. Divided against average of window
- * width and height */
+/* Units in the lock-free ring of each FIFO thread queue bin. Anything beyond this spills over into
+ * the bin's array. */
+#define THREAD_QUEUE_RING_LENGTH 1024
+/* Thumbnail bins (including preloads) are FIFO so thumbnails load in the order they were drawn. The
+ * rest are LIFO. */
+#define THREAD_QUEUE_FIFO_START NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD
+/* Used to calculate the dimensions of alpha background checks. Divided against half the height of
+ * the background. */
 #define ALPHA_BACKGROUND_CHECKER_PROPORTION 32
+/* Checks across each side of the alpha background tile, which is drawn as many times as it takes to
+ * cover the background. Must be even, so tiles line up. */
+#define ALPHA_BACKGROUND_TILE_CHECKERS 64
+/* Refinements reach past the view on each side by its size divided by this, so they're still drawn
+ * while panning a little. */
+#define REFINE_MARGIN_PROPORTION 4
+/* Assumed refresh rate in Hz if the display's can't be found. */
+#define DEFAULT_REFRESH_RATE 60
 /* Sufficient for PATH_MAX and other info. */
 #define WINDOW_TITLE_LEN (1024 + PATH_MAX)
 
@@ -49,14 +68,16 @@ typedef enum nqiv_event_priority
 	NQIV_EVENT_PRIORITY_PRUNE = 3,
 	/* Loading a displayed image should be higher priority than thumbnails. */
 	NQIV_EVENT_PRIORITY_IMAGE_LOAD = 4,
-	/* Loading thumbnails from image data is slower than thumbnail files. Do it first. */
-	NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD_EPHEMERAL = 5,
-	/* First attempt to load a normal thumbnail file. */
-	NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD = 6,
+	/* Load thumbnails, from files or image data, starting with the selection and spiraling out. The
+	 * level is offset by nqiv_montage_get_distance, up to THREAD_QUEUE_THUMBNAIL_DISTANCES - 1. */
+	NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD = 5,
 	/* Then try to create the file if it's not available. */
-	NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_FAIL = 7,
-	/* Finally save a thumbnail we'll never even try to use. */
-	NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_NO = 8,
+	NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_FAIL =
+		NQIV_EVENT_PRIORITY_THUMBNAIL_LOAD + THREAD_QUEUE_THUMBNAIL_DISTANCES,
+	/* Finally save a thumbnail we'll never even try to use. Aging makes sure this still happens
+	 * while browsing keeps the levels above busy. */
+	NQIV_EVENT_PRIORITY_THUMBNAIL_SAVE_LOAD_NO,
+	NQIV_EVENT_PRIORITY_COUNT,
 } nqiv_event_priority;
 
 /* When we load an image, we can decide how to adjust the zoom for it. */
@@ -73,94 +94,182 @@ extern const char* const nqiv_zoom_default_names[];
 extern const char* const   nqiv_texture_scale_mode_names[];
 extern const SDL_ScaleMode nqiv_texture_scale_modes[];
 
+/* What was last drawn in a cell of the montage. A cell is only drawn again once something here
+ * changes. */
+typedef struct nqiv_montage_cell
+{
+	nqiv_image*  image;
+	/* Texture drawn for the image, whether its thumbnail, a fallback, or a loading or error
+	 * background. NULL if nothing. */
+	SDL_Texture* texture;
+	/* Slot of the texture, if it's an atlas. See nqiv_atlas_slot */
+	Uint64       slot;
+	SDL_Rect     dstrect;
+	bool         selected;
+	bool         marked;
+	/* The selection and mark boxes are yet to be drawn over it. See render_montage. */
+	bool         boxes_pending;
+} nqiv_montage_cell;
+
+/* Settings the whole montage is drawn with. If any change, every cell is drawn again. */
+typedef struct nqiv_montage_look
+{
+	int           width;
+	int           height;
+	int           thumbnail_size;
+	SDL_ScaleMode texture_scale_mode;
+	bool          show_loading_indicator;
+	bool          stretch_images;
+	SDL_Color     background_color;
+	SDL_Color     error_color;
+	SDL_Color     loading_color;
+	SDL_Color     selection_color;
+	SDL_Color     mark_color;
+	SDL_Color     alpha_checker_color_one;
+	SDL_Color     alpha_checker_color_two;
+} nqiv_montage_look;
+
 /* The central object. Contains everything else and some extra state used by the same loop. */
 struct nqiv_state
 {
-	nqiv_log_ctx         logger;
+	nqiv_log_ctx              logger;
 	/* Just used for record keeping so we can print the names of logging streams. */
-	nqiv_array*          logger_stream_names;
-	nqiv_image_manager   images;
-	nqiv_pruner          pruner;
-	nqiv_keybind_manager keybinds;
-	nqiv_keyrate_manager keystates;
-	nqiv_montage_state   montage;
-	nqiv_cmd_manager     cmds;
+	nqiv_array*               logger_stream_names;
+	nqiv_image_manager        images;
+	nqiv_pruner               pruner;
+	nqiv_keybind_manager      keybinds;
+	nqiv_keyrate_manager      keystates;
+	nqiv_montage_state        montage;
+	nqiv_cmd_manager          cmds;
 	/* Communicates events to workers. */
-	nqiv_priority_queue  thread_queue;
+	nqiv_priority_queue       thread_queue;
+	/* Worker-local queues alongside thread_queue. */
+	nqiv_worker_pool          worker_pool;
+	/* Communicates loads which read files to I/O workers, which pass them on to thread_queue. */
+	nqiv_priority_queue       io_thread_queue;
+	/* While batch_thread_events is set, events are collected here instead of sent one by one. */
+	nqiv_priority_queue_batch thread_batch;
+	bool                      batch_thread_events;
+	nqiv_worker_pool          io_worker_pool;
+	/* Adjusts the active workers of worker_pool and VIPS threads at runtime. */
+	nqiv_governor             governor;
 	/* Pending keyboard actions. */
-	nqiv_queue           key_actions;
+	nqiv_queue                key_actions;
 	/* Have we initialized SDL. If so, do special cleanup stuff. */
-	bool                 SDL_inited;
-	SDL_Window*          window;
-	SDL_Renderer*        renderer;
-	SDL_Texture*         texture_background;
+	bool                      SDL_inited;
+	SDL_Window*               window;
+	SDL_Renderer*             renderer;
+	SDL_Texture*              texture_background;
 	/* Box around selected montage thumbnail. */
-	SDL_Texture*         texture_montage_selection;
+	SDL_Texture*              texture_montage_selection;
 	/* Dashed box around marked montage thumbnail. */
-	SDL_Texture*         texture_montage_mark;
+	SDL_Texture*              texture_montage_mark;
 	/* While an image load is pending, show this in its place unless show_loading_indicator is
 	 * false. */
-	SDL_Texture*         texture_montage_unloaded_background;
+	SDL_Texture*              texture_montage_unloaded_background;
 	/* Shown in place of an image that fails to load. */
-	SDL_Texture*         texture_montage_error_background;
-	/* Background shown behind transparent image- may be checkered. */
-	SDL_Texture*         texture_alpha_background;
-	SDL_ScaleMode        texture_scale_mode;
-	/* Track dimensions of alpha background, since they may need to be updated. */
-	int                  alpha_background_width;
-	int                  alpha_background_height;
+	SDL_Texture*              texture_montage_error_background;
+	/* Background shown behind transparent image- may be checkered. A tile with a pixel per check,
+	 * scaled up to the size of the checks. */
+	SDL_Texture*              texture_alpha_background;
+	/* The montage is kept drawn here, and only the cells which changed are drawn again. See
+	 * render_montage. */
+	SDL_Texture*              texture_montage;
+	nqiv_montage_cell*        montage_cells;
+	int                       montage_cell_count;
+	nqiv_montage_look         montage_look;
+	/* Is texture_montage what's on display? If not, it's drawn entirely again and presented. */
+	bool                      montage_shown;
+	/* Texture drawn for an image by the last render_from_form. See nqiv_montage_cell */
+	SDL_Texture*              drawn_texture;
+	Uint64                    drawn_slot;
+	/* Thumbnail textures are kept in atlases. */
+	nqiv_atlas_manager        atlases;
+	SDL_ScaleMode             texture_scale_mode;
+	/* Milliseconds the view of an image must stay the same before it's refined. 0 to never
+	 * refine. See nqiv_image_refinement */
+	int                       refine_delay;
+	/* SDL ticks when the refinement of the current view is due to be asked for. 0 if none is
+	 * waiting. */
+	Uint64                    refine_time;
 	/* SDL events returned to master from workers. */
-	Uint32               thread_event_number;
+	Uint32                    thread_event_number;
+	/* The master handles all queued events before rendering once for them. Renders asked for
+	 * meanwhile are put off, with their arguments combined. Renders are limited to the display's
+	 * refresh rate, as of time_of_last_render, unless presenting waits for vsync anyway. */
+	bool                      defer_render;
+	bool                      render_pending;
+	bool                      render_pending_first;
+	bool                      render_pending_hard;
+	Uint64                    time_of_last_render;
+	bool                      render_vsync;
+	/* Whether SDL fell back to drawing without a GPU. Scaling is slow there, so as little of it as
+	 * possible is left to SDL. */
+	bool                      render_software;
 	/* SDL events returned to master from configuration. */
-	Uint32               cfg_event_number;
-	/* Number of worker threads. */
-	int                  thread_count;
+	Uint32                    cfg_event_number;
+	/* Number of worker threads. The governor keeps at least thread_min_count of them active. */
+	int                       thread_count;
+	int                       thread_min_count;
+	/* Milliseconds between governor updates. 0 to keep all workers active. */
+	int                       governor_interval;
+	/* Number of worker threads reading files ahead of the others. 0 for none. */
+	int                       io_thread_count;
 	/* Threads will update the master after processing this many events. 0 to process all. */
-	int                  thread_event_interval;
-	int                  vips_threads;
-	/* The transaction group of an event is compared against this, protected by a mutex lock. If the
-	 * event is less than the current number, it is considered out of date and discarded. An event
-	 * with a transaction group of -1 is never out of date. This feature primarily exists to solve
-	 * the problem of events still being queued for images that are no longer visible. */
-	int64_t              thread_event_transaction_group;
+	int                       thread_event_interval;
+	/* Milliseconds for queued events to rise a priority level while waiting. 0 for no aging. */
+	int                       thread_aging_interval;
+	/* Scheduling priority of worker threads. See nqiv_set_thread_background. */
+	int                       thread_niceness;
+	bool                      thread_idle;
+	/* Most worker threads active while the window is in the background. 0 for no limit. */
+	int                       thread_background_count;
+	/* Processor the master thread is pinned to, and which worker threads are kept off. -1 for
+	 * none. */
+	int                       thread_master_cpu;
+	int                       vips_threads;
 	/* In SDL ticks (milliseconds) Check if prune_delay has passed for each render_and_update */
-	Uint64               time_of_last_prune;
-	Uint64               prune_delay;
+	Uint64                    time_of_last_prune;
+	Uint64                    prune_delay;
 	/* Wait on an SDL event this long before timing out, allowing housekeeping tasks (such as
 	 * pruning) to be performed. */
-	int                  event_timeout;
-	/* Base amount worker threads sleep between updates. */
-	int                  extra_wakeup_delay;
-	omp_lock_t           thread_event_transaction_group_lock;
+	int                       event_timeout;
+	/* Longest worker threads sleep waiting on the queue before checking it anyway. 0 for no cap. */
+	int                       extra_wakeup_delay;
 	/* Used to tell when the display needs to be redrawn. */
-	bool                 render_cleared;
+	bool                      render_cleared;
+	/* Is the window hidden or minimized? Then, nothing is drawn or loaded to be drawn until it's
+	 * shown again. */
+	bool                      window_hidden;
+	/* Does the window have input focus? If not, or it's hidden, it's in the background. */
+	bool                      window_focused;
 	/* Is montage mode? Otherwise image mode. */
-	bool                 in_montage;
+	bool                      in_montage;
 	/* Try to fill entire display area with image, disregarding aspect ratio. */
-	bool                 stretch_images;
+	bool                      stretch_images;
 	/* Used to handle edge case of first frame being passed, but not being rendered yet. Otherwise,
 	 * zoom defaults may not be set. */
-	bool                 first_frame_pending;
-	nqiv_zoom_default    zoom_default;
+	bool                      first_frame_pending;
+	nqiv_zoom_default         zoom_default;
 	/* Should we pan the image according to mouse motion right now? */
-	bool                 is_mouse_panning;
+	bool                      is_mouse_panning;
 	/* If we get an image bigger than the max texture size, just shrink the entire thing once, and
 	 * use that. */
-	bool                 no_resample_oversized;
-	bool                 show_loading_indicator;
+	bool                      no_resample_oversized;
+	bool                      show_loading_indicator;
 	/* Are we currently waiting for an image to load or render? */
-	bool                 is_loading;
-	SDL_Color            background_color;
-	SDL_Color            error_color;
-	SDL_Color            loading_color;
-	SDL_Color            selection_color;
-	SDL_Color            mark_color;
-	SDL_Color            alpha_checker_color_one;
-	SDL_Color            alpha_checker_color_two;
+	bool                      is_loading;
+	SDL_Color                 background_color;
+	SDL_Color                 error_color;
+	SDL_Color                 loading_color;
+	SDL_Color                 selection_color;
+	SDL_Color                 mark_color;
+	SDL_Color                 alpha_checker_color_one;
+	SDL_Color                 alpha_checker_color_two;
 	/* Whether to quit if the command parser has an error parsing or storing values. Otherwise
 	 * attempt to continue. */
-	bool                 cmd_parse_error_quit;
-	bool                 cmd_apply_error_quit;
+	bool                      cmd_parse_error_quit;
+	bool                      cmd_apply_error_quit;
 };
 
 /* Check if logger has error message. If it does, print it and return false. */
@@ -176,9 +285,6 @@ bool              nqiv_state_create_mark_texture(nqiv_state* state);
 bool              nqiv_state_recreate_mark_texture(nqiv_state* state);
 bool              nqiv_state_create_alpha_background_texture(nqiv_state* state);
 bool              nqiv_state_recreate_all_alpha_background_textures(nqiv_state* state);
-bool              nqiv_state_update_alpha_background_dimensions(nqiv_state* state,
-                                                                const int   alpha_background_width,
-                                                                const int   alpha_background_height);
 bool              nqiv_state_create_single_color_texture(nqiv_state*      state,
                                                          const SDL_Color* color,
                                                          SDL_Texture**    texture);
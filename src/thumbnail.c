@@ -285,7 +285,24 @@ bool nqiv_thumbnail_create(nqiv_image* image)
 	memcpy(tmppath, image->thumbnail.path, pathlen);
 	memcpy(tmppath + pathlen, ".tmp", nqiv_strlen(".tmp"));
 	assert(strlen(tmppath) == pathlen + 4);
-	if(vips_pngsave(image->thumbnail.vips, tmppath, NULL) == -1) {
+	/* Saving computes the thumbnail from the whole image. Watch a private copy, so the thumbnail
+	 * itself is still usable if it's killed. */
+	VipsImage* save_vips;
+	if(vips_copy(image->thumbnail.vips, &save_vips, NULL) == -1) {
+		nqiv_log_vips_exception(image->parent->logger, image, &image->image);
+		return false;
+	}
+	nqiv_image_vips_watch watch;
+	nqiv_image_vips_watch_start(&watch, image, save_vips);
+	const int save_result = vips_pngsave(save_vips, tmppath, NULL);
+	const bool killed = nqiv_image_vips_watch_finish(&watch, &image->thumbnail);
+	g_object_unref(save_vips);
+	if(killed) {
+		vips_error_clear();
+		g_remove(tmppath);
+		return false;
+	}
+	if(save_result == -1) {
 		nqiv_log_vips_exception(image->parent->logger, image, &image->image);
 		return false;
 	}
@@ -5,8 +5,11 @@
  * files, as well as some other circularly-shared things. This file should not include any other
  * nqiv file and should be included before the circularly referenced elements are needed. */
 
-typedef struct nqiv_cmd_manager nqiv_cmd_manager;
-typedef struct nqiv_state       nqiv_state;
+typedef struct nqiv_cmd_manager       nqiv_cmd_manager;
+typedef struct nqiv_state             nqiv_state;
+typedef struct nqiv_image             nqiv_image;
+typedef struct nqiv_image_form_decode nqiv_image_form_decode;
+typedef struct nqiv_atlas_manager     nqiv_atlas_manager;
 
 /* Standard return value for functions that need to report a more precise status than true or false.
  * These values should be 'truthy' though, evaluating as booleans would. */
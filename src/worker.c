@@ -1,4 +1,9 @@
+#include "platform.h"
+
+#include <stdlib.h>
+#include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #include <SDL2/SDL.h>
@@ -10,10 +15,17 @@
 #include "thumbnail.h"
 #include "worker.h"
 
-void nqiv_worker_handle_image_load_form(const nqiv_event_image_load_form_options* options,
+/* Read size for prefetching files in I/O workers. */
+#define NQIV_WORKER_PREFETCH_BUFFER_SIZE (256 * 1024)
+
+/* Returns true if decoding the surface of the form was started, to be finished once the image is
+ * unlocked. */
+bool nqiv_worker_handle_image_load_form(const nqiv_event_image_load_form_options* options,
                                         nqiv_image*                               image,
-                                        nqiv_image_form*                          form)
+                                        nqiv_image_form*                          form,
+                                        nqiv_image_form_decode*                   decode)
 {
+	bool decoding = false;
 	if(options->unload) {
 		if(options->surface || (options->surface_soft && form->texture != NULL)) {
 			nqiv_unload_image_form_surface(form);
@@ -22,8 +34,9 @@ void nqiv_worker_handle_image_load_form(const nqiv_event_image_load_form_options
 			nqiv_unload_image_form_vips(form);
 		}
 	} else {
-		if(form->texture != NULL) {
-			return;
+		/* Another worker is already decoding it. */
+		if(form->texture != NULL || form->decoding) {
+			return false;
 		}
 		bool success = true;
 		if(options->vips || options->vips_soft) {
@@ -69,14 +82,17 @@ void nqiv_worker_handle_image_load_form(const nqiv_event_image_load_form_options
 			if(form->surface != NULL) {
 				if(options->surface) {
 					nqiv_unload_image_form_surface(form);
-					success = nqiv_image_load_surface(image, form);
+					decoding = true;
 				}
 			} else {
-				success = nqiv_image_load_surface(image, form);
+				decoding = true;
 			}
 		}
-		(void)success;
+		if(decoding) {
+			nqiv_image_form_decode_start(decode, form);
+		}
 	}
+	return decoding;
 }
 
 void nqiv_worker_handle_image_load_form_clear_error(
@@ -87,39 +103,358 @@ void nqiv_worker_handle_image_load_form_clear_error(
 	}
 }
 
-void nqiv_worker_main(nqiv_log_ctx*        logger,
-                      nqiv_priority_queue* queue,
-                      const int            delay_base,
-                      const int            event_interval,
-                      const Uint32         event_code,
-                      const int64_t*       transaction_group,
-                      omp_lock_t*          transaction_group_lock)
+bool nqiv_worker_pool_init(nqiv_worker_pool*    pool,
+                           nqiv_log_ctx*        logger,
+                           nqiv_priority_queue* shared,
+                           nqiv_priority_queue* locals,
+                           const int            count)
+{
+	assert(pool != NULL);
+	assert(shared != NULL);
+	assert(count > 0);
+	const int             queue_count = locals != NULL ? count + 1 : 1;
+	nqiv_priority_queue** queues = calloc(queue_count, sizeof(nqiv_priority_queue*));
+	SDL_mutex*            park_mutex = SDL_CreateMutex();
+	SDL_cond*             park_cond = SDL_CreateCond();
+	if(queues == NULL || park_mutex == NULL || park_cond == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR, "Failed to allocate worker pool of %d.\n", count);
+		if(queues != NULL) {
+			free(queues);
+		}
+		if(park_mutex != NULL) {
+			SDL_DestroyMutex(park_mutex);
+		}
+		if(park_cond != NULL) {
+			SDL_DestroyCond(park_cond);
+		}
+		return false;
+	}
+	queues[0] = shared;
+	int idx;
+	for(idx = 1; idx < queue_count; ++idx) {
+		nqiv_priority_queue_share_wakeup(&locals[idx - 1], shared);
+		queues[idx] = &locals[idx - 1];
+	}
+	pool->shared = shared;
+	pool->locals = locals;
+	pool->queues = queues;
+	pool->queue_count = queue_count;
+	pool->count = count;
+	pool->park_mutex = park_mutex;
+	pool->park_cond = park_cond;
+	SDL_AtomicSet(&pool->active_count, count);
+	SDL_AtomicSet(&pool->processed, 0);
+	SDL_AtomicSet(&pool->wake_pending, 0);
+	pool->niceness = 0;
+	pool->idle = false;
+	nqiv_log_write(logger, NQIV_LOG_DEBUG, "Created worker pool of %d.\n", count);
+	return true;
+}
+
+void nqiv_worker_pool_destroy(nqiv_worker_pool* pool)
+{
+	if(pool->locals != NULL) {
+		int idx;
+		for(idx = 0; idx < pool->count; ++idx) {
+			nqiv_priority_queue_destroy(&pool->locals[idx]);
+		}
+		free(pool->locals);
+	}
+	if(pool->queues != NULL) {
+		free(pool->queues);
+	}
+	if(pool->park_cond != NULL) {
+		SDL_DestroyCond(pool->park_cond);
+	}
+	if(pool->park_mutex != NULL) {
+		SDL_DestroyMutex(pool->park_mutex);
+	}
+	memset(pool, 0, sizeof(nqiv_worker_pool));
+}
+
+void nqiv_worker_pool_set_active(nqiv_worker_pool* pool, const int active_count)
+{
+	assert(active_count >= 1);
+	assert(active_count <= pool->count);
+	SDL_LockMutex(pool->park_mutex);
+	SDL_AtomicSet(&pool->active_count, active_count);
+	SDL_CondBroadcast(pool->park_cond);
+	SDL_UnlockMutex(pool->park_mutex);
+}
+
+int nqiv_worker_pool_get_active(nqiv_worker_pool* pool)
+{
+	return SDL_AtomicGet(&pool->active_count);
+}
+
+int nqiv_worker_pool_get_backlog(nqiv_worker_pool* pool)
+{
+	int backlog = 0;
+	int idx;
+	for(idx = 0; idx < pool->queue_count; ++idx) {
+		backlog += nqiv_priority_queue_get_count(pool->queues[idx]);
+	}
+	return backlog;
+}
+
+bool nqiv_worker_pool_wake_master(nqiv_worker_pool* pool,
+                                  nqiv_log_ctx*     logger,
+                                  const Uint32      event_code)
+{
+	if(!SDL_AtomicCAS(&pool->wake_pending, 0, 1)) {
+		return true;
+	}
+	SDL_Event wake = {0};
+	wake.type = SDL_USEREVENT;
+	wake.user.code = (Sint32)event_code;
+	if(SDL_PushEvent(&wake) < 0) {
+		SDL_AtomicSet(&pool->wake_pending, 0);
+		nqiv_log_write(logger, NQIV_LOG_ERROR,
+		               "Failed to send SDL event from thread %d. SDL Error: %s\n",
+		               omp_get_thread_num(), SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+void nqiv_worker_pool_consume_wake(nqiv_worker_pool* pool)
+{
+	/* Anything finished after this point sends a new wakeup, so nothing is missed by the redraw
+	 * which follows. */
+	SDL_AtomicSet(&pool->wake_pending, 0);
+}
+
+void nqiv_worker_apply_scheduling(nqiv_log_ctx* logger, nqiv_worker_pool* pool)
+{
+	if((pool->niceness > 0 || pool->idle)
+	   && !nqiv_set_thread_background(pool->niceness, pool->idle)) {
+		nqiv_log_write(logger, NQIV_LOG_WARNING,
+		               "Failed to lower the scheduling priority of thread %d.\n",
+		               omp_get_thread_num());
+	}
+}
+
+/* Block while the worker is parked. Returns true if it was. */
+bool nqiv_worker_pool_park(nqiv_worker_pool* pool, const int worker_index)
+{
+	if(worker_index < SDL_AtomicGet(&pool->active_count)) {
+		return false;
+	}
+	SDL_LockMutex(pool->park_mutex);
+	while(worker_index >= SDL_AtomicGet(&pool->active_count)) {
+		SDL_CondWait(pool->park_cond, pool->park_mutex);
+	}
+	SDL_UnlockMutex(pool->park_mutex);
+	return true;
+}
+
+nqiv_priority_queue* nqiv_worker_pool_get_queue(nqiv_worker_pool* pool, nqiv_image* image)
+{
+	/* Parked workers would leave it to be stolen, so don't bother. */
+	const int worker = SDL_AtomicGet(&image->worker) - 1;
+	if(pool->locals != NULL && worker >= 0 && worker < SDL_AtomicGet(&pool->active_count)) {
+		return &pool->locals[worker];
+	}
+	return pool->shared;
+}
+
+/* Decode the surface of a form and publish it to the image. */
+void nqiv_worker_run_decode(nqiv_image* image, nqiv_image_form_decode* decode)
+{
+	nqiv_image_form_decode_run(image, decode);
+	nqiv_image_lock(image);
+	nqiv_image_form_decode_finish(image, decode);
+	nqiv_image_manager_list_loaded(image->parent, image);
+	nqiv_image_unlock(image);
+}
+
+/* Send a job to finish the decode started by the load event. If it can't be sent, the decode is
+ * run right away instead. */
+void nqiv_worker_send_decode(nqiv_log_ctx*                 logger,
+                             nqiv_worker_pool*             pool,
+                             const nqiv_event*             load,
+                             const nqiv_image_form_decode* decode)
+{
+	nqiv_image* image = load->options.image_load.image;
+	nqiv_event  event = {0};
+	event.type = NQIV_EVENT_FORM_DECODE;
+	/* The selection moving changes which loads come first, but it doesn't make a decode any less
+	 * worth finishing. */
+	event.lifetime = load->lifetime == NQIV_EVENT_LIFETIME_SELECTION ? NQIV_EVENT_LIFETIME_INTEREST
+	                                                                 : load->lifetime;
+	event.generation = load->generation;
+	event.level = load->level;
+	event.options.form_decode.image = image;
+	event.options.form_decode.decode = malloc(sizeof(nqiv_image_form_decode));
+	if(event.options.form_decode.decode != NULL) {
+		memcpy(event.options.form_decode.decode, decode, sizeof(nqiv_image_form_decode));
+		if(nqiv_priority_queue_push(nqiv_worker_pool_get_queue(pool, image), event.level,
+		                            &event)) {
+			return;
+		}
+		free(event.options.form_decode.decode);
+	}
+	nqiv_log_write(logger, NQIV_LOG_WARNING,
+	               "Failed to send decode job from thread %d. Decoding right away.\n",
+	               omp_get_thread_num());
+	nqiv_image_form_decode decode_copy;
+	memcpy(&decode_copy, decode, sizeof(nqiv_image_form_decode));
+	nqiv_worker_run_decode(image, &decode_copy);
+}
+
+bool nqiv_worker_form_options_read_files(const nqiv_event_image_load_form_options* options)
+{
+	return !options->unload && (options->vips || options->vips_soft);
+}
+
+bool nqiv_worker_event_reads_files(const nqiv_event* event)
+{
+	if(event->type != NQIV_EVENT_IMAGE_LOAD) {
+		return false;
+	}
+	const nqiv_event_image_load_options* options = &event->options.image_load;
+	return options->create_thumbnail
+	       || nqiv_worker_form_options_read_files(&options->image_options)
+	       || nqiv_worker_form_options_read_files(&options->thumbnail_options);
+}
+
+/* Read the whole file so later reads are served from the page cache. */
+bool nqiv_worker_prefetch_file(const char* path, char* buffer, const size_t buffer_size)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		return false;
+	}
+	while(fread(buffer, 1, buffer_size, file) == buffer_size) {
+	}
+	const bool success = ferror(file) == 0;
+	fclose(file);
+	return success;
+}
+
+void nqiv_worker_prefetch_event(const nqiv_event_image_load_options* options,
+                                char*                                buffer,
+                                const size_t                         buffer_size)
+{
+	nqiv_image* image = options->image;
+	/* If a worker is already loading it, its files are already being read. */
+	if(!nqiv_image_test_lock(image)) {
+		return;
+	}
+	bool  read_image = nqiv_worker_form_options_read_files(&options->image_options)
+	                   && image->image.vips == NULL;
+	bool  read_thumbnail = (nqiv_worker_form_options_read_files(&options->thumbnail_options)
+	                        && image->thumbnail.vips == NULL)
+	                       || (options->create_thumbnail && !image->thumbnail_attempted);
+	char* thumbnail_path = NULL;
+	if(read_thumbnail && image->parent->thumbnail.load && image->parent->thumbnail.root != NULL) {
+		if(image->thumbnail.path != NULL) {
+			const size_t path_size = strlen(image->thumbnail.path) + 1;
+			thumbnail_path = malloc(path_size);
+			if(thumbnail_path != NULL) {
+				memcpy(thumbnail_path, image->thumbnail.path, path_size);
+			}
+		} else {
+			nqiv_thumbnail_calculate_path(image, &thumbnail_path, false);
+		}
+	}
+	nqiv_image_unlock(image);
+	/* Without a thumbnail file, the thumbnail is made from the image. */
+	if(read_thumbnail
+	   && (thumbnail_path == NULL
+	       || !nqiv_worker_prefetch_file(thumbnail_path, buffer, buffer_size))) {
+		read_image = true;
+	}
+	if(read_image) {
+		nqiv_worker_prefetch_file(image->image.path, buffer, buffer_size);
+	}
+	free(thumbnail_path);
+}
+
+/* Pop the highest priority event from the pool. Ties go to the worker's own queue, then the shared
+ * one, then the other workers in turn, starting after this one so thieves spread out. */
+bool nqiv_worker_pool_pop(nqiv_worker_pool* pool, const int worker_index, nqiv_event* event)
+{
+	if(pool->locals == NULL) {
+		return nqiv_priority_queue_pop(pool->shared, event);
+	}
+	while(true) {
+		nqiv_priority_queue* best = NULL;
+		int                  best_level = -1;
+		int                  idx;
+		for(idx = -1; idx < pool->count; ++idx) {
+			nqiv_priority_queue* queue;
+			if(idx == -1) {
+				queue = &pool->locals[worker_index];
+			} else if(idx == 0) {
+				queue = pool->shared;
+			} else {
+				const int other = (worker_index + idx) % pool->count;
+				queue = &pool->locals[other];
+			}
+			const int level = nqiv_priority_queue_first_level(queue);
+			if(level != -1 && (best == NULL || level < best_level)) {
+				best = queue;
+				best_level = level;
+			}
+		}
+		if(best == NULL) {
+			return false;
+		}
+		/* Someone else may have taken it first. Look again. */
+		if(nqiv_priority_queue_pop(best, event)) {
+			return true;
+		}
+	}
+}
+
+void nqiv_worker_main(nqiv_log_ctx*     logger,
+                      nqiv_worker_pool* pool,
+                      const int         worker_index,
+                      const int         delay_base,
+                      const int         event_interval,
+                      const Uint32      event_code)
 {
-	/* Stagger events by their thread num to prevent stampeding herd problems. */
-	int  wait_time = delay_base + omp_get_thread_num();
+	assert(worker_index >= 0);
+	assert(worker_index < pool->count);
+	/* Workers block until the queue is pushed to. delay_base only caps how long they may sleep, and
+	 * is staggered by thread num to prevent stampeding herd problems. 0 means no cap. */
+	const int wait_time = delay_base > 0 ? delay_base + omp_get_thread_num() : 0;
 	bool running = true;
 	int  events_processed = 0;
+	nqiv_worker_apply_scheduling(logger, pool);
 	while(running) {
 		nqiv_event event = {0};
 		bool       event_found = false;
+		/* Only park once the master has been told about everything processed. */
+		if(events_processed == 0 && nqiv_worker_pool_park(pool, worker_index)) {
+			nqiv_log_write(logger, NQIV_LOG_DEBUG, "Unparked thread %d.\n", omp_get_thread_num());
+		}
 		/* Find valid events */
 		if(events_processed < event_interval || event_interval == 0) {
 			while(true) {
-				event_found = nqiv_priority_queue_pop(queue, &event);
-				if(!event_found || event.transaction_group == -1) {
+				event_found = nqiv_worker_pool_pop(pool, worker_index, &event);
+				if(!event_found) {
 					break;
 				}
-				omp_set_lock(transaction_group_lock);
-				if(event.transaction_group >= *transaction_group) {
-					omp_unset_lock(transaction_group_lock);
-					break;
-					/* NOOP */
+				/* A stale event gives up what it holds, without taking the pending options a
+				 * current one may need. */
+				if(!nqiv_image_event_is_current(&event)) {
+					nqiv_image_event_discard(&event);
+					continue;
 				}
-				omp_unset_lock(transaction_group_lock);
+				/* Another event for the same image already took the pending options. */
+				if(event.type == NQIV_EVENT_IMAGE_LOAD && event.options.image_load.pending
+				   && !nqiv_image_take_pending_load(event.options.image_load.image, &event)) {
+					event_found = false;
+					continue;
+				}
+				break;
 			}
 		}
 		if(event_found) {
 			events_processed += 1;
+			SDL_AtomicAdd(&pool->processed, 1);
 			switch(event.type) {
 			case NQIV_EVENT_WORKER_STOP:
 				nqiv_log_write(logger, NQIV_LOG_DEBUG, "Received stop event on thread %d.\n",
@@ -130,6 +465,8 @@ void nqiv_worker_main(nqiv_log_ctx*        logger,
 				{
 					nqiv_event_image_load_options* image_load = &event.options.image_load;
 					nqiv_image*                    image = image_load->image;
+					nqiv_image_form_decode         image_decode;
+					nqiv_image_form_decode         thumbnail_decode;
 					nqiv_log_write(logger, NQIV_LOG_DEBUG,
 					               "Received image load event on thread %d.\n",
 					               omp_get_thread_num());
@@ -147,8 +484,8 @@ void nqiv_worker_main(nqiv_log_ctx*        logger,
 						               image->image.path);
 						image->thumbnail_attempted = true;
 					}
-					nqiv_worker_handle_image_load_form(&image_load->image_options, image,
-					                                   &image->image);
+					const bool decode_image = nqiv_worker_handle_image_load_form(
+						&image_load->image_options, image, &image->image, &image_decode);
 					if(!image->thumbnail_attempted && image_load->create_thumbnail) {
 						/* If we can load the thumbnail and are allowed to create it, then make sure
 						 * it also is up to date. This involves loading the image form, as well. */
@@ -183,35 +520,119 @@ void nqiv_worker_main(nqiv_log_ctx*        logger,
 						}
 						image->thumbnail_attempted = true;
 					}
-					nqiv_worker_handle_image_load_form(&image_load->thumbnail_options, image,
-					                                   &image->thumbnail);
+					const bool decode_thumbnail = nqiv_worker_handle_image_load_form(
+						&image_load->thumbnail_options, image, &image->thumbnail,
+						&thumbnail_decode);
 					if(image_load->borrow_thumbnail_dimension_metadata) {
 						nqiv_image_borrow_thumbnail_dimensions(image);
 					}
+					SDL_AtomicSet(&image->worker, worker_index + 1);
+					nqiv_image_manager_list_loaded(image->parent, image);
 					nqiv_image_unlock(image);
+					/* Decoding is left to jobs of its own, which any worker may take. */
+					if(decode_image) {
+						nqiv_worker_send_decode(logger, pool, &event, &image_decode);
+					}
+					if(decode_thumbnail) {
+						nqiv_worker_send_decode(logger, pool, &event, &thumbnail_decode);
+					}
 					break;
 				}
+			case NQIV_EVENT_FORM_DECODE:
+				nqiv_log_write(logger, NQIV_LOG_DEBUG, "Received form decode event on thread %d.\n",
+				               omp_get_thread_num());
+				nqiv_worker_run_decode(event.options.form_decode.image,
+				                       event.options.form_decode.decode);
+				free(event.options.form_decode.decode);
+				break;
+			case NQIV_EVENT_IMAGE_REFINE:
+				nqiv_log_write(logger, NQIV_LOG_DEBUG,
+				               "Received image refine event on thread %d.\n",
+				               omp_get_thread_num());
+				nqiv_image_form_refine(event.options.image_refine.image,
+				                       &event.options.image_refine);
+				break;
 			}
 		} else {
-			/* No more events? Inform master if any events have been processed. Otherwise, sleep for
-			 * polling interval. */
+			/* No more events? Inform master if any events have been processed. Otherwise, sleep
+			 * until more are pushed. */
 			if(events_processed > 0) {
 				nqiv_log_write(logger, NQIV_LOG_DEBUG,
 				               "Thread %d waking master after processing %d events\n",
 				               omp_get_thread_num(), events_processed);
 				events_processed = 0;
-				SDL_Event tell_finished = {0};
-				tell_finished.type = SDL_USEREVENT;
-				tell_finished.user.code = (Sint32)event_code;
-				if(SDL_PushEvent(&tell_finished) < 0) {
-					nqiv_log_write(logger, NQIV_LOG_ERROR,
-					               "Failed to send SDL event from thread %d. SDL Error: %s\n",
-					               omp_get_thread_num(), SDL_GetError());
+				if(!nqiv_worker_pool_wake_master(pool, logger, event_code)) {
 					running = false;
 				}
 			} else {
-				SDL_Delay(wait_time);
+				nqiv_priority_queue_wait_many(pool->queues, pool->queue_count, wait_time);
+			}
+		}
+	}
+}
+
+void nqiv_worker_io_main(nqiv_log_ctx*     logger,
+                         nqiv_worker_pool* pool,
+                         nqiv_worker_pool* forward,
+                         const int         worker_index,
+                         const int         delay_base)
+{
+	assert(worker_index >= 0);
+	assert(worker_index < pool->count);
+	const int wait_time = delay_base > 0 ? delay_base + omp_get_thread_num() : 0;
+	char*     buffer = malloc(NQIV_WORKER_PREFETCH_BUFFER_SIZE);
+	nqiv_worker_apply_scheduling(logger, pool);
+	if(buffer == NULL) {
+		nqiv_log_write(logger, NQIV_LOG_ERROR, "Failed to allocate buffer for I/O thread %d.\n",
+		               omp_get_thread_num());
+	}
+	bool running = true;
+	while(running) {
+		nqiv_event event = {0};
+		if(nqiv_worker_pool_park(pool, worker_index)) {
+			nqiv_log_write(logger, NQIV_LOG_DEBUG, "Unparked I/O thread %d.\n",
+			               omp_get_thread_num());
+		}
+		if(!nqiv_priority_queue_pop(pool->shared, &event)) {
+			nqiv_priority_queue_wait(pool->shared, wait_time);
+			continue;
+		}
+		switch(event.type) {
+		case NQIV_EVENT_WORKER_STOP:
+			nqiv_log_write(logger, NQIV_LOG_DEBUG, "Received stop event on I/O thread %d.\n",
+			               omp_get_thread_num());
+			running = false;
+			break;
+		case NQIV_EVENT_IMAGE_LOAD:
+			{
+				nqiv_image* image = event.options.image_load.image;
+				/* Drop it here if it's out of date, rather than pass it on. */
+				if(nqiv_image_manager_event_is_dead(&event)) {
+					break;
+				}
+				if(buffer != NULL) {
+					nqiv_worker_prefetch_event(&event.options.image_load, buffer,
+					                           NQIV_WORKER_PREFETCH_BUFFER_SIZE);
+				}
+				if(!nqiv_priority_queue_push(nqiv_worker_pool_get_queue(forward, image),
+				                             event.level, &event)) {
+					nqiv_log_write(logger, NQIV_LOG_ERROR,
+					               "Failed to pass on event from I/O thread %d.\n",
+					               omp_get_thread_num());
+					nqiv_image_event_discard(&event);
+				}
+				break;
 			}
+		case NQIV_EVENT_FORM_DECODE:
+			/* Only sent by the workers decoding. */
+			assert(false);
+			nqiv_image_event_discard(&event);
+			break;
+		case NQIV_EVENT_IMAGE_REFINE:
+			/* Never reads files, so it isn't sent here. */
+			assert(false);
+			break;
 		}
 	}
+	free(buffer);
 }
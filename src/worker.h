@@ -8,25 +8,104 @@
 
 #include "queue.h"
 #include "image.h"
+#include "event.h"
 
 /*
- * Worker threads function by polling their queue by a certain wait time. They
- * will grab events until they find one with an event interval greater than the
- * current, or -1. Others will be discarded. Then they will dispatch the
- * appropriate code to handle that event. (See event.h for an overview of
- * events)
+ * Workers belong to a pool. Each has a local queue of its own, alongside the
+ * shared queue of the pool. Loads for an image are sent to the local queue of
+ * the worker that last loaded it, so the image's data is more likely to still
+ * be in that worker's caches. Everything else goes to the shared queue.
+ *
+ * Loads which read files may first pass through a separate pool of I/O
+ * workers, which have only the shared queue. An I/O worker reads the files the
+ * load will need, so they are in the OS's page cache, and then passes the event
+ * on to the pool above at the same priority. This way, workers decoding and
+ * encoding images are not left blocked on slow disks, while reading for the
+ * next images carries on alongside them. I/O workers aren't governed, but are
+ * parked like the others while nqiv is in the background.
+ *
+ * Worker threads function by blocking on the queues of their pool until
+ * something is pushed to one of them, or an optional wait time passes. They
+ * take the highest priority event available, preferring their own queue, then
+ * the shared one, then stealing from the other workers, so an idle worker never
+ * sits beside a busy one's backlog. They will grab events until they find one
+ * that is still current (see nqiv_image_event_is_current). Others will be
+ * discarded. Then they will dispatch the appropriate code to handle that
+ * event. (See event.h for an overview of events)
  *
  * When the event interval is met or there are no more events, they will send an
- * SDL event for the master to update its display, then sleep to repeat the
- * polling process.
+ * SDL event for the master to update its display, then sleep until the queues
+ * are pushed to again. Only one such event is sent until the master consumes it,
+ * so workers finishing together cause a single redraw.
+ *
+ * Only the first active_count workers of a pool take events. The rest are
+ * parked until it's raised again. See governor.h
+ *
+ * Workers may run at a lower scheduling priority than the master, so even
+ * when they keep every processor busy, input and rendering are not held up.
  */
 
-void nqiv_worker_main(nqiv_log_ctx*        logger,
-                      nqiv_priority_queue* queue,
-                      const int            delay_base,
-                      const int            event_interval,
-                      const Uint32         event_code,
-                      const int64_t*       transaction_group,
-                      omp_lock_t*          transaction_group_lock);
+typedef struct nqiv_worker_pool
+{
+	/* Events any worker may take. Not owned by the pool. */
+	nqiv_priority_queue*  shared;
+	/* One queue per worker, for events with an affinity to it. NULL if there are none. */
+	nqiv_priority_queue*  locals;
+	/* shared followed by locals, to wait on all of them at once. */
+	nqiv_priority_queue** queues;
+	int                   queue_count;
+	/* Number of workers. */
+	int                   count;
+	/* Workers with an index past this are parked. */
+	SDL_atomic_t          active_count;
+	SDL_mutex*            park_mutex;
+	/* Broadcast when active_count changes. */
+	SDL_cond*             park_cond;
+	/* Events handled so far, to measure throughput. */
+	SDL_atomic_t          processed;
+	/* Set while an SDL event sent to wake the master hasn't been consumed. */
+	SDL_atomic_t          wake_pending;
+	/* Workers lower their scheduling priority to these as they start. See
+	 * nqiv_set_thread_background. */
+	int                   niceness;
+	bool                  idle;
+} nqiv_worker_pool;
+
+/* Take ownership of count initialized local queues, which will share wakeups with shared. If locals
+ * is NULL, the count workers only use shared. */
+bool                 nqiv_worker_pool_init(nqiv_worker_pool*    pool,
+                                           nqiv_log_ctx*        logger,
+                                           nqiv_priority_queue* shared,
+                                           nqiv_priority_queue* locals,
+                                           const int            count);
+void                 nqiv_worker_pool_destroy(nqiv_worker_pool* pool);
+/* Set how many workers take events, from 1 to the worker count. */
+void                 nqiv_worker_pool_set_active(nqiv_worker_pool* pool, const int active_count);
+int                  nqiv_worker_pool_get_active(nqiv_worker_pool* pool);
+/* Events in all queues of the pool. Only a snapshot. */
+int                  nqiv_worker_pool_get_backlog(nqiv_worker_pool* pool);
+/* Send an SDL event with event_code to wake the master, unless one is already pending. */
+bool                 nqiv_worker_pool_wake_master(nqiv_worker_pool* pool,
+                                                  nqiv_log_ctx*     logger,
+                                                  const Uint32      event_code);
+/* Called by the master on receiving the wakeup, before acting on it. */
+void                 nqiv_worker_pool_consume_wake(nqiv_worker_pool* pool);
+/* Queue to send a load event for the image to. */
+nqiv_priority_queue* nqiv_worker_pool_get_queue(nqiv_worker_pool* pool, nqiv_image* image);
+/* Is this a load which may read files, and so should go through the I/O workers first? */
+bool                 nqiv_worker_event_reads_files(const nqiv_event* event);
+
+void nqiv_worker_main(nqiv_log_ctx*     logger,
+                      nqiv_worker_pool* pool,
+                      const int         worker_index,
+                      const int         delay_base,
+                      const int         event_interval,
+                      const Uint32      event_code);
+/* Read files for load events from pool, then pass them on to forward. */
+void nqiv_worker_io_main(nqiv_log_ctx*     logger,
+                         nqiv_worker_pool* pool,
+                         nqiv_worker_pool* forward,
+                         const int         worker_index,
+                         const int         delay_base);
 
 #endif /* NQIV_WORKER_H */
@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+#include "../src/logging.h"
+#include "../src/array.h"
+#include "../src/atlas.h"
+
+#include "atlas_tests.h"
+
+/* Largest atlas. Slots of 20 fit 3 across, with a gutter between them. */
+#define ATLAS_TEST_SIZE      64
+#define ATLAS_TEST_SLOT_SIZE 20
+#define ATLAS_TEST_COLUMNS   3
+#define ATLAS_TEST_SLOTS     (ATLAS_TEST_COLUMNS * ATLAS_TEST_COLUMNS)
+
+typedef struct atlas_test_context
+{
+	nqiv_log_ctx       logger;
+	SDL_Surface*       target;
+	SDL_Renderer*      renderer;
+	SDL_Surface*       thumbnail;
+	nqiv_atlas_manager manager;
+} atlas_test_context;
+
+/* A software renderer needs no window, so it works without a display. */
+void atlas_test_setup(atlas_test_context* context, const int thumbnail_size)
+{
+	nqiv_log_init(&context->logger);
+	nqiv_log_set_prefix_format(&context->logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&context->logger, stderr);
+	context->logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&context->logger));
+	context->target = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_TEST_SIZE, ATLAS_TEST_SIZE, 32,
+	                                                 SDL_PIXELFORMAT_ABGR8888);
+	assert(context->target != NULL);
+	context->renderer = SDL_CreateSoftwareRenderer(context->target);
+	assert(context->renderer != NULL);
+	context->thumbnail = SDL_CreateRGBSurfaceWithFormat(0, thumbnail_size, thumbnail_size, 32,
+	                                                    SDL_PIXELFORMAT_ABGR8888);
+	assert(context->thumbnail != NULL);
+	assert(nqiv_atlas_manager_init(&context->manager, &context->logger, context->renderer,
+	                               ATLAS_TEST_SIZE));
+}
+
+void atlas_test_teardown(atlas_test_context* context)
+{
+	nqiv_atlas_manager_destroy(&context->manager);
+	SDL_FreeSurface(context->thumbnail);
+	SDL_DestroyRenderer(context->renderer);
+	SDL_FreeSurface(context->target);
+	nqiv_log_destroy(&context->logger);
+}
+
+int atlas_test_count(atlas_test_context* context)
+{
+	return nqiv_array_get_units_count(context->manager.atlases);
+}
+
+void atlas_test_slots(void)
+{
+	atlas_test_context context = {0};
+	nqiv_atlas_slot    slots[ATLAS_TEST_SLOTS + 1] = {{0}};
+	atlas_test_setup(&context, ATLAS_TEST_SLOT_SIZE);
+
+	/* Slots are laid out in shelves, a gutter apart, in an atlas just large enough for them. */
+	int idx;
+	for(idx = 0; idx < ATLAS_TEST_SLOTS; ++idx) {
+		assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+		                              &slots[idx]));
+		assert(slots[idx].atlas == slots[0].atlas);
+		assert(slots[idx].index == idx);
+		assert(slots[idx].rect.x
+		       == (idx % ATLAS_TEST_COLUMNS) * (ATLAS_TEST_SLOT_SIZE + NQIV_ATLAS_GUTTER));
+		assert(slots[idx].rect.y
+		       == (idx / ATLAS_TEST_COLUMNS) * (ATLAS_TEST_SLOT_SIZE + NQIV_ATLAS_GUTTER));
+		assert(slots[idx].rect.w == ATLAS_TEST_SLOT_SIZE);
+		assert(slots[idx].rect.h == ATLAS_TEST_SLOT_SIZE);
+		assert(slots[idx].id == (Uint64)idx + 1);
+	}
+	nqiv_atlas* first = slots[0].atlas;
+	assert(first->size
+	       == ATLAS_TEST_COLUMNS * (ATLAS_TEST_SLOT_SIZE + NQIV_ATLAS_GUTTER) - NQIV_ATLAS_GUTTER);
+	assert(first->taken_count == ATLAS_TEST_SLOTS);
+	assert(nqiv_atlas_manager_find(&context.manager, first->texture) == first);
+
+	/* A full atlas rolls over to a new one. */
+	assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+	                              &slots[ATLAS_TEST_SLOTS]));
+	assert(slots[ATLAS_TEST_SLOTS].atlas != first);
+	assert(slots[ATLAS_TEST_SLOTS].index == 0);
+	assert(atlas_test_count(&context) == 2);
+
+	/* A slot given back is taken again, with a new id. */
+	nqiv_atlas_slot_release(&slots[4]);
+	assert(slots[4].atlas == NULL);
+	assert(first->taken_count == ATLAS_TEST_SLOTS - 1);
+	assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+	                              &slots[4]));
+	assert(slots[4].atlas == first);
+	assert(slots[4].index == 4);
+	assert(slots[4].id == (Uint64)ATLAS_TEST_SLOTS + 2);
+
+	for(idx = 0; idx <= ATLAS_TEST_SLOTS; ++idx) {
+		nqiv_atlas_slot_release(&slots[idx]);
+	}
+	atlas_test_teardown(&context);
+}
+
+void atlas_test_release(void)
+{
+	atlas_test_context context = {0};
+	nqiv_atlas_slot    slots[ATLAS_TEST_SLOTS + 1] = {{0}};
+	nqiv_atlas_slot    small = {0};
+	atlas_test_setup(&context, ATLAS_TEST_SLOT_SIZE);
+
+	int idx;
+	for(idx = 0; idx <= ATLAS_TEST_SLOTS; ++idx) {
+		assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+		                              &slots[idx]));
+	}
+	assert(atlas_test_count(&context) == 2);
+
+	/* One empty atlas is kept for the current slot size, and any other is destroyed. */
+	nqiv_atlas_slot_release(&slots[ATLAS_TEST_SLOTS]);
+	assert(atlas_test_count(&context) == 2);
+	for(idx = 0; idx < ATLAS_TEST_SLOTS; ++idx) {
+		nqiv_atlas_slot_release(&slots[idx]);
+	}
+	assert(atlas_test_count(&context) == 1);
+
+	/* The spare is taken again rather than a new atlas made. */
+	nqiv_atlas* spare = ((nqiv_atlas**)context.manager.atlases->data)[0];
+	assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+	                              &slots[0]));
+	assert(slots[0].atlas == spare);
+	nqiv_atlas_slot_release(&slots[0]);
+	assert(atlas_test_count(&context) == 1);
+
+	/* Once the slot size changes, the spare for the old one goes. */
+	assert(nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE + 1,
+	                              &small));
+	assert(atlas_test_count(&context) == 1);
+	assert(small.atlas->slot_size == ATLAS_TEST_SLOT_SIZE + 1);
+	nqiv_atlas_slot_release(&small);
+	assert(atlas_test_count(&context) == 1);
+
+	atlas_test_teardown(&context);
+}
+
+void atlas_test_bypass(void)
+{
+	atlas_test_context context = {0};
+	nqiv_atlas_slot    slot = {0};
+	atlas_test_setup(&context, ATLAS_TEST_SIZE / 2);
+
+	/* Too few slots of this size fit for an atlas to be worth it. */
+	assert(!nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SIZE / 2,
+	                               &slot));
+	assert(slot.atlas == NULL);
+	/* The thumbnail doesn't fit the slot. */
+	assert(!nqiv_atlas_manager_add(&context.manager, context.thumbnail, ATLAS_TEST_SLOT_SIZE,
+	                               &slot));
+	assert(slot.atlas == NULL);
+	assert(atlas_test_count(&context) == 0);
+
+	atlas_test_teardown(&context);
+}
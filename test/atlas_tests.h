@@ -0,0 +1,8 @@
+#ifndef NQIV_ATLAS_TEST
+#define NQIV_ATLAS_TEST
+
+void atlas_test_slots(void);
+void atlas_test_release(void);
+void atlas_test_bypass(void);
+
+#endif /* NQIV_ATLAS_TEST */
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "../src/color.h"
+
+#include "color_tests.h"
+
+#define COLOR_TEST_POINTS (NQIV_COLOR_LUT_SIZE * NQIV_COLOR_LUT_SIZE * NQIV_COLOR_LUT_SIZE)
+
+/* Fill the table with the color of each point, inverted if asked. */
+void color_test_fill(nqiv_color_lut* lut, const bool invert)
+{
+	lut->table = malloc(COLOR_TEST_POINTS * 3);
+	assert(lut->table != NULL);
+	const int step = NQIV_COLOR_LUT_SIZE - 1;
+	int       idx;
+	for(idx = 0; idx < COLOR_TEST_POINTS * 3; ++idx) {
+		int point = idx / 3;
+		int channel;
+		for(channel = idx % 3; channel > 0; --channel) {
+			point /= NQIV_COLOR_LUT_SIZE;
+		}
+		const int value = (point % NQIV_COLOR_LUT_SIZE * 255 + step / 2) / step;
+		lut->table[idx] = (Uint8)(invert ? 255 - value : value);
+	}
+}
+
+void color_test_identity(void)
+{
+	nqiv_color_lut lut = {0};
+	color_test_fill(&lut, false);
+	Uint8 pixels[256 * 4];
+	int   idx;
+	for(idx = 0; idx < 256; ++idx) {
+		pixels[idx * 4] = (Uint8)idx;
+		pixels[idx * 4 + 1] = (Uint8)(255 - idx);
+		pixels[idx * 4 + 2] = (Uint8)(idx * 7);
+		pixels[idx * 4 + 3] = (Uint8)(idx / 2);
+	}
+	nqiv_color_lut_apply(&lut, pixels, 256);
+	for(idx = 0; idx < 256; ++idx) {
+		assert(abs(pixels[idx * 4] - idx) <= 1);
+		assert(abs(pixels[idx * 4 + 1] - (255 - idx)) <= 1);
+		assert(abs(pixels[idx * 4 + 2] - (Uint8)(idx * 7)) <= 1);
+		assert(pixels[idx * 4 + 3] == (Uint8)(idx / 2));
+	}
+	free(lut.table);
+}
+
+void color_test_invert(void)
+{
+	nqiv_color_lut lut = {0};
+	color_test_fill(&lut, true);
+	Uint8 pixels[] = {0, 0, 0, 255, 255, 255, 255, 0, 0, 255, 128, 7};
+	nqiv_color_lut_apply(&lut, pixels, 3);
+	assert(pixels[0] == 255 && pixels[1] == 255 && pixels[2] == 255 && pixels[3] == 255);
+	assert(pixels[4] == 0 && pixels[5] == 0 && pixels[6] == 0 && pixels[7] == 0);
+	assert(pixels[8] == 255 && pixels[9] == 0 && abs(pixels[10] - 127) <= 1 && pixels[11] == 7);
+	free(lut.table);
+}
+
+/* With one corner of the first cube of the grid lit, each pixel in the cube takes as much of it as
+ * the least it's past the lowest corner along the axes leading there, less the most along the rest.
+ * That only holds if the right tetrahedron is used. */
+void color_test_tetrahedra(void)
+{
+	nqiv_color_lut lut = {0};
+	lut.table = calloc(COLOR_TEST_POINTS * 3, 1);
+	assert(lut.table != NULL);
+	const int step = NQIV_COLOR_LUT_SIZE - 1;
+	/* Values inside the first cube, each past its lowest corner by value * step out of 255. */
+	const int values = (255 + step - 1) / step;
+	int       corner;
+	for(corner = 0; corner < 8; ++corner) {
+		const int lit = ((corner & 1) + (corner >> 1 & 1) * NQIV_COLOR_LUT_SIZE
+		                 + (corner >> 2 & 1) * NQIV_COLOR_LUT_SIZE * NQIV_COLOR_LUT_SIZE)
+		                * 3;
+		lut.table[lit] = 255;
+		int value;
+		for(value = 0; value < values * values * values; ++value) {
+			const int channels[3] = {value % values, value / values % values,
+			                         value / values / values};
+			Uint8     pixel[4] = {(Uint8)channels[0], (Uint8)channels[1], (Uint8)channels[2], 0};
+			int       least_in = 255;
+			int       most_out = 0;
+			int       axis;
+			for(axis = 0; axis < 3; ++axis) {
+				const int fraction = channels[axis] * step;
+				if((corner >> axis & 1) != 0) {
+					least_in = fraction < least_in ? fraction : least_in;
+				} else {
+					most_out = fraction > most_out ? fraction : most_out;
+				}
+			}
+			nqiv_color_lut_apply(&lut, pixel, 1);
+			assert(pixel[0] == (least_in > most_out ? least_in - most_out : 0));
+			assert(pixel[1] == 0 && pixel[2] == 0);
+		}
+		lut.table[lit] = 0;
+	}
+	free(lut.table);
+}
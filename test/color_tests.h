@@ -0,0 +1,8 @@
+#ifndef NQIV_COLOR_TEST
+#define NQIV_COLOR_TEST
+
+void color_test_identity(void);
+void color_test_invert(void);
+void color_test_tetrahedra(void);
+
+#endif /* NQIV_COLOR_TEST */
@@ -0,0 +1,240 @@
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+
+#include "../src/image.h"
+
+#include "image_tests.h"
+
+/* Stored image size, not square so turns can be told apart. */
+#define IMAGE_TEST_WIDTH  5
+#define IMAGE_TEST_HEIGHT 3
+
+/* Where pixel x, y of an image of width and height is shown, by the documented meaning of
+ * nqiv_image_orientation: mirrored, then turned clockwise. */
+void image_test_orient_point(const nqiv_image_orientation* orientation,
+                             const int                     width,
+                             const int                     height,
+                             int*                          x,
+                             int*                          y)
+{
+	int shown_width = width;
+	int shown_height = height;
+	if(orientation->flip) {
+		*x = shown_width - 1 - *x;
+	}
+	int turn;
+	for(turn = 0; turn < orientation->turns; ++turn) {
+		const int turned_x = shown_height - 1 - *y;
+		*y = *x;
+		*x = turned_x;
+		const int swap = shown_width;
+		shown_width = shown_height;
+		shown_height = swap;
+	}
+}
+
+/* Where pixel x, y is shown for an EXIF orientation tag, straight from the EXIF standard. */
+void image_test_exif_point(const int exif, const int width, const int height, int* x, int* y)
+{
+	const int old_x = *x;
+	const int old_y = *y;
+	switch(exif) {
+	case 1:
+		break;
+	case 2:
+		*x = width - 1 - old_x;
+		break;
+	case 3:
+		*x = width - 1 - old_x;
+		*y = height - 1 - old_y;
+		break;
+	case 4:
+		*y = height - 1 - old_y;
+		break;
+	case 5:
+		*x = old_y;
+		*y = old_x;
+		break;
+	case 6:
+		*x = height - 1 - old_y;
+		*y = old_x;
+		break;
+	case 7:
+		*x = height - 1 - old_y;
+		*y = width - 1 - old_x;
+		break;
+	case 8:
+		*x = old_y;
+		*y = width - 1 - old_x;
+		break;
+	default:
+		assert(false);
+	}
+}
+
+void image_test_orientation_from_exif(void)
+{
+	const struct
+	{
+		int                    exif;
+		nqiv_image_orientation expected;
+	} cases[] = {
+		{1, {0, false}}, {2, {0, true}}, {3, {2, false}}, {4, {2, true}}, {5, {3, true}},
+		{6, {1, false}}, {7, {1, true}}, {8, {3, false}},
+		/* Anything else is left as it is. */
+		{0, {0, false}}, {9, {0, false}}, {-1, {0, false}},
+	};
+	int idx;
+	for(idx = 0; idx < (int)(sizeof(cases) / sizeof(cases[0])); ++idx) {
+		const nqiv_image_orientation orientation =
+			nqiv_image_orientation_from_exif(cases[idx].exif);
+		assert(orientation.turns == cases[idx].expected.turns);
+		assert(orientation.flip == cases[idx].expected.flip);
+		assert(nqiv_image_orientation_swaps_axes(&orientation) == (cases[idx].exif >= 5
+		                                                           && cases[idx].exif <= 8));
+		if(cases[idx].exif < 1 || cases[idx].exif > 8) {
+			continue;
+		}
+		int x;
+		int y;
+		for(y = 0; y < IMAGE_TEST_HEIGHT; ++y) {
+			for(x = 0; x < IMAGE_TEST_WIDTH; ++x) {
+				int shown_x = x;
+				int shown_y = y;
+				int exif_x = x;
+				int exif_y = y;
+				image_test_orient_point(&orientation, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT, &shown_x,
+				                        &shown_y);
+				image_test_exif_point(cases[idx].exif, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT,
+				                      &exif_x, &exif_y);
+				assert(shown_x == exif_x);
+				assert(shown_y == exif_y);
+			}
+		}
+	}
+}
+
+void image_test_orientation_combine(void)
+{
+	const struct
+	{
+		nqiv_image_orientation first;
+		nqiv_image_orientation second;
+		nqiv_image_orientation expected;
+	} cases[] = {
+		{{0, false}, {0, false}, {0, false}},
+		{{1, false}, {1, false}, {2, false}},
+		{{3, false}, {2, false}, {1, false}},
+		{{0, true}, {0, true}, {0, false}},
+		/* Turning then mirroring is mirroring then turning the other way. */
+		{{1, false}, {0, true}, {3, true}},
+		{{3, false}, {0, true}, {1, true}},
+		{{0, true}, {1, false}, {1, true}},
+		{{1, true}, {1, false}, {2, true}},
+		{{1, true}, {1, true}, {0, false}},
+		{{3, true}, {2, true}, {3, false}},
+	};
+	int idx;
+	for(idx = 0; idx < (int)(sizeof(cases) / sizeof(cases[0])); ++idx) {
+		const nqiv_image_orientation combined =
+			nqiv_image_orientation_combine(&cases[idx].first, &cases[idx].second);
+		assert(combined.turns == cases[idx].expected.turns);
+		assert(combined.flip == cases[idx].expected.flip);
+	}
+	/* Every pair puts each pixel where doing one after the other would. */
+	int first_exif;
+	int second_exif;
+	for(first_exif = 1; first_exif <= 8; ++first_exif) {
+		for(second_exif = 1; second_exif <= 8; ++second_exif) {
+			const nqiv_image_orientation first = nqiv_image_orientation_from_exif(first_exif);
+			const nqiv_image_orientation second = nqiv_image_orientation_from_exif(second_exif);
+			const nqiv_image_orientation combined = nqiv_image_orientation_combine(&first, &second);
+			assert(combined.turns >= 0 && combined.turns < 4);
+			const bool first_swaps = nqiv_image_orientation_swaps_axes(&first);
+			int        x;
+			int        y;
+			for(y = 0; y < IMAGE_TEST_HEIGHT; ++y) {
+				for(x = 0; x < IMAGE_TEST_WIDTH; ++x) {
+					int twice_x = x;
+					int twice_y = y;
+					int once_x = x;
+					int once_y = y;
+					image_test_orient_point(&first, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT, &twice_x,
+					                        &twice_y);
+					image_test_orient_point(&second,
+					                        first_swaps ? IMAGE_TEST_HEIGHT : IMAGE_TEST_WIDTH,
+					                        first_swaps ? IMAGE_TEST_WIDTH : IMAGE_TEST_HEIGHT,
+					                        &twice_x, &twice_y);
+					image_test_orient_point(&combined, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT, &once_x,
+					                        &once_y);
+					assert(once_x == twice_x);
+					assert(once_y == twice_y);
+				}
+			}
+		}
+	}
+}
+
+void image_test_orientation_unmap_rect(void)
+{
+	/* The top left pixel as shown, and where it is in the stored image, by the EXIF standard. */
+	const struct
+	{
+		int      exif;
+		SDL_Rect expected;
+	} corners[] = {
+		{1, {0, 0, 1, 1}},
+		{2, {IMAGE_TEST_WIDTH - 1, 0, 1, 1}},
+		{3, {IMAGE_TEST_WIDTH - 1, IMAGE_TEST_HEIGHT - 1, 1, 1}},
+		{4, {0, IMAGE_TEST_HEIGHT - 1, 1, 1}},
+		{5, {0, 0, 1, 1}},
+		{6, {0, IMAGE_TEST_HEIGHT - 1, 1, 1}},
+		{7, {IMAGE_TEST_WIDTH - 1, IMAGE_TEST_HEIGHT - 1, 1, 1}},
+		{8, {IMAGE_TEST_WIDTH - 1, 0, 1, 1}},
+	};
+	/* As shown, for each orientation. Kept inside the smaller side. */
+	const SDL_Rect shown_rects[] = {
+		{0, 0, 1, 1}, {0, 0, 3, 3}, {1, 0, 2, 1}, {0, 1, 1, 2}, {1, 1, 2, 2}, {2, 0, 1, 3},
+	};
+	int idx;
+	for(idx = 0; idx < (int)(sizeof(corners) / sizeof(corners[0])); ++idx) {
+		const nqiv_image_orientation orientation =
+			nqiv_image_orientation_from_exif(corners[idx].exif);
+		const bool swaps = nqiv_image_orientation_swaps_axes(&orientation);
+		const int  shown_width = swaps ? IMAGE_TEST_HEIGHT : IMAGE_TEST_WIDTH;
+		const int  shown_height = swaps ? IMAGE_TEST_WIDTH : IMAGE_TEST_HEIGHT;
+		SDL_Rect   rect = {0, 0, 1, 1};
+		nqiv_image_orientation_unmap_rect(&orientation, shown_width, shown_height, &rect);
+		assert(rect.x == corners[idx].expected.x);
+		assert(rect.y == corners[idx].expected.y);
+		assert(rect.w == corners[idx].expected.w);
+		assert(rect.h == corners[idx].expected.h);
+		/* Each pixel of the unmapped rect is shown inside the rect it came from. */
+		int rect_idx;
+		for(rect_idx = 0; rect_idx < (int)(sizeof(shown_rects) / sizeof(shown_rects[0]));
+		    ++rect_idx) {
+			const SDL_Rect* shown = &shown_rects[rect_idx];
+			memcpy(&rect, shown, sizeof(SDL_Rect));
+			nqiv_image_orientation_unmap_rect(&orientation, shown_width, shown_height, &rect);
+			assert(rect.w * rect.h == shown->w * shown->h);
+			assert(rect.x >= 0 && rect.y >= 0);
+			assert(rect.x + rect.w <= IMAGE_TEST_WIDTH);
+			assert(rect.y + rect.h <= IMAGE_TEST_HEIGHT);
+			int x;
+			int y;
+			for(y = rect.y; y < rect.y + rect.h; ++y) {
+				for(x = rect.x; x < rect.x + rect.w; ++x) {
+					int shown_x = x;
+					int shown_y = y;
+					image_test_orient_point(&orientation, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT,
+					                        &shown_x, &shown_y);
+					assert(shown_x >= shown->x && shown_x < shown->x + shown->w);
+					assert(shown_y >= shown->y && shown_y < shown->y + shown->h);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,8 @@
+#ifndef NQIV_IMAGE_TEST
+#define NQIV_IMAGE_TEST
+
+void image_test_orientation_from_exif(void);
+void image_test_orientation_combine(void);
+void image_test_orientation_unmap_rect(void);
+
+#endif /* NQIV_IMAGE_TEST */
@@ -394,6 +394,7 @@ void pruner_test_check_instance(const char*          pruner_string,
 		img->image.data = effects->load_image_surface ? (void*)0xDEADBEEF : NULL;
 		img->image.surface = effects->load_image_surface ? (void*)0xDEADBEEF : NULL;
 		img->image.animation.exists = effects->animated_image;
+		assert(nqiv_image_manager_list_loaded(&images, img));
 	}
 	assert(montage_position >= 0);
 	assert(montage_position <= nqiv_array_get_units_count(images.images));
@@ -414,7 +415,8 @@ void pruner_test_check_instance(const char*          pruner_string,
 	nqiv_event e = {0};
 	while(nqiv_priority_queue_pop(&queue, &e)) {
 		assert(e.type == NQIV_EVENT_IMAGE_LOAD);
-		assert(e.transaction_group == 0);
+		assert(e.lifetime == NQIV_EVENT_LIFETIME_GENERATION);
+		assert(e.generation == 0);
 		assert(e.options.image_load.image != NULL);
 		assert(!e.options.image_load.set_thumbnail_path);
 		assert(!e.options.image_load.create_thumbnail);
@@ -442,6 +444,8 @@ void pruner_test_check_instance(const char*          pruner_string,
 	for(c = 0; c < image_count; ++c) {
 		nqiv_image* img;
 		assert(nqiv_array_get(images.images, c, &img));
+		/* Only images with something loaded are left to prune next time. */
+		assert((img->loaded_position != 0) == nqiv_image_has_loaded_form(img));
 		img->thumbnail.vips = NULL;
 		img->thumbnail.data = NULL;
 		img->thumbnail.surface = NULL;
@@ -1,13 +1,23 @@
 #include <assert.h>
 
+#include <omp.h>
+
 #include "../src/logging.h"
 #include "../src/queue.h"
 
 #include "../src/array.h"
 #include "queue_tests.h"
 
-#define QUEUE_TEST_STANDARD_SIZE 3
-#define QUEUE_TEST_BIN_COUNT     2
+#define QUEUE_TEST_STANDARD_SIZE   3
+#define QUEUE_TEST_BIN_COUNT       2
+#define QUEUE_TEST_THREAD_COUNT    4
+#define QUEUE_TEST_THREAD_PUSHES   10000
+#define QUEUE_TEST_AGING_BIN_COUNT 3
+#define QUEUE_TEST_AGING_INTERVAL  40
+#define QUEUE_TEST_BATCH_ENTRIES   6
+#define QUEUE_TEST_PURGE_ENTRIES   100
+#define QUEUE_TEST_PURGE_ROUNDS    200
+#define QUEUE_TEST_PURGE_SPINS     1000
 
 void queue_test_default(void)
 {
@@ -101,3 +111,525 @@ void queue_test_priority_default(void)
 	nqiv_priority_queue_destroy(&queue);
 	nqiv_log_destroy(&logger);
 }
+
+void queue_test_priority_wait(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	int                 c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_is_empty(&queue));
+	assert(!nqiv_priority_queue_wait(&queue, 1));
+
+	assert(nqiv_priority_queue_push(&queue, 1, &c));
+	assert(!nqiv_priority_queue_is_empty(&queue));
+	assert(nqiv_priority_queue_wait(&queue, 1));
+	assert(nqiv_priority_queue_wait(&queue, 0));
+
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(nqiv_priority_queue_is_empty(&queue));
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+void queue_test_priority_fifo(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	int                 c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	/* Rounded up to 4 */
+	assert(nqiv_priority_queue_set_fifo(&queue, 1, QUEUE_TEST_STANDARD_SIZE));
+	for(c = 0; c < 6; ++c) {
+		assert(nqiv_priority_queue_push(&queue, 1, &c));
+	}
+	c = 6;
+	assert(nqiv_priority_queue_push(&queue, 0, &c));
+	c = 7;
+	assert(nqiv_priority_queue_push(&queue, 0, &c));
+	assert(nqiv_priority_queue_get_count(&queue) == 8);
+
+	/* LIFO bin first. */
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 7);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 6);
+	/* Then the ring in order. */
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 0);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 1);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 2);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 3);
+	/* Then what spilled over. */
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 5);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 4);
+	assert(!nqiv_priority_queue_pop(&queue, &c));
+	assert(nqiv_priority_queue_is_empty(&queue));
+	assert(nqiv_priority_queue_get_count(&queue) == 0);
+
+	/* Ring is reusable after wrapping around. */
+	c = 8;
+	assert(nqiv_priority_queue_push(&queue, 1, &c));
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 8);
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+void queue_test_priority_contention(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	int                 popped[QUEUE_TEST_THREAD_COUNT] = {0};
+	long                sums[QUEUE_TEST_THREAD_COUNT] = {0};
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_set_max_data_length(&queue, QUEUE_TEST_THREAD_COUNT * QUEUE_TEST_THREAD_PUSHES));
+	assert(nqiv_priority_queue_set_min_add_count(&queue, QUEUE_TEST_THREAD_PUSHES));
+	/* Small enough to spill over under load. */
+	assert(nqiv_priority_queue_set_fifo(&queue, 1, QUEUE_TEST_THREAD_PUSHES / 10));
+
+	/* Every thread pushes to both bins, and pops until it has seen its share. */
+	/* clang-format off */
+	#pragma omp parallel num_threads(QUEUE_TEST_THREAD_COUNT)
+	/* clang-format on */
+	{
+		const int thread = omp_get_thread_num();
+		int       idx;
+		for(idx = 0; idx < QUEUE_TEST_THREAD_PUSHES; ++idx) {
+			const int value = thread * QUEUE_TEST_THREAD_PUSHES + idx;
+			assert(nqiv_priority_queue_push(&queue, idx % QUEUE_TEST_BIN_COUNT, &value));
+			int c;
+			if(nqiv_priority_queue_pop(&queue, &c)) {
+				popped[thread] += 1;
+				sums[thread] += c;
+			}
+		}
+		int c;
+		while(nqiv_priority_queue_pop(&queue, &c)) {
+			popped[thread] += 1;
+			sums[thread] += c;
+		}
+	}
+
+	int  total_popped = 0;
+	long total_sum = 0;
+	int  idx;
+	for(idx = 0; idx < QUEUE_TEST_THREAD_COUNT; ++idx) {
+		total_popped += popped[idx];
+		total_sum += sums[idx];
+	}
+	const long count = QUEUE_TEST_THREAD_COUNT * QUEUE_TEST_THREAD_PUSHES;
+	assert(total_popped == count);
+	assert(total_sum == count * (count - 1) / 2);
+	assert(nqiv_priority_queue_is_empty(&queue));
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+void queue_test_priority_share_wakeup(void)
+{
+	nqiv_log_ctx         logger = {0};
+	nqiv_priority_queue  shared = {0};
+	nqiv_priority_queue  local = {0};
+	nqiv_priority_queue* queues[2] = {&shared, &local};
+	int                  c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&shared, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_init(&local, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	nqiv_priority_queue_share_wakeup(&local, &shared);
+	assert(local.wakeup_mutex == shared.wakeup_mutex);
+	assert(local.wakeup_cond == shared.wakeup_cond);
+	assert(nqiv_priority_queue_first_level(&local) == -1);
+	assert(!nqiv_priority_queue_wait_many(queues, 2, 1));
+
+	assert(nqiv_priority_queue_push(&local, 1, &c));
+	assert(nqiv_priority_queue_push(&local, 0, &c));
+	assert(nqiv_priority_queue_first_level(&local) == 0);
+	assert(nqiv_priority_queue_first_level(&shared) == -1);
+	assert(nqiv_priority_queue_wait_many(queues, 2, 0));
+
+	assert(nqiv_priority_queue_pop(&local, &c));
+	assert(nqiv_priority_queue_pop(&local, &c));
+	assert(!nqiv_priority_queue_pop(&local, &c));
+	assert(nqiv_priority_queue_first_level(&local) == -1);
+
+	nqiv_priority_queue_destroy(&local);
+	nqiv_priority_queue_destroy(&shared);
+	nqiv_log_destroy(&logger);
+}
+
+/* Stands in for SDL_GetTicks64, so aging is tested without waiting. */
+Uint64 queue_test_ticks = 0;
+
+Uint64 queue_test_get_ticks(void)
+{
+	return queue_test_ticks;
+}
+
+void queue_test_priority_aging(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	int                 c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_AGING_BIN_COUNT));
+	queue_test_ticks = 0;
+	nqiv_priority_queue_set_clock(&queue, queue_test_get_ticks);
+	nqiv_priority_queue_set_aging(&queue, QUEUE_TEST_AGING_INTERVAL);
+	c = 2;
+	assert(nqiv_priority_queue_push(&queue, 2, &c));
+	assert(nqiv_priority_queue_first_level(&queue) == 2);
+	/* Just short of rising a level. */
+	queue_test_ticks += QUEUE_TEST_AGING_INTERVAL - 1;
+	assert(nqiv_priority_queue_first_level(&queue) == 2);
+	queue_test_ticks += 1;
+	assert(nqiv_priority_queue_first_level(&queue) == 1);
+	/* Long enough for the waiting bin to rise two levels, and no further than 0. */
+	queue_test_ticks += QUEUE_TEST_AGING_INTERVAL * 2;
+	assert(nqiv_priority_queue_first_level(&queue) == 0);
+	c = 1;
+	assert(nqiv_priority_queue_push(&queue, 1, &c));
+	c = 0;
+	assert(nqiv_priority_queue_push(&queue, 0, &c));
+	assert(nqiv_priority_queue_first_level(&queue) == 0);
+
+	/* Ties in aged level go to the actual level. */
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 0);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 2);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 1);
+	assert(!nqiv_priority_queue_pop(&queue, &c));
+
+	/* A bin only ages while it waits, from when it was last served. */
+	c = 2;
+	assert(nqiv_priority_queue_push(&queue, 2, &c));
+	c = 1;
+	assert(nqiv_priority_queue_push(&queue, 1, &c));
+	queue_test_ticks += QUEUE_TEST_AGING_INTERVAL;
+	assert(nqiv_priority_queue_first_level(&queue) == 0);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 1);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 2);
+	assert(!nqiv_priority_queue_pop(&queue, &c));
+	/* The clock wrapping past the truncated ticks is still counted as time waited. */
+	queue_test_ticks = 0xFFFFFFFF - QUEUE_TEST_AGING_INTERVAL / 2;
+	c = 2;
+	assert(nqiv_priority_queue_push(&queue, 2, &c));
+	queue_test_ticks += QUEUE_TEST_AGING_INTERVAL;
+	assert(nqiv_priority_queue_first_level(&queue) == 1);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+
+	/* Without aging, levels are followed strictly again. */
+	nqiv_priority_queue_set_aging(&queue, 0);
+	c = 2;
+	assert(nqiv_priority_queue_push(&queue, 2, &c));
+	queue_test_ticks += QUEUE_TEST_AGING_INTERVAL * 2;
+	c = 1;
+	assert(nqiv_priority_queue_push(&queue, 1, &c));
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 1);
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+int queue_test_batch_failures = 0;
+
+void queue_test_count_failure(const void* entry)
+{
+	(void)entry;
+	queue_test_batch_failures += 1;
+}
+
+void queue_test_priority_batch(void)
+{
+	nqiv_log_ctx              logger = {0};
+	nqiv_priority_queue       first = {0};
+	nqiv_priority_queue       second = {0};
+	nqiv_priority_queue_batch batch = {0};
+	int                       c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&first, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_init(&second, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_set_fifo(&second, 1, QUEUE_TEST_STANDARD_SIZE));
+	assert(nqiv_priority_queue_batch_init(&batch, &logger, sizeof(int)));
+	assert(nqiv_priority_queue_batch_is_empty(&batch));
+
+	/* Interleaved between queues and levels. The ring of the FIFO bin holds four entries, and the
+	 * rest overflow into its LIFO bin. */
+	for(c = 0; c < QUEUE_TEST_BATCH_ENTRIES; ++c) {
+		if(c < QUEUE_TEST_STANDARD_SIZE) {
+			assert(nqiv_priority_queue_batch_add(&batch, &first, 1, &c));
+		}
+		assert(nqiv_priority_queue_batch_add(&batch, &second, 1, &c));
+	}
+	c = 10;
+	assert(nqiv_priority_queue_batch_add(&batch, &first, 0, &c));
+	assert(!nqiv_priority_queue_batch_is_empty(&batch));
+	assert(nqiv_priority_queue_batch_submit(&batch, queue_test_count_failure));
+	assert(nqiv_priority_queue_batch_is_empty(&batch));
+	assert(queue_test_batch_failures == 0);
+	assert(nqiv_priority_queue_get_count(&first) == QUEUE_TEST_STANDARD_SIZE + 1);
+	assert(nqiv_priority_queue_get_count(&second) == QUEUE_TEST_BATCH_ENTRIES);
+
+	assert(nqiv_priority_queue_pop(&first, &c));
+	assert(c == 10);
+	int expected;
+	for(expected = QUEUE_TEST_STANDARD_SIZE - 1; expected >= 0; --expected) {
+		assert(nqiv_priority_queue_pop(&first, &c));
+		assert(c == expected);
+	}
+	assert(!nqiv_priority_queue_pop(&first, &c));
+	for(expected = 0; expected < 4; ++expected) {
+		assert(nqiv_priority_queue_pop(&second, &c));
+		assert(c == expected);
+	}
+	for(expected = QUEUE_TEST_BATCH_ENTRIES - 1; expected >= 4; --expected) {
+		assert(nqiv_priority_queue_pop(&second, &c));
+		assert(c == expected);
+	}
+	assert(!nqiv_priority_queue_pop(&second, &c));
+
+	/* More than a LIFO bin may hold. None of it is pushed. */
+	for(c = 0; c < QUEUE_TEST_STANDARD_SIZE + 1; ++c) {
+		assert(nqiv_priority_queue_batch_add(&batch, &first, 0, &c));
+	}
+	assert(!nqiv_priority_queue_batch_submit(&batch, queue_test_count_failure));
+	assert(queue_test_batch_failures == QUEUE_TEST_STANDARD_SIZE + 1);
+	assert(nqiv_priority_queue_is_empty(&first));
+
+	nqiv_priority_queue_batch_destroy(&batch);
+	nqiv_priority_queue_destroy(&second);
+	nqiv_priority_queue_destroy(&first);
+	nqiv_log_destroy(&logger);
+}
+
+bool queue_test_is_odd(const void* entry)
+{
+	return *(const int*)entry % 2 == 1;
+}
+
+void queue_test_priority_purge(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	int                 c = 0;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE * 2,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_set_fifo(&queue, 1, QUEUE_TEST_STANDARD_SIZE));
+	for(c = 0; c < 6; ++c) {
+		assert(nqiv_priority_queue_push(&queue, 0, &c));
+		assert(nqiv_priority_queue_push(&queue, 1, &c));
+	}
+	assert(nqiv_priority_queue_purge(&queue, queue_test_is_odd) == 6);
+
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 4);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 2);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 0);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 0);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 2);
+	assert(nqiv_priority_queue_pop(&queue, &c));
+	assert(c == 4);
+	assert(!nqiv_priority_queue_pop(&queue, &c));
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+/* Slow enough that entries are out of the ring a while when purged. */
+bool queue_test_is_odd_slowly(const void* entry)
+{
+	volatile int spin;
+	for(spin = 0; spin < QUEUE_TEST_PURGE_SPINS; ++spin) {
+	}
+	return queue_test_is_odd(entry);
+}
+
+void queue_test_priority_purge_contention(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+	SDL_atomic_t        done = {0};
+	int                 round;
+	int                 c;
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	assert(nqiv_priority_queue_set_fifo(&queue, 1, QUEUE_TEST_PURGE_ENTRIES));
+
+	/* Each round, one thread purges until the queue is empty, while the rest pop until it's done.
+	 * Pops find the ring empty while purged survivors are out of it, and nothing else is pushed,
+	 * so the survivors must be marked again when put back. Otherwise they're never popped. */
+	for(round = 0; round < QUEUE_TEST_PURGE_ROUNDS; ++round) {
+		int popped[QUEUE_TEST_THREAD_COUNT] = {0};
+		int purged = 0;
+		for(c = 0; c < QUEUE_TEST_PURGE_ENTRIES; ++c) {
+			assert(nqiv_priority_queue_push(&queue, 1, &c));
+		}
+		SDL_AtomicSet(&done, 0);
+		/* clang-format off */
+		#pragma omp parallel num_threads(QUEUE_TEST_THREAD_COUNT)
+		/* clang-format on */
+		{
+			const int thread = omp_get_thread_num();
+			if(thread == 0) {
+				int passes;
+				for(passes = 0; passes < QUEUE_TEST_PURGE_ENTRIES
+				                && nqiv_priority_queue_get_count(&queue) > 0;
+				    ++passes) {
+					purged += nqiv_priority_queue_purge(&queue, queue_test_is_odd_slowly);
+				}
+				SDL_AtomicSet(&done, 1);
+			} else {
+				int entry;
+				while(SDL_AtomicGet(&done) == 0) {
+					if(nqiv_priority_queue_pop(&queue, &entry)) {
+						popped[thread] += 1;
+					}
+				}
+			}
+		}
+
+		/* Nothing may be left behind where pops won't look. */
+		while(nqiv_priority_queue_pop(&queue, &c)) {
+			popped[0] += 1;
+		}
+		assert(nqiv_priority_queue_get_count(&queue) == 0);
+		int total_popped = 0;
+		int idx;
+		for(idx = 0; idx < QUEUE_TEST_THREAD_COUNT; ++idx) {
+			total_popped += popped[idx];
+		}
+		assert(total_popped + purged == QUEUE_TEST_PURGE_ENTRIES);
+	}
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
+/* Nanoseconds for each push and pop of every thread pushing to and popping from one bin. */
+double queue_test_time_bin(nqiv_priority_queue* queue, const int level)
+{
+	const double start = omp_get_wtime();
+	/* clang-format off */
+	#pragma omp parallel num_threads(QUEUE_TEST_THREAD_COUNT)
+	/* clang-format on */
+	{
+		int idx;
+		for(idx = 0; idx < QUEUE_TEST_THREAD_PUSHES; ++idx) {
+			assert(nqiv_priority_queue_push(queue, level, &idx));
+			int c;
+			assert(nqiv_priority_queue_pop(queue, &c));
+		}
+	}
+	const double elapsed = omp_get_wtime() - start;
+	assert(nqiv_priority_queue_is_empty(queue));
+	return elapsed * 1e9 / (double)(QUEUE_TEST_THREAD_COUNT * QUEUE_TEST_THREAD_PUSHES * 2);
+}
+
+/* Compare a FIFO bin's ring with a LIFO bin's locked array under contention. Only reported, since
+ * timings depend on the machine. */
+void queue_test_priority_benchmark(void)
+{
+	nqiv_log_ctx        logger = {0};
+	nqiv_priority_queue queue = {0};
+
+	nqiv_log_init(&logger);
+	nqiv_log_set_prefix_format(&logger, "#level# #time:%Y-%m-%d %T%z# ");
+	nqiv_log_add_stream(&logger, stderr);
+	logger.level = NQIV_LOG_ERROR;
+	assert(!nqiv_log_has_error(&logger));
+
+	assert(nqiv_priority_queue_init(&queue, &logger, sizeof(int), QUEUE_TEST_STANDARD_SIZE,
+	                                QUEUE_TEST_BIN_COUNT));
+	/* Every thread has at most one entry waiting, so the ring never spills. */
+	assert(nqiv_priority_queue_set_fifo(&queue, 1, QUEUE_TEST_THREAD_COUNT));
+
+	/* Warm up both, so neither pays for first touching memory. */
+	queue_test_time_bin(&queue, 0);
+	queue_test_time_bin(&queue, 1);
+	const double locked = queue_test_time_bin(&queue, 0);
+	const double ring = queue_test_time_bin(&queue, 1);
+	fprintf(stderr, "%d threads: locked bin %.1f ns per operation, ring %.1f ns per operation.\n",
+	        QUEUE_TEST_THREAD_COUNT, locked, ring);
+
+	nqiv_priority_queue_destroy(&queue);
+	nqiv_log_destroy(&logger);
+}
+
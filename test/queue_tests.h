@@ -3,5 +3,14 @@
 
 void queue_test_default(void);
 void queue_test_priority_default(void);
+void queue_test_priority_wait(void);
+void queue_test_priority_fifo(void);
+void queue_test_priority_contention(void);
+void queue_test_priority_purge(void);
+void queue_test_priority_purge_contention(void);
+void queue_test_priority_share_wakeup(void);
+void queue_test_priority_aging(void);
+void queue_test_priority_batch(void);
+void queue_test_priority_benchmark(void);
 
 #endif /* NQIV_QUEUE_TEST */
@@ -10,6 +10,9 @@
 #include "queue_tests.h"
 #include "keybind_tests.h"
 #include "keyrate_tests.h"
+#include "color_tests.h"
+#include "atlas_tests.h"
+#include "image_tests.h"
 
 /*
  * Run automated, self-contained tests.
@@ -216,6 +219,15 @@ test_set* create_tests(void)
 	S("queue");
 	T("queue_test_default", queue_test_default);
 	T("queue_test_priority_default", queue_test_priority_default);
+	T("queue_test_priority_wait", queue_test_priority_wait);
+	T("queue_test_priority_fifo", queue_test_priority_fifo);
+	T("queue_test_priority_contention", queue_test_priority_contention);
+	T("queue_test_priority_purge", queue_test_priority_purge);
+	T("queue_test_priority_purge_contention", queue_test_priority_purge_contention);
+	T("queue_test_priority_share_wakeup", queue_test_priority_share_wakeup);
+	T("queue_test_priority_aging", queue_test_priority_aging);
+	T("queue_test_priority_batch", queue_test_priority_batch);
+	T("queue_test_priority_benchmark", queue_test_priority_benchmark);
 
 	S("logging");
 	T("logging_general", logging_test_general);
@@ -232,6 +244,21 @@ test_set* create_tests(void)
 	S("keyrate");
 	T("keyrate_default", keyrate_test_default);
 
+	S("color");
+	T("color_identity", color_test_identity);
+	T("color_invert", color_test_invert);
+	T("color_tetrahedra", color_test_tetrahedra);
+
+	S("atlas");
+	T("atlas_slots", atlas_test_slots);
+	T("atlas_release", atlas_test_release);
+	T("atlas_bypass", atlas_test_bypass);
+
+	S("image");
+	T("image_orientation_from_exif", image_test_orientation_from_exif);
+	T("image_orientation_combine", image_test_orientation_combine);
+	T("image_orientation_unmap_rect", image_test_orientation_unmap_rect);
+
 	return root;
 }
 #undef FAIL